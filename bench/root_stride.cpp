@@ -0,0 +1,81 @@
+#include "bench.hpp"
+
+#include "surf.hpp"
+
+// Point queries on LoudsDense with and without the root stride directory
+// (kDenseRootStride), on random uint64 keys and on timestamp keys.
+// Usage: root_stride [number of keys]
+
+static const uint64_t kNumQueries = 2000000;
+static const int kNumRuns = 5;
+
+static double lookupLatency(const surf::LoudsDense* louds_dense,
+			    const std::vector<std::string>& queries,
+			    uint64_t& num_positive) {
+    double best = 0;
+    for (int run = 0; run < kNumRuns; run++) {
+	surf::position_t out_node_num = 0;
+	double start_time = bench::getNow();
+	for (const std::string& query : queries)
+	    num_positive += louds_dense->lookupKey(query, out_node_num);
+	double latency = (bench::getNow() - start_time) / queries.size() * 1000000000;
+	if ((run == 0) || (latency < best))
+	    best = latency;
+    }
+    return best;
+}
+
+static void runKeys(const char* name, std::vector<uint64_t>& int_keys,
+		    const bool random_negatives, std::mt19937_64& gen) {
+    std::sort(int_keys.begin(), int_keys.end());
+    int_keys.erase(std::unique(int_keys.begin(), int_keys.end()), int_keys.end());
+    std::vector<std::string> keys;
+    for (uint64_t int_key : int_keys)
+	keys.push_back(bench::uint64ToString(int_key));
+
+    std::vector<std::string> positives(keys);
+    std::shuffle(positives.begin(), positives.end(), gen);
+    if (positives.size() > kNumQueries)
+	positives.resize(kNumQueries);
+    // random negatives miss near the root; timestamp negatives sit next
+    // to a key and share its leading bytes
+    std::vector<std::string> negatives;
+    for (uint64_t i = 0; i < kNumQueries; i++) {
+	uint64_t int_key = random_negatives ? gen() : (int_keys[gen() % int_keys.size()] + 1);
+	negatives.push_back(bench::uint64ToString(int_key));
+    }
+
+    surf::SuRFBuilder builder(true, surf::kSparseDenseRatio, surf::kNone, 0, 0);
+    builder.build(keys);
+    for (int root_stride = 0; root_stride < 2; root_stride++) {
+	surf::LoudsDense louds_dense(&builder, surf::kInterleaveDenseNodes,
+				     surf::kDenseChildBases, (root_stride == 1));
+	uint64_t num_positive = 0;
+	double positive_latency = lookupLatency(&louds_dense, positives, num_positive);
+	double negative_latency = lookupLatency(&louds_dense, negatives, num_positive);
+	std::cout << name << ", root stride " << (root_stride ? "on " : "off")
+		  << ": positive " << positive_latency << " ns, negative "
+		  << negative_latency << " ns, memory " << louds_dense.getMemoryUsage()
+		  << " B (" << num_positive << ")\n";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t num_keys = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 10000000;
+    std::mt19937_64 gen(2018);
+
+    std::vector<uint64_t> random_keys;
+    for (uint64_t i = 0; i < num_keys; i++)
+	random_keys.push_back(gen());
+    runKeys("randint", random_keys, true, gen);
+
+    // microseconds, about one key per second
+    std::vector<uint64_t> timestamp_keys;
+    uint64_t timestamp = 1500000000ULL * 1000000ULL;
+    for (uint64_t i = 0; i < num_keys; i++) {
+	timestamp += 1 + gen() % 2000000;
+	timestamp_keys.push_back(timestamp);
+    }
+    runKeys("timestamp", timestamp_keys, false, gen);
+    return 0;
+}
@@ -38,3 +38,6 @@ echo 'SuRFReal, 4-bit suffixes, random int, range queries'
 # echo 'SuRFReal, 4-bit suffixes, email, point queries'
 # ../build/bench/workload SuRFReal 4 mixed 50 0 email range zipfian
 
+
+echo 'LoudsDense root stride, random int and timestamp, point queries'
+../build/bench/root_stride
@@ -81,6 +81,9 @@ bool Bitvector::readBit (const position_t pos) const {
 
 position_t Bitvector::distanceToNextSetBit (const position_t pos) const {
     assert(pos < num_bits_);
+    // the next word may not exist
+    if (pos + 1 == num_bits_)
+	return 1;
     position_t distance = 1;
 
     position_t word_id = (pos + 1) / kWordSize;
@@ -167,7 +170,9 @@ void Bitvector::concatenateBitvectors(const std::vector<std::vector<word_t> >& b
 		bit_shift += bits_remain;
 	    } else {
 		word_id++;
-		bits_[word_id] |= (last_word << (kWordSize - bit_shift));
+		// nothing spills over if the level ends at a word boundary
+		if (bit_shift + bits_remain > kWordSize)
+		    bits_[word_id] |= (last_word << (kWordSize - bit_shift));
 		bit_shift = bit_shift + bits_remain - kWordSize;
 	    }
 	}
@@ -0,0 +1,223 @@
+#ifndef BLOCKEDBLOOM_H_
+#define BLOCKEDBLOOM_H_
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "hash.hpp"
+
+namespace surf {
+
+// Cache-line-blocked Bloom filter over the full keys.
+// It is consulted only after a point query reaches a leaf in the trie,
+// so that lookupKey gets a Bloom-like false positive rate while range
+// queries are answered by the trie alone.
+// All probes of a key fall into one 512-bit block (one cache line).
+// num_blocks_ == 0 means the filter is disabled and accepts every key.
+// Keys are hashed with the suffix hash function (hash.hpp), so that a
+// query's PreparedKey hashes once for both.
+class BlockedBloom {
+public:
+    BlockedBloom() : num_blocks_(0), num_probes_(0), hash_(kLevelDbHash), bits_(nullptr),
+		     fp_rate_(1.0) {};
+    BlockedBloom(const BlockedBloom& other)
+	: num_blocks_(other.num_blocks_), num_probes_(other.num_probes_),
+	  hash_(other.hash_), fp_rate_(other.fp_rate_) {
+	allocate();
+	if (num_blocks_ > 0)
+	    memcpy(bits_, other.bits_, bitsSize());
+    }
+    BlockedBloom(const std::vector<std::string>& keys, const uint32_t bits_per_key,
+		 const SuffixHash hash = kLevelDbHash) {
+	num_blocks_ = 0;
+	num_probes_ = 0;
+	hash_ = hash;
+	if (bits_per_key > 0) {
+	    uint64_t num_bits = (uint64_t)keys.size() * bits_per_key;
+	    num_blocks_ = (position_t)((num_bits + kBlockSize - 1) / kBlockSize);
+	    if (num_blocks_ == 0)
+		num_blocks_ = 1;
+	    // k = bits_per_key * ln(2), rounded
+	    num_probes_ = (bits_per_key * 69 + 50) / 100;
+	    if (num_probes_ < 1) num_probes_ = 1;
+	    if (num_probes_ > kMaxNumProbes) num_probes_ = kMaxNumProbes;
+	}
+	allocate();
+	if (num_blocks_ > 0) {
+	    memset(bits_, 0, bitsSize());
+	    for (position_t i = 0; i < keys.size(); i++)
+		insert(keys[i]);
+	}
+	computeFpRate();
+    }
+
+    ~BlockedBloom() {}
+
+    bool isEnabled() const {
+	return (num_blocks_ > 0);
+    }
+
+    position_t numBlocks() const {
+	return num_blocks_;
+    }
+
+    uint32_t numProbes() const {
+	return num_probes_;
+    }
+
+    SuffixHash getHash() const {
+	return hash_;
+    }
+
+    // Expected false positive rate from the fraction of bits set;
+    // 1 when disabled
+    double fpRate() const {
+	return fp_rate_;
+    }
+
+    // in bytes
+    uint64_t bitsSize() const {
+	return ((uint64_t)num_blocks_ * kWordsPerBlock * sizeof(word_t));
+    }
+
+    uint64_t serializedSize() const {
+	return (sizeof(num_blocks_) + sizeof(num_probes_) + bitsSize());
+    }
+
+    // in bytes
+    uint64_t size() const {
+	return (sizeof(BlockedBloom) + bitsSize());
+    }
+
+    inline bool lookupKey(const PreparedKey& key) const;
+
+    // The hash function is stored above the number of probes (at most
+    // kMaxNumProbes). Version 0 images have no Bloom filter, see
+    // SuRF::deSerialize.
+    void serialize(char*& dst) const {
+	writePosition(dst, num_blocks_);
+	uint32_t probes_and_hash = num_probes_ | ((uint32_t)hash_ << kHashFieldShift);
+	*reinterpret_cast<uint32_t*>(dst) = htobe32(probes_and_hash);
+	dst += sizeof(num_probes_);
+	uint64_t num_words = (uint64_t)num_blocks_ * kWordsPerBlock;
+	for (uint64_t i = 0; i < num_words; i++) {
+	    *reinterpret_cast<uint64_t*>(dst) = htobe64(bits_[i]);
+	    dst += sizeof(uint64_t);
+	}
+    }
+
+    int deSerialize(const char*& src) {
+	num_blocks_ = readPosition(src);
+	uint32_t probes_and_hash = be32toh(*reinterpret_cast<const uint32_t*>(src));
+	num_probes_ = probes_and_hash & ((1U << kHashFieldShift) - 1);
+	hash_ = (SuffixHash)(probes_and_hash >> kHashFieldShift);
+	src += sizeof(num_probes_);
+	allocate();
+	uint64_t num_words = (uint64_t)num_blocks_ * kWordsPerBlock;
+	for (uint64_t i = 0; i < num_words; i++) {
+	    bits_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+	    src += sizeof(uint64_t);
+	}
+	computeFpRate();
+	return 0;
+    }
+
+    void destroy() {
+	free(bits_);
+	bits_ = nullptr;
+    }
+
+private:
+    static const position_t kBlockSize = 512; // one cache line
+    static const position_t kWordsPerBlock = kBlockSize / kWordSize;
+    static const uint32_t kMaxNumProbes = 16;
+    static const uint32_t kHashFieldShift = 16; // of the hash function, when serialized
+
+    void allocate() {
+	bits_ = nullptr;
+	if (num_blocks_ == 0)
+	    return;
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, kBlockSize / 8, bitsSize()) != 0)
+	    ptr = nullptr;
+	assert(ptr != nullptr);
+	bits_ = reinterpret_cast<word_t*>(ptr);
+    }
+
+    void computeFpRate() {
+	fp_rate_ = 1.0;
+	if (num_blocks_ == 0)
+	    return;
+	uint64_t num_words = (uint64_t)num_blocks_ * kWordsPerBlock;
+	uint64_t num_ones = 0;
+	for (uint64_t i = 0; i < num_words; i++)
+	    num_ones += __builtin_popcountll(bits_[i]);
+	fp_rate_ = pow((double)num_ones / (num_words * kWordSize), num_probes_);
+    }
+
+    // The hash suffixes take the low bits of a 64-bit hash, so the
+    // Bloom filter takes the high ones; the LevelDB hash has 32 bits.
+    uint32_t hashBits(const uint64_t hash) const {
+	return (uint32_t)((hash_ == kWyHash) ? (hash >> 32) : hash);
+    }
+
+    // Murmur3 finalizer; the LevelDB hash leaves the low bits poorly
+    // mixed for keys that differ only in their last bytes (e.g., ints).
+    static uint32_t mix(uint32_t h) {
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+    }
+
+    position_t getBlockId(const uint32_t h) const {
+	return (position_t)(((uint64_t)h * num_blocks_) >> 32);
+    }
+
+    inline void insert(const std::string& key);
+
+    position_t num_blocks_;
+    uint32_t num_probes_;
+    SuffixHash hash_;
+    word_t* bits_; // aligned to the cache line
+    double fp_rate_; // not serialized
+};
+
+void BlockedBloom::insert(const std::string& key) {
+    uint32_t h = mix(hashBits(suffixHash(hash_, key.data(), key.size())));
+    word_t* block = bits_ + getBlockId(h) * kWordsPerBlock;
+    h = mix(h);
+    const uint32_t delta = (h >> 17) | (h << 15); // rotate right 17 bits
+    for (uint32_t i = 0; i < num_probes_; i++) {
+	position_t bit_pos = h & (kBlockSize - 1);
+	block[bit_pos / kWordSize] |= (kMsbMask >> (bit_pos & (kWordSize - 1)));
+	h += delta;
+    }
+}
+
+bool BlockedBloom::lookupKey(const PreparedKey& key) const {
+    if (num_blocks_ == 0)
+	return true;
+    uint32_t h = mix(hashBits(key.hash(hash_)));
+    const word_t* block = bits_ + getBlockId(h) * kWordsPerBlock;
+    h = mix(h);
+    const uint32_t delta = (h >> 17) | (h << 15); // rotate right 17 bits
+    for (uint32_t i = 0; i < num_probes_; i++) {
+	position_t bit_pos = h & (kBlockSize - 1);
+	if (!(block[bit_pos / kWordSize] & (kMsbMask >> (bit_pos & (kWordSize - 1)))))
+	    return false;
+	h += delta;
+    }
+    return true;
+}
+
+} // namespace surf
+
+#endif // BLOCKEDBLOOM_H_
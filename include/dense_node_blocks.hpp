@@ -0,0 +1,276 @@
+#ifndef DENSENODEBLOCKS_H_
+#define DENSENODEBLOCKS_H_
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "config.hpp"
+#include "surf_builder.hpp"
+
+namespace surf {
+
+// Node-interleaved LOUDS-Dense encoding: each node is one 128-byte
+// record (two adjacent cache lines):
+//   words 0-3: label bitmap
+//   words 4-7: child indicator bitmap
+//   word 8   : number of child indicator 1's before the node (high 32 bits)
+//              and of label 1's before the node (low 32 bits)
+//   word 9   : number of prefix keys up to and including the node
+//              (high 32 bits) and the node's prefix key flag (bit 0)
+// A dense step (label check, child check, child rank) then reads the
+// first line and the header in the adjacent one.
+// Positions are numbered as in the split bitmaps: node * 256 + label.
+class DenseNodeBlocks {
+public:
+    DenseNodeBlocks() : num_nodes_(0), blocks_(nullptr) {};
+    DenseNodeBlocks(const DenseNodeBlocks& other) : num_nodes_(other.num_nodes_) {
+	allocate();
+	memcpy(blocks_, other.blocks_, blocksSize());
+    }
+    DenseNodeBlocks(const std::vector<std::vector<word_t> >& bitmap_labels_per_level,
+		    const std::vector<std::vector<word_t> >& bitmap_child_indicator_bits_per_level,
+		    const std::vector<std::vector<word_t> >& prefixkey_indicator_bits_per_level,
+		    const std::vector<position_t>& node_counts_per_level,
+		    const level_t start_level = 0,
+		    level_t end_level = 0/* non-inclusive */) {
+	if (end_level == 0)
+	    end_level = node_counts_per_level.size();
+	num_nodes_ = 0;
+	for (level_t level = start_level; level < end_level; level++)
+	    num_nodes_ += node_counts_per_level[level];
+	allocate();
+	memset(blocks_, 0, blocksSize());
+
+	position_t node_num = 0;
+	for (level_t level = start_level; level < end_level; level++) {
+	    for (position_t i = 0; i < node_counts_per_level[level]; i++) {
+		word_t* block = blocks_ + node_num * kWordsPerNode;
+		for (position_t j = 0; j < kBitmapWords; j++) {
+		    block[kLabelsOffset + j] = bitmap_labels_per_level[level][i * kBitmapWords + j];
+		    block[kChildBitsOffset + j]
+			= bitmap_child_indicator_bits_per_level[level][i * kBitmapWords + j];
+		}
+		if (SuRFBuilder::readBit(prefixkey_indicator_bits_per_level[level], i))
+		    block[kPrefixKeyOffset] = 1;
+		node_num++;
+	    }
+	}
+	initHeaders();
+    }
+
+    ~DenseNodeBlocks() {}
+
+    // Whether num_bits positions (node * 256 + label) fit the 32-bit
+    // rank fields of the records; always true with 32-bit positions
+    static bool fits(const position_t num_bits) {
+	return ((uint64_t)num_bits <= UINT32_MAX);
+    }
+
+    position_t numNodes() const {
+	return num_nodes_;
+    }
+
+    position_t numBits() const {
+	return (num_nodes_ * kNodeFanout);
+    }
+
+    bool readLabelBit(const position_t pos) const {
+	assert(pos <= numBits());
+	return labelWord(pos / kWordSize) & (kMsbMask >> (pos & (kWordSize - 1)));
+    }
+
+    bool readChildBit(const position_t pos) const {
+	assert(pos <= numBits());
+	return childWord(pos / kWordSize) & (kMsbMask >> (pos & (kWordSize - 1)));
+    }
+
+    bool readPrefixKeyBit(const position_t node_num) const {
+	assert(node_num <= num_nodes_);
+	return blocks_[node_num * kWordsPerNode + kPrefixKeyOffset] & 1;
+    }
+
+    // Number of label 1's up to position pos (inclusive)
+    position_t rankLabel(const position_t pos) const {
+	const word_t* block = getBlock(pos);
+	return ((position_t)(block[kRankOffset] & kLowHalfMask)
+		+ rankInBitmap(block + kLabelsOffset, pos % kNodeFanout));
+    }
+
+    // Number of child indicator 1's up to position pos (inclusive)
+    position_t rankChild(const position_t pos) const {
+	const word_t* block = getBlock(pos);
+	return ((position_t)(block[kRankOffset] >> 32)
+		+ rankInBitmap(block + kChildBitsOffset, pos % kNodeFanout));
+    }
+
+    // Number of prefix keys in nodes 0 to node_num (inclusive)
+    position_t rankPrefixKey(const position_t node_num) const {
+	assert(node_num <= num_nodes_);
+	return (position_t)(blocks_[node_num * kWordsPerNode + kPrefixKeyOffset] >> 32);
+    }
+
+    // Same semantics as Bitvector::distanceToNextSetBit over the label bitmaps
+    position_t distanceToNextLabel(const position_t pos) const {
+	position_t distance = 1;
+	position_t word_id = (pos + 1) / kWordSize;
+	position_t offset = (pos + 1) % kWordSize;
+	position_t num_words = num_nodes_ * kBitmapWords;
+
+	//first word left-over bits
+	word_t test_bits = labelWord(word_id) << offset;
+	if (test_bits > 0) {
+	    return (distance + __builtin_clzll(test_bits));
+	} else {
+	    if (word_id == num_words - 1)
+		return (numBits() - pos);
+	    distance += (kWordSize - offset);
+	}
+
+	while (word_id < num_words - 1) {
+	    word_id++;
+	    test_bits = labelWord(word_id);
+	    if (test_bits > 0)
+		return (distance + __builtin_clzll(test_bits));
+	    distance += kWordSize;
+	}
+	return distance;
+    }
+
+    // Same semantics as Bitvector::distanceToPrevSetBit over the label bitmaps
+    position_t distanceToPrevLabel(const position_t pos) const {
+	assert(pos <= numBits());
+	if (pos == 0) return 0;
+	position_t distance = 1;
+	position_t word_id = (pos - 1) / kWordSize;
+	position_t offset = (pos - 1) % kWordSize;
+
+	//first word left-over bits
+	word_t test_bits = labelWord(word_id) >> (kWordSize - 1 - offset);
+	if (test_bits > 0)
+	    return (distance + __builtin_ctzll(test_bits));
+	distance += (offset + 1);
+
+	while (word_id > 0) {
+	    word_id--;
+	    test_bits = labelWord(word_id);
+	    if (test_bits > 0)
+		return (distance + __builtin_ctzll(test_bits));
+	    distance += kWordSize;
+	}
+	return distance;
+    }
+
+    void prefetch(const position_t pos) const {
+	__builtin_prefetch(getBlock(pos));
+	__builtin_prefetch(getBlock(pos) + kRankOffset);
+    }
+
+    // in bytes
+    position_t blocksSize() const {
+	// one extra record holding the totals, for rank at numBits()
+	return ((num_nodes_ + 1) * kWordsPerNode * sizeof(word_t));
+    }
+
+    position_t serializedSize() const {
+	return (sizeof(num_nodes_) + blocksSize());
+    }
+
+    position_t size() const {
+	return (sizeof(DenseNodeBlocks) + blocksSize());
+    }
+
+    void serialize(char*& dst) const {
+	writePosition(dst, num_nodes_);
+	position_t num_words = (num_nodes_ + 1) * kWordsPerNode;
+	for (position_t i = 0; i < num_words; i++) {
+	    *reinterpret_cast<uint64_t*>(dst) = htobe64(blocks_[i]);
+	    dst += sizeof(uint64_t);
+	}
+    }
+
+    int deSerialize(const char*& src) {
+	num_nodes_ = readPosition(src);
+	allocate();
+	position_t num_words = (num_nodes_ + 1) * kWordsPerNode;
+	for (position_t i = 0; i < num_words; i++) {
+	    blocks_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+	    src += sizeof(uint64_t);
+	}
+	return 0;
+    }
+
+    void destroy() {
+	free(blocks_);
+	blocks_ = nullptr;
+    }
+
+private:
+    static const position_t kNodeFanout = 256;
+    static const position_t kBitmapWords = kNodeFanout / kWordSize;
+    static const position_t kWordsPerNode = 16; // two cache lines
+    static const position_t kLabelsOffset = 0;
+    static const position_t kChildBitsOffset = 4;
+    static const position_t kRankOffset = 8;
+    static const position_t kPrefixKeyOffset = 9;
+    static const word_t kLowHalfMask = 0xFFFFFFFF;
+
+    void allocate() {
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, kWordsPerNode * sizeof(word_t), blocksSize()) != 0)
+	    ptr = nullptr;
+	assert(ptr != nullptr);
+	blocks_ = reinterpret_cast<word_t*>(ptr);
+    }
+
+    const word_t* getBlock(const position_t pos) const {
+	assert(pos <= numBits());
+	return blocks_ + (pos / kNodeFanout) * kWordsPerNode;
+    }
+
+    word_t labelWord(const position_t word_id) const {
+	return blocks_[(word_id / kBitmapWords) * kWordsPerNode + kLabelsOffset
+		       + word_id % kBitmapWords];
+    }
+
+    word_t childWord(const position_t word_id) const {
+	return blocks_[(word_id / kBitmapWords) * kWordsPerNode + kChildBitsOffset
+		       + word_id % kBitmapWords];
+    }
+
+    static position_t rankInBitmap(const word_t* bitmap, const position_t offset) {
+	position_t word_id = offset / kWordSize;
+	position_t rank = 0;
+	for (position_t i = 0; i < word_id; i++)
+	    rank += __builtin_popcountll(bitmap[i]);
+	return (rank + __builtin_popcountll(bitmap[word_id]
+					    >> (kWordSize - 1 - (offset & (kWordSize - 1)))));
+    }
+
+    void initHeaders() {
+	position_t cumu_label_rank = 0;
+	position_t cumu_child_rank = 0;
+	position_t cumu_prefixkey_rank = 0;
+	for (position_t i = 0; i <= num_nodes_; i++) {
+	    word_t* block = blocks_ + i * kWordsPerNode;
+	    // the header fields are 32 bits wide, whatever position_t is (see fits)
+	    assert(cumu_label_rank <= UINT32_MAX);
+	    assert(cumu_child_rank <= UINT32_MAX);
+	    block[kRankOffset] = ((word_t)cumu_child_rank << 32) | cumu_label_rank;
+	    for (position_t j = 0; j < kBitmapWords; j++) {
+		cumu_label_rank += __builtin_popcountll(block[kLabelsOffset + j]);
+		cumu_child_rank += __builtin_popcountll(block[kChildBitsOffset + j]);
+	    }
+	    cumu_prefixkey_rank += (block[kPrefixKeyOffset] & 1);
+	    block[kPrefixKeyOffset] |= ((word_t)cumu_prefixkey_rank << 32);
+	}
+    }
+
+    position_t num_nodes_;
+    word_t* blocks_; // aligned to the record size
+};
+
+} // namespace surf
+
+#endif // DENSENODEBLOCKS_H_
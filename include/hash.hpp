@@ -1,8 +1,12 @@
 #ifndef HASH_H_
 #define HASH_H_
 
+#include <string.h>
+
 #include <string>
 
+#include "config.hpp"
+
 namespace surf {
 
 //******************************************************
@@ -45,6 +49,68 @@ inline uint32_t Hash(const char* data, size_t n, uint32_t seed) {
     return h;
 }
 
+//******************************************************
+//64-BIT HASH FUNCTION IN THE STYLE OF WYHASH (FINAL 4)
+//******************************************************
+inline uint64_t DecodeFixed64(const char* ptr) {
+    uint64_t result;
+    memcpy(&result, ptr, sizeof(result));
+    return result;
+}
+
+// Folds the 128-bit product of a and b to 64 bits
+inline uint64_t WyMix(const uint64_t a, const uint64_t b) {
+    __uint128_t r = (__uint128_t)a * b;
+    return ((uint64_t)r ^ (uint64_t)(r >> 64));
+}
+
+inline uint64_t WyHash(const char* data, size_t n, uint64_t seed) {
+    static const uint64_t p0 = 0xa0761d6478bd642fULL;
+    static const uint64_t p1 = 0xe7037ed1a0b428dbULL;
+    static const uint64_t p2 = 0x8ebc6af09c88c6e3ULL;
+    static const uint64_t p3 = 0x589965cc75374cc3ULL;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    seed ^= WyMix(seed ^ p0, p1);
+    uint64_t a, b;
+    if (n <= 16) {
+	if (n >= 4) {
+	    // two overlapping 4-byte reads from each end
+	    size_t mid = (n >> 3) << 2;
+	    a = ((uint64_t)DecodeFixed32(data) << 32) | DecodeFixed32(data + mid);
+	    b = ((uint64_t)DecodeFixed32(data + n - 4) << 32) | DecodeFixed32(data + n - 4 - mid);
+	} else if (n > 0) {
+	    a = ((uint64_t)bytes[0] << 16) | ((uint64_t)bytes[n >> 1] << 8) | bytes[n - 1];
+	    b = 0;
+	} else {
+	    a = b = 0;
+	}
+    } else {
+	size_t i = n;
+	if (i > 48) {
+	    // three independent lanes of 16 bytes each
+	    uint64_t seed1 = seed, seed2 = seed;
+	    do {
+		seed = WyMix(DecodeFixed64(data) ^ p1, DecodeFixed64(data + 8) ^ seed);
+		seed1 = WyMix(DecodeFixed64(data + 16) ^ p2, DecodeFixed64(data + 24) ^ seed1);
+		seed2 = WyMix(DecodeFixed64(data + 32) ^ p3, DecodeFixed64(data + 40) ^ seed2);
+		data += 48;
+		i -= 48;
+	    } while (i > 48);
+	    seed ^= seed1 ^ seed2;
+	}
+	while (i > 16) {
+	    seed = WyMix(DecodeFixed64(data) ^ p1, DecodeFixed64(data + 8) ^ seed);
+	    data += 16;
+	    i -= 16;
+	}
+	// the last 16 bytes, which may overlap the ones already mixed
+	a = DecodeFixed64(data + i - 16);
+	b = DecodeFixed64(data + i - 8);
+    }
+    __uint128_t r = (__uint128_t)(a ^ p1) * (b ^ seed);
+    return WyMix((uint64_t)r ^ p0 ^ n, (uint64_t)(r >> 64) ^ p1);
+}
+
 inline uint32_t suffixHash(const std::string &key) {
     return Hash(key.c_str(), key.size(), 0xbc9f1d34);
 }
@@ -53,6 +119,41 @@ inline uint32_t suffixHash(const char* key, const int keylen) {
     return Hash(key, keylen, 0xbc9f1d34);
 }
 
+inline uint64_t suffixHash(const SuffixHash hash, const char* key, const size_t keylen) {
+    if (hash == kWyHash)
+	return WyHash(key, keylen, 0xbc9f1d34);
+    return Hash(key, keylen, 0xbc9f1d34);
+}
+
+// A query key and its hash, computed on first use and then reused by
+// every hash suffix check and Bloom filter probe of the query (hashing
+// a long key can take a good part of a lookup). Converts implicitly
+// from the key, which must outlive it.
+class PreparedKey {
+public:
+    PreparedKey(const std::string& key)
+	: key_(key), has_hash_(false), hash_type_(kLevelDbHash), hash_(0) {}
+
+    const std::string& key() const {
+	return key_;
+    }
+
+    uint64_t hash(const SuffixHash hash_type) const {
+	if (!has_hash_ || (hash_type != hash_type_)) {
+	    hash_ = suffixHash(hash_type, key_.data(), key_.size());
+	    hash_type_ = hash_type;
+	    has_hash_ = true;
+	}
+	return hash_;
+    }
+
+private:
+    const std::string& key_;
+    mutable bool has_hash_;
+    mutable SuffixHash hash_type_;
+    mutable uint64_t hash_;
+};
+
 } // namespace surf
 
 #endif // HASH_H_
@@ -0,0 +1,216 @@
+#ifndef KEYENCODER_H_
+#define KEYENCODER_H_
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+
+namespace surf {
+
+// Order-preserving single-character key compression (as the
+// single-char scheme of HOPE): every byte value gets a prefix-free
+// bit code from an optimal alphabetic (Hu-Tucker) code tree, trained
+// on the byte frequencies of a sample of the keys. An encoded key is
+// the concatenation of its byte codes, zero-padded to a whole byte.
+// The leftmost leaf of the code tree is a sentinel that no byte uses,
+// so no code is all zeros. Then a < b implies encode(a) < encode(b),
+// with padding included, and different keys never collide.
+// A disabled encoder (default-constructed) is the identity.
+class KeyEncoder {
+public:
+    KeyEncoder() : enabled_(false) {
+	memset(codes_, 0, sizeof(codes_));
+	memset(code_lens_, 0, sizeof(code_lens_));
+    };
+    KeyEncoder(const KeyEncoder& other) : enabled_(other.enabled_) {
+	memcpy(codes_, other.codes_, sizeof(codes_));
+	memcpy(code_lens_, other.code_lens_, sizeof(code_lens_));
+    }
+    // Trains the codes on every sample_interval-th key
+    KeyEncoder(const std::vector<std::string>& keys,
+	       const position_t sample_interval = kKeyEncoderSampleInterval) {
+	std::vector<uint64_t> counts(kNumSymbols, 0);
+	for (position_t i = 0; i < keys.size(); i += sample_interval) {
+	    for (position_t j = 0; j < keys[i].length(); j++)
+		counts[(label_t)keys[i][j]]++;
+	}
+	buildCodes(counts);
+	enabled_ = true;
+    }
+
+    ~KeyEncoder() {}
+
+    bool isEnabled() const {
+	return enabled_;
+    }
+
+    // Code length of byte value c, in bits
+    level_t codeLen(const label_t c) const {
+	return code_lens_[c];
+    }
+
+    void encode(const std::string& key, std::string& encoded) const {
+	encoded.clear();
+	encoded.reserve(key.length());
+	uint64_t buf = 0;
+	level_t num_bits = 0;
+	for (position_t i = 0; i < key.length(); i++) {
+	    label_t c = (label_t)key[i];
+	    buf = (buf << code_lens_[c]) | codes_[c];
+	    num_bits += code_lens_[c];
+	    while (num_bits >= 8) {
+		num_bits -= 8;
+		encoded.push_back((char)(buf >> num_bits));
+	    }
+	}
+	if (num_bits > 0)
+	    encoded.push_back((char)(buf << (8 - num_bits)));
+    }
+
+    std::string encode(const std::string& key) const {
+	std::string encoded;
+	encode(key, encoded);
+	return encoded;
+    }
+
+    // Number of leading bytes of key whose codes lie entirely within the
+    // first num_bytes bytes of its encoding
+    level_t decodedLength(const std::string& key, const position_t num_bytes) const {
+	uint64_t num_bits = 0;
+	level_t len = 0;
+	while (len < key.length()) {
+	    num_bits += code_lens_[(label_t)key[len]];
+	    if (num_bits > (uint64_t)num_bytes * 8)
+		break;
+	    len++;
+	}
+	return len;
+    }
+
+    uint64_t serializedSize() const {
+	uint64_t size = sizeof(uint32_t);
+	if (enabled_)
+	    size += sizeof(codes_) + sizeof(code_lens_);
+	return size;
+    }
+
+    // in bytes
+    uint64_t size() const {
+	return sizeof(KeyEncoder);
+    }
+
+    void serialize(char*& dst) const {
+	*reinterpret_cast<uint32_t*>(dst) = htobe32(enabled_ ? 1 : 0);
+	dst += sizeof(uint32_t);
+	if (!enabled_)
+	    return;
+	for (position_t i = 0; i < kNumSymbols; i++) {
+	    *reinterpret_cast<uint64_t*>(dst) = htobe64(codes_[i]);
+	    dst += sizeof(uint64_t);
+	}
+	memcpy(dst, code_lens_, sizeof(code_lens_));
+	dst += sizeof(code_lens_);
+    }
+
+    int deSerialize(const char*& src) {
+	enabled_ = (be32toh(*reinterpret_cast<const uint32_t*>(src)) != 0);
+	src += sizeof(uint32_t);
+	memset(codes_, 0, sizeof(codes_));
+	memset(code_lens_, 0, sizeof(code_lens_));
+	if (!enabled_)
+	    return 0;
+	for (position_t i = 0; i < kNumSymbols; i++) {
+	    codes_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+	    src += sizeof(uint64_t);
+	}
+	memcpy(code_lens_, src, sizeof(code_lens_));
+	src += sizeof(code_lens_);
+	return 0;
+    }
+
+    void destroy() {}
+
+private:
+    static const position_t kNumSymbols = 256;
+    // bounds the total weight, and thus the code length (about
+    // 1.44 * 20 bits), so that encode's 64-bit buffer cannot overflow
+    static const uint64_t kMaxTotalWeight = (1 << 20);
+    static const level_t kMaxCodeLen = 56;
+
+    // Optimal alphabetic code tree over the sentinel (leaf 0) and the
+    // byte values (leaf c + 1), by dynamic programming with Knuth's
+    // root monotonicity: O(n^2) for n = 257 leaves.
+    void buildCodes(const std::vector<uint64_t>& counts) {
+	uint64_t total = 0;
+	for (position_t i = 0; i < kNumSymbols; i++)
+	    total += counts[i];
+	position_t n = kNumSymbols + 1;
+	std::vector<uint64_t> prefix_weights(n + 1, 0);
+	for (position_t i = 0; i < n; i++) {
+	    uint64_t weight = 1;
+	    if ((i > 0) && (total > 0))
+		weight += counts[i - 1] * kMaxTotalWeight / total;
+	    prefix_weights[i + 1] = prefix_weights[i] + weight;
+	}
+
+	// cost[i * n + j] and root[i * n + j] for the leaves i to j:
+	// the right subtree of the root starts at leaf root
+	std::vector<uint64_t> cost(n * n, 0);
+	std::vector<position_t> root(n * n, 0);
+	for (position_t i = 0; i < n; i++)
+	    root[i * n + i] = i;
+	for (position_t len = 2; len <= n; len++) {
+	    for (position_t i = 0; i + len <= n; i++) {
+		position_t j = i + len - 1;
+		position_t k_begin = root[i * n + j - 1];
+		if (k_begin < i + 1)
+		    k_begin = i + 1;
+		position_t k_end = root[(i + 1) * n + j];
+		uint64_t best_cost = UINT64_MAX;
+		position_t best_k = k_begin;
+		for (position_t k = k_begin; k <= k_end; k++) {
+		    uint64_t c = cost[i * n + k - 1] + cost[k * n + j];
+		    if (c < best_cost) {
+			best_cost = c;
+			best_k = k;
+		    }
+		}
+		cost[i * n + j] = best_cost + prefix_weights[j + 1] - prefix_weights[i];
+		root[i * n + j] = best_k;
+	    }
+	}
+
+	memset(codes_, 0, sizeof(codes_));
+	memset(code_lens_, 0, sizeof(code_lens_));
+	assignCodes(root, n, 0, n - 1, 0, 0);
+    }
+
+    void assignCodes(const std::vector<position_t>& root, const position_t n,
+		     const position_t i, const position_t j,
+		     const uint64_t code, const level_t len) {
+	if (i == j) {
+	    assert(len <= kMaxCodeLen);
+	    if (i > 0) {
+		codes_[i - 1] = code;
+		code_lens_[i - 1] = (uint8_t)len;
+	    }
+	    return;
+	}
+	position_t k = root[i * n + j];
+	assignCodes(root, n, i, k - 1, code << 1, len + 1);
+	assignCodes(root, n, k, j, (code << 1) | 1, len + 1);
+    }
+
+    bool enabled_;
+    uint64_t codes_[kNumSymbols]; // right-aligned
+    uint8_t code_lens_[kNumSymbols];
+};
+
+} // namespace surf
+
+#endif // KEYENCODER_H_
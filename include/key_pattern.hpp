@@ -0,0 +1,72 @@
+#ifndef KEYPATTERN_H_
+#define KEYPATTERN_H_
+
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+
+namespace surf {
+
+// A pattern over the leading bytes of a key.
+// Position i accepts key bytes in [low(i), high(i)]; bytes past the end
+// of the pattern are unconstrained (i.e., a trailing '*' is implied).
+// A variable-length field inside a composite key is expressed with one
+// wildcard per byte of its fixed width.
+class KeyPattern {
+public:
+    KeyPattern() {};
+    // Fixed bytes, with each occurrence of wildcard matching any byte
+    KeyPattern(const std::string& pattern, const char wildcard = '?') {
+	for (unsigned i = 0; i < pattern.length(); i++) {
+	    if (pattern[i] == wildcard)
+		addWildcard();
+	    else
+		addByte((label_t)pattern[i]);
+	}
+    }
+
+    ~KeyPattern() {}
+
+    void addByte(const label_t byte) {
+	addRange(byte, byte);
+    }
+
+    void addRange(const label_t low, const label_t high) {
+	lows_.push_back(low);
+	highs_.push_back(high);
+    }
+
+    void addWildcard() {
+	addRange(0, kFanout - 1);
+    }
+
+    level_t size() const {
+	return (level_t)lows_.size();
+    }
+
+    label_t low(const level_t level) const {
+	return lows_[level];
+    }
+
+    label_t high(const level_t level) const {
+	return highs_[level];
+    }
+
+    // Whether the first min(size(), key.length()) bytes of key fit the pattern
+    bool matchPrefix(const std::string& key) const {
+	for (level_t i = 0; (i < size()) && (i < key.length()); i++) {
+	    if (((label_t)key[i] < lows_[i]) || ((label_t)key[i] > highs_[i]))
+		return false;
+	}
+	return true;
+    }
+
+private:
+    std::vector<label_t> lows_;
+    std::vector<label_t> highs_;
+};
+
+} // namespace surf
+
+#endif // KEYPATTERN_H_
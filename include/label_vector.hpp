@@ -1,7 +1,7 @@
 #ifndef LABELVECTOR_H_
 #define LABELVECTOR_H_
 
-#include <emmintrin.h>
+#include <immintrin.h>
 
 #include <vector>
 
@@ -9,11 +9,29 @@
 
 namespace surf {
 
+// Label searches use the widest of SSE2, AVX2 (-mavx2) and AVX-512BW
+// (-mavx512bw) that the build targets. Searches over fewer labels than
+// the thresholds below scan linearly, the others use SIMD. Measured
+// with each ISA on nodes of random sorted labels: binary search lost
+// to one or the other at every node size, and the SIMD greater- and
+// less-than searches, being branch-free, win from 3 labels on.
 class LabelVector {
 public:
+#if defined(__AVX512BW__)
+    static const position_t kSimdWidth = 64;
+    static const position_t kSimdSearchMinLen = 8;
+#elif defined(__AVX2__)
+    static const position_t kSimdWidth = 32;
+    static const position_t kSimdSearchMinLen = 12;
+#else
+    static const position_t kSimdWidth = 16;
+    static const position_t kSimdSearchMinLen = 8;
+#endif
+    static const position_t kSimdOrderedSearchMinLen = 3;
+
     LabelVector() : num_bytes_(0), labels_(nullptr) {};
     LabelVector(const LabelVector& other):num_bytes_(other.num_bytes_) {
-        labels_ = new label_t[num_bytes_];
+	allocate();
         memmove(labels_, other.labels_, num_bytes_*sizeof(label_t));
     }
 
@@ -27,7 +45,7 @@ public:
 	for (level_t level = start_level; level < end_level; level++)
 	    num_bytes_ += labels_per_level[level].size();
 
-	labels_ = new label_t[num_bytes_];
+	allocate();
 
 	position_t pos = 0;
 	for (level_t level = start_level; level < end_level; level++) {
@@ -51,7 +69,7 @@ public:
     }
 
     position_t size() const {
-	return (sizeof(LabelVector) + num_bytes_);
+	return (sizeof(LabelVector) + num_bytes_ + kSimdWidth);
     }
 
     label_t read(const position_t pos) const {
@@ -64,37 +82,65 @@ public:
 
     inline bool search(const label_t target, position_t& pos, const position_t search_len) const;
     inline bool searchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const;
+    inline bool searchLessThan(const label_t target, position_t& pos, const position_t search_len) const;
 
     inline bool binarySearch(const label_t target, position_t& pos, const position_t search_len) const;
     inline bool simdSearch(const label_t target, position_t& pos, const position_t search_len) const;
     inline bool linearSearch(const label_t target, position_t& pos, const position_t search_len) const;
 
     inline bool binarySearchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const;
+    inline bool simdSearchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const;
     inline bool linearSearchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const;
 
+    inline bool binarySearchLessThan(const label_t target, position_t& pos, const position_t search_len) const;
+    inline bool simdSearchLessThan(const label_t target, position_t& pos, const position_t search_len) const;
+    inline bool linearSearchLessThan(const label_t target, position_t& pos, const position_t search_len) const;
+
     void serialize(char*& dst) const {
-		*reinterpret_cast<uint32_t *>(dst) = htobe32(num_bytes_);
-        dst += sizeof(num_bytes_);
+		writePosition(dst, num_bytes_);
         memcpy(dst, labels_, num_bytes_);
         dst += num_bytes_;
         // align(dst);
     }
 
     int deSerialize(const char*& src) {
-		num_bytes_ = be32toh(*reinterpret_cast<const uint32_t *>(src));
-        src += sizeof(num_bytes_);
-        labels_ = new label_t[num_bytes_];
+		num_bytes_ = readPosition(src);
+	allocate();
         memcpy(labels_, src, num_bytes_);
         src += num_bytes_;
         // align(src);
         return 0;
     }
 
+    // Reads the version 0 layout (32-bit size), see kSerializeVersion
+    int deSerializeV0(const char*& src) {
+	num_bytes_ = readUint32(src);
+	allocate();
+	memcpy(labels_, src, num_bytes_);
+	src += num_bytes_;
+	return 0;
+    }
+
     void destroy() {
 	delete[] labels_;	
     }
 
 private:
+    // The labels are followed by kSimdWidth zero bytes, so that a SIMD
+    // load starting at any label stays in the array.
+    void allocate() {
+	labels_ = new label_t[num_bytes_ + kSimdWidth];
+	memset(labels_ + num_bytes_, 0, kSimdWidth);
+    }
+
+    // Bit i is set if labels[i] == target (resp. <= target), for the
+    // kSimdWidth labels from labels on
+    static inline uint64_t simdMatchEqual(const label_t* labels, const label_t target);
+    static inline uint64_t simdMatchLessEqual(const label_t* labels, const label_t target);
+    // Number of labels <= target among the sorted labels from pos on
+    inline position_t simdCountLessEqual(const label_t target, const position_t pos,
+					 const position_t search_len) const;
+
     position_t num_bytes_;
     label_t* labels_;
 };
@@ -106,10 +152,8 @@ bool LabelVector::search(const label_t target, position_t& pos, position_t searc
 	search_len--;
     }
 
-    if (search_len < 3)
+    if (search_len < kSimdSearchMinLen)
 	return linearSearch(target, pos, search_len);
-    if (search_len < 12)
-	return binarySearch(target, pos, search_len);
     else
 	return simdSearch(target, pos, search_len);
 }
@@ -121,10 +165,25 @@ bool LabelVector::searchGreaterThan(const label_t target, position_t& pos, posit
 	search_len--;
     }
 
-    if (search_len < 3)
+    if (search_len < kSimdOrderedSearchMinLen)
 	return linearSearchGreaterThan(target, pos, search_len);
     else
-	return binarySearchGreaterThan(target, pos, search_len);
+	return simdSearchGreaterThan(target, pos, search_len);
+}
+
+// The terminator label is skipped: it sorts before every real label
+// in the node, so the caller handles it after a failed search.
+bool LabelVector::searchLessThan(const label_t target, position_t& pos, position_t search_len) const {
+    //skip terminator label
+    if ((search_len > 1) && (labels_[pos] == kTerminator)) {
+	pos++;
+	search_len--;
+    }
+
+    if (search_len < kSimdOrderedSearchMinLen)
+	return linearSearchLessThan(target, pos, search_len);
+    else
+	return simdSearchLessThan(target, pos, search_len);
 }
 
 bool LabelVector::binarySearch(const label_t target, position_t& pos, const position_t search_len) const {
@@ -145,33 +204,15 @@ bool LabelVector::binarySearch(const label_t target, position_t& pos, const posi
 }
 
 bool LabelVector::simdSearch(const label_t target, position_t& pos, const position_t search_len) const {
-    position_t num_labels_searched = 0;
-    position_t num_labels_left = search_len;
-    while ((num_labels_left >> 4) > 0) {
-	label_t* start_ptr = labels_ + pos + num_labels_searched;
-	__m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(target), 
-				     _mm_loadu_si128(reinterpret_cast<__m128i*>(start_ptr)));
-	unsigned check_bits = _mm_movemask_epi8(cmp);
-	if (check_bits) {
-	    pos += (num_labels_searched + __builtin_ctz(check_bits));
-	    return true;
-	}
-	num_labels_searched += 16;
-	num_labels_left -= 16;
-    }
-
-    if (num_labels_left > 0) {
-	label_t* start_ptr = labels_ + pos + num_labels_searched;
-	__m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(target), 
-				     _mm_loadu_si128(reinterpret_cast<__m128i*>(start_ptr)));
-	unsigned leftover_bits_mask = (1 << num_labels_left) - 1;
-	unsigned check_bits = _mm_movemask_epi8(cmp) & leftover_bits_mask;
-	if (check_bits) {
-	    pos += (num_labels_searched + __builtin_ctz(check_bits));
+    for (position_t i = 0; i < search_len; i += kSimdWidth) {
+	uint64_t matches = simdMatchEqual(labels_ + pos + i, target);
+	if (search_len - i < kSimdWidth)
+	    matches &= ((uint64_t)1 << (search_len - i)) - 1;
+	if (matches) {
+	    pos += (i + __builtin_ctzll(matches));
 	    return true;
 	}
     }
-
     return false;
 }
 
@@ -210,6 +251,16 @@ bool LabelVector::binarySearchGreaterThan(const label_t target, position_t& pos,
     return false;
 }
 
+// The labels are sorted, so the first label > target follows those <= target
+bool LabelVector::simdSearchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const {
+    position_t num_less_equal = simdCountLessEqual(target, pos, search_len);
+    if (num_less_equal < search_len) {
+	pos += num_less_equal;
+	return true;
+    }
+    return false;
+}
+
 bool LabelVector::linearSearchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const {
     for (position_t i = 0; i < search_len; i++) {
 	if (labels_[pos + i] > target) {
@@ -220,6 +271,97 @@ bool LabelVector::linearSearchGreaterThan(const label_t target, position_t& pos,
     return false;
 }
 
+bool LabelVector::binarySearchLessThan(const label_t target, position_t& pos, const position_t search_len) const {
+    position_t l = pos;
+    position_t r = pos + search_len;
+    while (l < r) {
+	position_t m = (l + r) >> 1;
+	if (labels_[m] < target)
+	    l = m + 1;
+	else
+	    r = m;
+    }
+
+    if (l > pos) {
+	pos = l - 1;
+	return true;
+    }
+    return false;
+}
+
+bool LabelVector::simdSearchLessThan(const label_t target, position_t& pos, const position_t search_len) const {
+    if (target == 0)
+	return false;
+    position_t num_less = simdCountLessEqual(target - 1, pos, search_len);
+    if (num_less > 0) {
+	pos += (num_less - 1);
+	return true;
+    }
+    return false;
+}
+
+bool LabelVector::linearSearchLessThan(const label_t target, position_t& pos, const position_t search_len) const {
+    for (position_t i = search_len; i > 0; i--) {
+	if (labels_[pos + i - 1] < target) {
+	    pos += (i - 1);
+	    return true;
+	}
+    }
+    return false;
+}
+
+position_t LabelVector::simdCountLessEqual(const label_t target, const position_t pos,
+					   const position_t search_len) const {
+    position_t count = 0;
+    for (position_t i = 0; i < search_len; i += kSimdWidth) {
+	uint64_t matches = simdMatchLessEqual(labels_ + pos + i, target);
+	if (search_len - i < kSimdWidth)
+	    matches &= ((uint64_t)1 << (search_len - i)) - 1;
+	position_t num_matches = __builtin_popcountll(matches);
+	count += num_matches;
+	// the labels after the first one > target are all > target
+	if (num_matches < kSimdWidth)
+	    break;
+    }
+    return count;
+}
+
+#if defined(__AVX512BW__)
+uint64_t LabelVector::simdMatchEqual(const label_t* labels, const label_t target) {
+    return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(labels), _mm512_set1_epi8(target));
+}
+
+uint64_t LabelVector::simdMatchLessEqual(const label_t* labels, const label_t target) {
+    return _mm512_cmple_epu8_mask(_mm512_loadu_si512(labels), _mm512_set1_epi8(target));
+}
+#elif defined(__AVX2__)
+uint64_t LabelVector::simdMatchEqual(const label_t* labels, const label_t target) {
+    __m256i cmp = _mm256_cmpeq_epi8(_mm256_set1_epi8(target),
+				    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(labels)));
+    return (uint32_t)_mm256_movemask_epi8(cmp);
+}
+
+// unsigned x <= target iff min(x, target) == x
+uint64_t LabelVector::simdMatchLessEqual(const label_t* labels, const label_t target) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(labels));
+    __m256i cmp = _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(target)), x);
+    return (uint32_t)_mm256_movemask_epi8(cmp);
+}
+#else
+uint64_t LabelVector::simdMatchEqual(const label_t* labels, const label_t target) {
+    __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(target),
+				 _mm_loadu_si128(reinterpret_cast<const __m128i*>(labels)));
+    return (uint32_t)_mm_movemask_epi8(cmp);
+}
+
+// unsigned x <= target iff min(x, target) == x
+uint64_t LabelVector::simdMatchLessEqual(const label_t* labels, const label_t target) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(labels));
+    __m128i cmp = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(target)), x);
+    return (uint32_t)_mm_movemask_epi8(cmp);
+}
+#endif
+
 } // namespace surf
 
 #endif // LABELVECTOR_H_
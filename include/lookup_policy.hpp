@@ -0,0 +1,56 @@
+#ifndef LOOKUPPOLICY_H_
+#define LOOKUPPOLICY_H_
+
+#include <string>
+
+#include "config.hpp"
+#include "rank.hpp"
+#include "select.hpp"
+#include "suffix.hpp"
+
+namespace surf {
+
+// Point-query policies: how LoudsDense::lookupKey and
+// LoudsSparse::lookupKey rank the label bitmaps, select on the LOUDS
+// bits and check suffixes.
+
+// Reads the suffix type and the directory parameters from the filter,
+// at every step of every query.
+struct DynamicLookup {
+    static position_t rank(const BitvectorRank& bitvector, const position_t pos) {
+	return bitvector.rank(pos);
+    }
+
+    static position_t select(const BitvectorSelect& bitvector, const position_t rank) {
+	return bitvector.select(rank);
+    }
+
+    static bool checkEquality(const BitvectorSuffix& suffixes, const position_t idx,
+			      const PreparedKey& key, const level_t level) {
+	return suffixes.checkEquality(idx, key, level);
+    }
+};
+
+// Fixes them at compile time: the compiler drops the branches of the
+// other suffix types and folds the directory divisions to shifts.
+// The filter must have been built with the same parameters (see
+// SuRFSpecialized and SpecializedLookup).
+template <SuffixType kSuffixType, position_t kRankBlockSize, position_t kSelectSampleInterval>
+struct StaticLookup {
+    static position_t rank(const BitvectorRank& bitvector, const position_t pos) {
+	return bitvector.rank<kRankBlockSize>(pos);
+    }
+
+    static position_t select(const BitvectorSelect& bitvector, const position_t rank) {
+	return bitvector.select<kSelectSampleInterval>(rank);
+    }
+
+    static bool checkEquality(const BitvectorSuffix& suffixes, const position_t idx,
+			      const PreparedKey& key, const level_t level) {
+	return suffixes.checkEquality<kSuffixType>(idx, key, level);
+    }
+};
+
+} // namespace surf
+
+#endif // LOOKUPPOLICY_H_
@@ -4,7 +4,11 @@
 #include <string>
 
 #include "config.hpp"
+#include "dense_node_blocks.hpp"
+#include "key_pattern.hpp"
+#include "lookup_policy.hpp"
 #include "rank.hpp"
+#include "rank_interleaved.hpp"
 #include "suffix.hpp"
 #include "surf_builder.hpp"
 
@@ -81,30 +85,93 @@ public:
 
 public:
     LoudsDense() {};
-    inline LoudsDense(const SuRFBuilder* builder);
+    // interleave_nodes selects the DenseNodeBlocks layout instead of
+    // separate label, child indicator and prefix key bitvectors, if
+    // the levels fit its 32-bit counters (DenseNodeBlocks::fits).
+    // Otherwise, child_bases selects a child indicator rank directory
+    // with one entry per node (see child_indicator_bases_).
+    // root_stride adds the 16-bit root directory (see root_stride_bits_).
+    // split_suffixes selects the split BitvectorSuffix layout (uniform
+    // suffix lengths only).
+    // rank_block_size is the basic block size of the label bitmap rank
+    // directory (see kDenseRankBlockSize).
+    inline LoudsDense(const SuRFBuilder* builder,
+		      const bool interleave_nodes = kInterleaveDenseNodes,
+		      const bool child_bases = kDenseChildBases,
+		      const bool root_stride = kDenseRootStride,
+		      const bool split_suffixes = kSplitSuffixes,
+		      const position_t rank_block_size = kDenseRankBlockSize);
     LoudsDense(const LoudsDense& other)
         : height_(other.height_),
-          label_bitmaps_(new BitvectorRank(*other.label_bitmaps_)),
-          child_indicator_bitmaps_(new BitvectorRank(*other.child_indicator_bitmaps_)),
-          prefixkey_indicator_bits_(new BitvectorRank(*other.prefixkey_indicator_bits_)),
+          label_bitmaps_(nullptr),
+          child_indicator_bitmaps_(nullptr),
+          child_indicator_bases_(nullptr),
+          prefixkey_indicator_bits_(nullptr),
+          node_blocks_(nullptr),
+          root_stride_base_(other.root_stride_base_),
+          root_stride_bits_(nullptr),
           suffixes_(new BitvectorSuffix(*other.suffixes_)) {
         level_cuts_ = new position_t[height_];
         memmove(level_cuts_, other.level_cuts_, height_ * sizeof(position_t));
+	if (other.node_blocks_ != nullptr) {
+	    node_blocks_ = new DenseNodeBlocks(*other.node_blocks_);
+	} else {
+	    label_bitmaps_ = new BitvectorRank(*other.label_bitmaps_);
+	    if (other.child_indicator_bases_ != nullptr)
+		child_indicator_bases_ = new BitvectorRank(*other.child_indicator_bases_);
+	    else
+		child_indicator_bitmaps_ = new BitvectorRankInterleaved(*other.child_indicator_bitmaps_);
+	    prefixkey_indicator_bits_ = new BitvectorRankInterleaved(*other.prefixkey_indicator_bits_);
+	}
+	if (other.root_stride_bits_ != nullptr)
+	    root_stride_bits_ = new BitvectorRank(*other.root_stride_bits_);
     }
     ~LoudsDense() {}
 
     // Returns whether key exists in the trie so far
     // out_node_num == 0 means search terminates in louds-dense.
-    inline bool lookupKey(const std::string& key, position_t& out_node_num) const;
+    // fp_probability (if not null) is set when the search terminates here
+    // (see BitvectorSuffix::estimateFpProbability; 0 for prefix keys).
+    // Lookup: see lookup_policy.hpp.
+    template <typename Lookup = DynamicLookup>
+    inline bool lookupKey(const PreparedKey& key, position_t& out_node_num,
+			  double* fp_probability = nullptr) const;
+    // Appends to ranges the key prefixes that reach a stored key, in
+    // ascending order of length; lookupKey accepts those that pass the
+    // suffix check. depth is the number of key bytes matched so far.
+    // Returns whether the search continues in louds-sparse (at
+    // out_node_num, same convention as lookupKey).
+    inline bool longestPrefixMatch(const std::string& key, std::vector<PrefixRange>& ranges,
+				   level_t& depth, position_t& out_node_num) const;
+    // Walks every trie branch that fits pattern. Stored prefixes that
+    // match it and end in louds-dense are appended to prefixes; if prefixes
+    // is null, the walk stops at the first match. Returns whether any
+    // matched. Branches that reach louds-sparse are returned in
+    // out_node_nums/out_prefixes for LoudsSparse::matchPattern.
+    inline bool matchPattern(const KeyPattern& pattern, std::vector<std::string>* prefixes,
+			     std::vector<position_t>& out_node_nums,
+			     std::vector<std::string>& out_prefixes) const;
     // return value indicates potential false positive
     inline bool moveToKeyGreaterThan(const std::string& key,
 			      const bool inclusive, LoudsDense::Iter& iter) const;
+    // return value indicates potential false positive
+    inline bool moveToKeyLessThan(const std::string& key,
+			   const bool inclusive, LoudsDense::Iter& iter) const;
     inline uint64_t approxCount(const LoudsDense::Iter* iter_left,
 			 const LoudsDense::Iter* iter_right,
 			 position_t& out_node_num_left,
 			 position_t& out_node_num_right) const;
 
     uint64_t getHeight() const { return height_; };
+    bool isNodeInterleaved() const { return (node_blocks_ != nullptr); };
+    bool isExact() const { return suffixes_->isExact(); };
+    SuffixType getSuffixType() const { return suffixes_->getType(); };
+    // 0 with the DenseNodeBlocks layout, which has no such directory
+    position_t getRankBlockSize() const {
+	return (label_bitmaps_ == nullptr) ? 0 : label_bitmaps_->getBasicBlockSize();
+    };
+    bool hasChildBases() const { return (child_indicator_bases_ != nullptr); };
+    bool hasRootStride() const { return (root_stride_bits_ != nullptr); };
     inline uint64_t serializedSize() const;
     inline uint64_t getMemoryUsage() const;
 
@@ -112,13 +179,25 @@ public:
 		*reinterpret_cast<uint32_t *>(dst) = htobe32(height_);
 	dst += sizeof(height_);
 	for(int i=0;i<height_;i++){
-		*reinterpret_cast<uint32_t *>(dst) = htobe32(level_cuts_[i]);
-		dst += sizeof(uint32_t);
+		writePosition(dst, level_cuts_[i]);
 	}
+	*reinterpret_cast<uint32_t *>(dst) = htobe32(getLayoutFlags());
+	dst += sizeof(uint32_t);
 	//align(dst);
-	label_bitmaps_->serialize(dst);
-	child_indicator_bitmaps_->serialize(dst);
-	prefixkey_indicator_bits_->serialize(dst);
+	if (isNodeInterleaved()) {
+	    node_blocks_->serialize(dst);
+	} else {
+	    label_bitmaps_->serialize(dst);
+	    if (hasChildBases())
+		child_indicator_bases_->serialize(dst);
+	    else
+		child_indicator_bitmaps_->serialize(dst);
+	    prefixkey_indicator_bits_->serialize(dst);
+	}
+	if (hasRootStride()) {
+	    writePosition(dst, root_stride_base_);
+	    root_stride_bits_->serialize(dst);
+	}
 	suffixes_->serialize(dst);
 	//align(dst);
     }
@@ -129,60 +208,161 @@ public:
 	src += sizeof(louds_dense->height_);
 	louds_dense->level_cuts_ = new position_t[louds_dense->height_];
 	for(int i=0;i<louds_dense->height_;i++){
-		louds_dense->level_cuts_[i] = be32toh(*reinterpret_cast<const uint32_t *>(src));
-		src += sizeof(uint32_t);
+		louds_dense->level_cuts_[i] = readPosition(src);
 	}
+	uint32_t layout_flags = be32toh(*reinterpret_cast<const uint32_t *>(src));
+	src += sizeof(uint32_t);
 	//align(src);
-	louds_dense->label_bitmaps_ = new BitvectorRank();
-	louds_dense->label_bitmaps_->deSerialize(src);
-	louds_dense->child_indicator_bitmaps_ = new BitvectorRank();
-	louds_dense->child_indicator_bitmaps_->deSerialize(src);
-	louds_dense->prefixkey_indicator_bits_ = new BitvectorRank();
-	louds_dense->prefixkey_indicator_bits_->deSerialize(src);
+	louds_dense->label_bitmaps_ = nullptr;
+	louds_dense->child_indicator_bitmaps_ = nullptr;
+	louds_dense->child_indicator_bases_ = nullptr;
+	louds_dense->prefixkey_indicator_bits_ = nullptr;
+	louds_dense->node_blocks_ = nullptr;
+	if (layout_flags & kLayoutInterleaved) {
+	    louds_dense->node_blocks_ = new DenseNodeBlocks();
+	    louds_dense->node_blocks_->deSerialize(src);
+	} else {
+	    louds_dense->label_bitmaps_ = new BitvectorRank();
+	    louds_dense->label_bitmaps_->deSerialize(src);
+	    if (layout_flags & kLayoutChildBases) {
+		louds_dense->child_indicator_bases_ = new BitvectorRank();
+		louds_dense->child_indicator_bases_->deSerialize(src);
+	    } else {
+		louds_dense->child_indicator_bitmaps_ = new BitvectorRankInterleaved();
+		louds_dense->child_indicator_bitmaps_->deSerialize(src);
+	    }
+	    louds_dense->prefixkey_indicator_bits_ = new BitvectorRankInterleaved();
+	    louds_dense->prefixkey_indicator_bits_->deSerialize(src);
+	}
+	louds_dense->root_stride_base_ = 0;
+	louds_dense->root_stride_bits_ = nullptr;
+	if (layout_flags & kLayoutRootStride) {
+	    louds_dense->root_stride_base_ = readPosition(src);
+	    louds_dense->root_stride_bits_ = new BitvectorRank();
+	    louds_dense->root_stride_bits_->deSerialize(src);
+	}
 	louds_dense->suffixes_ = new BitvectorSuffix();
 	louds_dense->suffixes_->deSerialize(src);
 	//align(src);
 	return louds_dense;
     }
 
+    // Reads the version 0 layout (32-bit fields, no layout flags, rank
+    // directories as BitvectorRank), see kSerializeVersion
+    static LoudsDense* deSerializeV0(const char*& src) {
+	LoudsDense* louds_dense = new LoudsDense();
+	louds_dense->height_ = readUint32(src);
+	louds_dense->level_cuts_ = new position_t[louds_dense->height_];
+	for (level_t i = 0; i < louds_dense->height_; i++)
+	    louds_dense->level_cuts_[i] = readUint32(src);
+	louds_dense->label_bitmaps_ = new BitvectorRank();
+	louds_dense->label_bitmaps_->deSerializeV0(src);
+	louds_dense->child_indicator_bitmaps_ = new BitvectorRankInterleaved();
+	louds_dense->child_indicator_bitmaps_->deSerializeV0(src);
+	louds_dense->child_indicator_bases_ = nullptr;
+	louds_dense->prefixkey_indicator_bits_ = new BitvectorRankInterleaved();
+	louds_dense->prefixkey_indicator_bits_->deSerializeV0(src);
+	louds_dense->node_blocks_ = nullptr;
+	louds_dense->root_stride_base_ = 0;
+	louds_dense->root_stride_bits_ = nullptr;
+	louds_dense->suffixes_ = new BitvectorSuffix();
+	louds_dense->suffixes_->deSerializeV0(src);
+	return louds_dense;
+    }
+
     void destroy() {
-	label_bitmaps_->destroy();
-	delete label_bitmaps_;
-	child_indicator_bitmaps_->destroy();
-	delete child_indicator_bitmaps_;
-	prefixkey_indicator_bits_->destroy();
-	delete prefixkey_indicator_bits_;
+	if (isNodeInterleaved()) {
+	    node_blocks_->destroy();
+	    delete node_blocks_;
+	} else {
+	    label_bitmaps_->destroy();
+	    delete label_bitmaps_;
+	    if (hasChildBases()) {
+		child_indicator_bases_->destroy();
+		delete child_indicator_bases_;
+	    } else {
+		child_indicator_bitmaps_->destroy();
+		delete child_indicator_bitmaps_;
+	    }
+	    prefixkey_indicator_bits_->destroy();
+	    delete prefixkey_indicator_bits_;
+	}
+	if (hasRootStride()) {
+	    root_stride_bits_->destroy();
+	    delete root_stride_bits_;
+	}
 	suffixes_->destroy();
 	delete suffixes_;
+	delete[] level_cuts_;
     }
 
 private:
     inline position_t getChildNodeNum(const position_t pos) const;
+    template <typename Lookup = DynamicLookup>
     inline position_t getSuffixPos(const position_t pos, const bool is_prefix_key) const;
     inline position_t getNextPos(const position_t pos) const;
     inline position_t getPrevPos(const position_t pos, bool* is_out_of_bound) const;
+    inline uint32_t getLayoutFlags() const;
+    inline void buildRootStride();
+
+    // Accessors that hide which of the two layouts is in use
+    inline bool hasLabel(const position_t pos) const;
+    inline bool hasChild(const position_t pos) const;
+    inline bool isPrefixKey(const position_t node_num) const;
+    template <typename Lookup = DynamicLookup>
+    inline position_t rankLabel(const position_t pos) const;
+    inline position_t rankChild(const position_t pos) const;
+    inline position_t rankPrefixKey(const position_t node_num) const;
+    inline position_t distanceToNextLabel(const position_t pos) const;
+    inline position_t distanceToPrevLabel(const position_t pos) const;
 
     inline bool compareSuffixGreaterThan(const position_t pos, const std::string& key,
 				  const level_t level, const bool inclusive, 
 				  LoudsDense::Iter& iter) const;
+    inline bool compareSuffixLessThan(const position_t pos, const std::string& key,
+			       const level_t level, const bool inclusive,
+			       LoudsDense::Iter& iter) const;
     inline void extendPosList(std::vector<position_t>& pos_list,
 		       position_t& out_node_num) const;
+    inline bool matchPatternInNode(const KeyPattern& pattern, const position_t node_num,
+				   std::string& prefix, std::vector<std::string>* prefixes,
+				   std::vector<position_t>& out_node_nums,
+				   std::vector<std::string>& out_prefixes) const;
 
 private:
     static const position_t kNodeFanout = 256;
     static const position_t kRankBasicBlockSize  = 512;
+    // bits of the serialized layout flags
+    static const uint32_t kLayoutInterleaved = 1;
+    static const uint32_t kLayoutChildBases = 2;
+    static const uint32_t kLayoutRootStride = 4;
+    static const position_t kRootStrideBits = kNodeFanout * kNodeFanout;
 
     level_t height_;
     position_t* level_cuts_; // position of the last bit at each level
 
     BitvectorRank* label_bitmaps_;
-    BitvectorRank* child_indicator_bitmaps_;
-    BitvectorRank* prefixkey_indicator_bits_; //1 bit per internal node
+    BitvectorRankInterleaved* child_indicator_bitmaps_;
+    // replaces child_indicator_bitmaps_ when not null: the rank directory
+    // has one entry per node, i.e., the number of the node's first child
+    // minus one, so that rank is that entry plus an in-node popcount
+    BitvectorRank* child_indicator_bases_;
+    BitvectorRankInterleaved* prefixkey_indicator_bits_; //1 bit per internal node
+    // replaces the three structures above when not null
+    DenseNodeBlocks* node_blocks_;
+    // Optional 16-bit stride over levels 0 and 1 for point queries: bit
+    // (key[0] << 8 | key[1]) is set iff that path continues to a node at
+    // level 2, whose number is then root_stride_base_ (the number of the
+    // root's children) plus the bit's rank.
+    position_t root_stride_base_;
+    BitvectorRank* root_stride_bits_;
     BitvectorSuffix* suffixes_;
 };
 
 
-LoudsDense::LoudsDense(const SuRFBuilder* builder) {
+LoudsDense::LoudsDense(const SuRFBuilder* builder, const bool interleave_nodes,
+		       const bool child_bases, const bool root_stride,
+		       const bool split_suffixes, const position_t rank_block_size) {
     height_ = builder->getSparseStartLevel();
     std::vector<position_t> num_bits_per_level;
     for (level_t level = 0; level < height_; level++)
@@ -195,17 +375,35 @@ LoudsDense::LoudsDense(const SuRFBuilder* builder) {
 	level_cuts_[level] = bit_count - 1;
     }
 
-    label_bitmaps_ = new BitvectorRank(kRankBasicBlockSize, builder->getBitmapLabels(),
-				       num_bits_per_level, 0, height_);
-    child_indicator_bitmaps_ = new BitvectorRank(kRankBasicBlockSize,
-						 builder->getBitmapChildIndicatorBits(),
-						 num_bits_per_level, 0, height_);
-    prefixkey_indicator_bits_ = new BitvectorRank(kRankBasicBlockSize,
-						  builder->getPrefixkeyIndicatorBits(),
-						  builder->getNodeCounts(), 0, height_);
+    label_bitmaps_ = nullptr;
+    child_indicator_bitmaps_ = nullptr;
+    child_indicator_bases_ = nullptr;
+    prefixkey_indicator_bits_ = nullptr;
+    node_blocks_ = nullptr;
+    if (interleave_nodes && DenseNodeBlocks::fits(bit_count)) {
+	node_blocks_ = new DenseNodeBlocks(builder->getBitmapLabels(),
+					   builder->getBitmapChildIndicatorBits(),
+					   builder->getPrefixkeyIndicatorBits(),
+					   builder->getNodeCounts(), 0, height_);
+    } else {
+	label_bitmaps_ = new BitvectorRank(rank_block_size, builder->getBitmapLabels(),
+					   num_bits_per_level, 0, height_);
+	if (child_bases)
+	    child_indicator_bases_ = new BitvectorRank(kNodeFanout, builder->getBitmapChildIndicatorBits(),
+						       num_bits_per_level, 0, height_);
+	else
+	    child_indicator_bitmaps_ = new BitvectorRankInterleaved(builder->getBitmapChildIndicatorBits(),
+								    num_bits_per_level, 0, height_);
+	prefixkey_indicator_bits_ = new BitvectorRankInterleaved(builder->getPrefixkeyIndicatorBits(),
+								 builder->getNodeCounts(), 0, height_);
+    }
 
     if (builder->getSuffixType() == kNone) {
-	suffixes_ = new BitvectorSuffix();
+	suffixes_ = new BitvectorSuffix(builder->isExact());
+    } else if (!builder->getHashSuffixLens().empty()) {
+	suffixes_ = new BitvectorSuffix(builder->getSuffixType(), builder->getHashSuffixLens(),
+					builder->getRealSuffixLen(), builder->getSuffixes(),
+					builder->getSuffixCounts(), 0, height_);
     } else {
 	level_t hash_suffix_len = builder->getHashSuffixLen();
         level_t real_suffix_len = builder->getRealSuffixLen();
@@ -216,38 +414,153 @@ LoudsDense::LoudsDense(const SuRFBuilder* builder) {
 	suffixes_ = new BitvectorSuffix(builder->getSuffixType(), 
 					hash_suffix_len, real_suffix_len,
                                         builder->getSuffixes(),
-					num_suffix_bits_per_level, 0, height_);
+					num_suffix_bits_per_level, 0, height_, split_suffixes);
     }
+    suffixes_->setSuffixHash(builder->getSuffixHash());
+
+    root_stride_base_ = 0;
+    root_stride_bits_ = nullptr;
+    // the directory only pays off if both levels are dense
+    if (root_stride && (height_ >= 2))
+	buildRootStride();
 }
 
-bool LoudsDense::lookupKey(const std::string& key, position_t& out_node_num) const {
+template <typename Lookup>
+bool LoudsDense::lookupKey(const PreparedKey& prepared_key, position_t& out_node_num,
+			   double* fp_probability) const {
+    const std::string& key = prepared_key.key();
     position_t node_num = 0;
     position_t pos = 0;
-    for (level_t level = 0; level < height_; level++) {
+    level_t level = 0;
+    if (hasRootStride() && (key.length() >= 2)) {
+	position_t stride = ((position_t)(label_t)key[0] * kNodeFanout) + (label_t)key[1];
+	// otherwise, the search ends at level 0 or 1 and takes the usual path
+	if (root_stride_bits_->readBit(stride)) {
+	    node_num = root_stride_base_ + root_stride_bits_->rank(stride);
+	    level = 2;
+	}
+    }
+    for (; level < height_; level++) {
 	pos = (node_num * kNodeFanout);
 	if (level >= key.length()) { //if run out of searchKey bytes
-	    if (prefixkey_indicator_bits_->readBit(node_num)) //if the prefix is also a key
-		return suffixes_->checkEquality(getSuffixPos(pos, true), key, level + 1);
-	    else
+	    if (isPrefixKey(node_num)) { //if the prefix is also a key
+		if (fp_probability != nullptr)
+		    *fp_probability = 0;
+		return Lookup::checkEquality(*suffixes_, getSuffixPos<Lookup>(pos, true),
+					     prepared_key, level + 1);
+	    } else {
 		return false;
+	    }
 	}
 	pos += (label_t)key[level];
 
 	//child_indicator_bitmaps_->prefetch(pos);
 
-	if (!label_bitmaps_->readBit(pos)) //if key byte does not exist
+	if (!hasLabel(pos)) //if key byte does not exist
+	    return false;
+
+	if (!hasChild(pos)) { //if trie branch terminates
+	    position_t suffix_pos = getSuffixPos<Lookup>(pos, false);
+	    if (fp_probability != nullptr)
+		*fp_probability = suffixes_->estimateFpProbability(suffix_pos);
+	    return Lookup::checkEquality(*suffixes_, suffix_pos, prepared_key, level + 1);
+	}
+
+	node_num = getChildNodeNum(pos);
+    }
+    //search will continue in LoudsSparse
+    out_node_num = node_num;
+    return true;
+}
+
+bool LoudsDense::longestPrefixMatch(const std::string& key, std::vector<PrefixRange>& ranges,
+				    level_t& depth, position_t& out_node_num) const {
+    position_t node_num = 0;
+    position_t pos = 0;
+    out_node_num = 0;
+    for (level_t level = 0; level < height_; level++) {
+	depth = level;
+	pos = (node_num * kNodeFanout);
+	if ((level > 0) && isPrefixKey(node_num)) //if the prefix is also a key
+	    ranges.push_back({suffixes_, getSuffixPos(pos, true), level, level, level + 1});
+	if (level >= key.length()) //if run out of searchKey bytes
+	    return false;
+	pos += (label_t)key[level];
+
+	if (!hasLabel(pos)) //if key byte does not exist
 	    return false;
 
-	if (!child_indicator_bitmaps_->readBit(pos)) //if trie branch terminates
-	    return suffixes_->checkEquality(getSuffixPos(pos, false), key, level + 1);
+	if (!hasChild(pos)) { //if trie branch terminates
+	    depth = level + 1;
+	    ranges.push_back({suffixes_, getSuffixPos(pos, false), level + 1,
+			      (level_t)key.length(), level + 1});
+	    return false;
+	}
 
 	node_num = getChildNodeNum(pos);
     }
     //search will continue in LoudsSparse
+    depth = height_;
     out_node_num = node_num;
     return true;
 }
 
+bool LoudsDense::matchPattern(const KeyPattern& pattern, std::vector<std::string>* prefixes,
+			      std::vector<position_t>& out_node_nums,
+			      std::vector<std::string>& out_prefixes) const {
+    std::string prefix;
+    if (height_ == 0) {
+	out_node_nums.push_back(0);
+	out_prefixes.push_back(prefix);
+	return false;
+    }
+    return matchPatternInNode(pattern, 0, prefix, prefixes, out_node_nums, out_prefixes);
+}
+
+bool LoudsDense::matchPatternInNode(const KeyPattern& pattern, const position_t node_num,
+				    std::string& prefix, std::vector<std::string>* prefixes,
+				    std::vector<position_t>& out_node_nums,
+				    std::vector<std::string>& out_prefixes) const {
+    level_t level = prefix.length();
+    // the whole pattern is matched; the node is non-empty
+    if (level >= pattern.size()) {
+	if (prefixes != nullptr)
+	    prefixes->push_back(prefix);
+	return true;
+    }
+    // prefix keys are shorter than the pattern and never match
+    bool found = false;
+    position_t pos = (node_num * kNodeFanout) + pattern.low(level);
+    position_t end_pos = (node_num * kNodeFanout) + pattern.high(level);
+    if (!hasLabel(pos))
+	pos += distanceToNextLabel(pos);
+    while (pos <= end_pos) {
+	prefix.push_back((char)(pos % kNodeFanout));
+	if (!hasChild(pos)) {
+	    // trie branch terminates: the truncated key may match,
+	    // unless it is a whole key shorter than the pattern
+	    if (!isExact() || (level + 1 == pattern.size())) {
+		if (prefixes != nullptr)
+		    prefixes->push_back(prefix);
+		found = true;
+	    }
+	} else if (level + 1 < height_) {
+	    found |= matchPatternInNode(pattern, getChildNodeNum(pos), prefix, prefixes,
+					out_node_nums, out_prefixes);
+	} else {
+	    out_node_nums.push_back(getChildNodeNum(pos));
+	    out_prefixes.push_back(prefix);
+	}
+	prefix.pop_back();
+	if (found && (prefixes == nullptr))
+	    return true;
+	if (pos == end_pos)
+	    break;
+	pos += distanceToNextLabel(pos);
+    }
+    return found;
+}
+
 bool LoudsDense::moveToKeyGreaterThan(const std::string& key, 
 				      const bool inclusive, LoudsDense::Iter& iter) const {
     position_t node_num = 0;
@@ -257,25 +570,30 @@ bool LoudsDense::moveToKeyGreaterThan(const std::string& key,
 	pos = node_num * kNodeFanout;
 	if (level >= key.length()) { // if run out of searchKey bytes
 	    iter.append(getNextPos(pos - 1));
-	    if (prefixkey_indicator_bits_->readBit(node_num)) //if the prefix is also a key
-		iter.is_at_prefix_key_ = true;
-	    else
+	    if (!isPrefixKey(node_num)) {
+		// moveToLeftMostKey sets the flags
 		iter.moveToLeftMostKey();
+		return true;
+	    }
+	    //the prefix is also a key, and equals key
+	    iter.is_at_prefix_key_ = true;
 	    // valid, search complete, moveLeft complete, moveRight complete
-	    iter.setFlags(true, true, true, true); 
-	    return true;
+	    iter.setFlags(true, true, true, true);
+	    if (!inclusive)
+		iter++;
+	    return false;
 	}
 
 	pos += (label_t)key[level];
 	iter.append(pos);
 
 	// if no exact match
-	if (!label_bitmaps_->readBit(pos)) {
+	if (!hasLabel(pos)) {
 	    iter++;
 	    return false;
 	}
 	//if trie branch terminates
-	if (!child_indicator_bitmaps_->readBit(pos))
+	if (!hasChild(pos))
 	    return compareSuffixGreaterThan(pos, key, level+1, inclusive, iter);
 	node_num = getChildNodeNum(pos);
     }
@@ -287,13 +605,55 @@ bool LoudsDense::moveToKeyGreaterThan(const std::string& key,
     return true;
 }
 
+bool LoudsDense::moveToKeyLessThan(const std::string& key,
+				   const bool inclusive, LoudsDense::Iter& iter) const {
+    position_t node_num = 0;
+    position_t pos = 0;
+    for (level_t level = 0; level < height_; level++) {
+	pos = node_num * kNodeFanout;
+	if (level >= key.length()) { // if run out of searchKey bytes
+	    //if the prefix is also a key
+	    if (inclusive && isPrefixKey(node_num)) {
+		iter.append(getNextPos(pos - 1));
+		iter.is_at_prefix_key_ = true;
+		// valid, search complete, moveLeft complete, moveRight complete
+		iter.setFlags(true, true, true, true);
+		return true;
+	    }
+	    // every key in this subtrie is greater than or equal to key
+	    if (level > 0)
+		iter--;
+	    return false;
+	}
+
+	pos += (label_t)key[level];
+	iter.append(pos);
+
+	// if no exact match
+	if (!hasLabel(pos)) {
+	    iter--;
+	    return false;
+	}
+	//if trie branch terminates
+	if (!hasChild(pos))
+	    return compareSuffixLessThan(pos, key, level+1, inclusive, iter);
+	node_num = getChildNodeNum(pos);
+    }
+
+    //search will continue in LoudsSparse
+    iter.setSendOutNodeNum(node_num);
+    // valid, search INCOMPLETE, moveLeft complete, moveRight complete
+    iter.setFlags(true, false, true, true);
+    return true;
+}
+
 void LoudsDense::extendPosList(std::vector<position_t>& pos_list,
 			       position_t& out_node_num) const {
     position_t node_num = 0;
     position_t pos = pos_list[pos_list.size() - 1];
     for (level_t i = pos_list.size(); i < height_; i++) {
 	node_num = getChildNodeNum(pos);
-	if (!child_indicator_bitmaps_->readBit(pos))
+	if (!hasChild(pos))
 	    node_num++;
 	pos = (node_num * kNodeFanout);
 	if (pos > level_cuts_[i]) {
@@ -309,7 +669,7 @@ void LoudsDense::extendPosList(std::vector<position_t>& pos_list,
 	out_node_num = pos;
     } else {
 	out_node_num = getChildNodeNum(pos);
-	if (!child_indicator_bitmaps_->readBit(pos))
+	if (!hasChild(pos))
 	    out_node_num++;
     }
 }
@@ -347,26 +707,26 @@ uint64_t LoudsDense::approxCount(const LoudsDense::Iter* iter_left,
 	    if (i >= ori_right_len && right_pos != level_cuts_[height_ - 1])
 		right_pos = getNextPos(right_pos);
 	    bool has_prefix_key_left
-		= prefixkey_indicator_bits_->readBit(left_pos / kNodeFanout);
+		= isPrefixKey(left_pos / kNodeFanout);
 	    bool has_prefix_key_right
-		= prefixkey_indicator_bits_->readBit(right_pos / kNodeFanout);
-	    position_t rank_left_label = label_bitmaps_->rank(left_pos);
-	    position_t rank_right_label = label_bitmaps_->rank(right_pos);
+		= isPrefixKey(right_pos / kNodeFanout);
+	    position_t rank_left_label = rankLabel(left_pos);
+	    position_t rank_right_label = rankLabel(right_pos);
 	    if (right_pos == level_cuts_[height_ - 1])
 		rank_right_label++;
-	    position_t rank_left_ind = child_indicator_bitmaps_->rank(left_pos);
-	    position_t rank_right_ind = child_indicator_bitmaps_->rank(right_pos);
+	    position_t rank_left_ind = rankChild(left_pos);
+	    position_t rank_right_ind = rankChild(right_pos);
 	    position_t rank_left_prefix
-		= prefixkey_indicator_bits_->rank(left_pos / kNodeFanout);
+		= rankPrefixKey(left_pos / kNodeFanout);
 	    position_t rank_right_prefix
-		= prefixkey_indicator_bits_->rank(right_pos / kNodeFanout);
+		= rankPrefixKey(right_pos / kNodeFanout);
 	    position_t num_leafs = (rank_right_label - rank_left_label)
 		- (rank_right_ind - rank_left_ind)
 		+ (rank_right_prefix - rank_left_prefix);
 	    // offcount in child_indicators
-	    if (child_indicator_bitmaps_->readBit(right_pos))
+	    if (hasChild(right_pos))
 		num_leafs++;
-	    if (child_indicator_bitmaps_->readBit(left_pos))
+	    if (hasChild(left_pos))
 		num_leafs--;
 	    // offcount in prefix keys
 	    if (i >= ori_right_len && has_prefix_key_right)
@@ -383,45 +743,145 @@ uint64_t LoudsDense::approxCount(const LoudsDense::Iter* iter_left,
 
 uint64_t LoudsDense::serializedSize() const {
     uint64_t size = sizeof(height_)
-	+ (sizeof(position_t) * height_);
+	+ (sizeof(position_t) * height_)
+	+ sizeof(uint32_t); // layout flag
     //sizeAlign(size);
-    size += (label_bitmaps_->serializedSize()
-	     + child_indicator_bitmaps_->serializedSize()
-	     + prefixkey_indicator_bits_->serializedSize()
-	     + suffixes_->serializedSize());
+    if (isNodeInterleaved())
+	size += node_blocks_->serializedSize();
+    else
+	size += (label_bitmaps_->serializedSize()
+		 + (hasChildBases() ? child_indicator_bases_->serializedSize()
+		    : child_indicator_bitmaps_->serializedSize())
+		 + prefixkey_indicator_bits_->serializedSize());
+    if (hasRootStride())
+	size += sizeof(root_stride_base_) + root_stride_bits_->serializedSize();
+    size += suffixes_->serializedSize();
     //sizeAlign(size);
     return size;
 }
 
 uint64_t LoudsDense::getMemoryUsage() const {
-    return (sizeof(LoudsDense)
-	    + label_bitmaps_->size()
-	    + child_indicator_bitmaps_->size()
-	    + prefixkey_indicator_bits_->size()
-	    + suffixes_->size());
+    uint64_t size = sizeof(LoudsDense) + suffixes_->size();
+    if (isNodeInterleaved())
+	size += node_blocks_->size();
+    else
+	size += (label_bitmaps_->size()
+		 + (hasChildBases() ? child_indicator_bases_->size() : child_indicator_bitmaps_->size())
+		 + prefixkey_indicator_bits_->size());
+    if (hasRootStride())
+	size += root_stride_bits_->size();
+    return size;
 }
 
 position_t LoudsDense::getChildNodeNum(const position_t pos) const {
-    return child_indicator_bitmaps_->rank(pos);
+    return rankChild(pos);
 }
 
+template <typename Lookup>
 position_t LoudsDense::getSuffixPos(const position_t pos, const bool is_prefix_key) const {
     position_t node_num = pos / kNodeFanout;
-    position_t suffix_pos = (label_bitmaps_->rank(pos)
-			     - child_indicator_bitmaps_->rank(pos)
-			     + prefixkey_indicator_bits_->rank(node_num)
+    position_t suffix_pos = (rankLabel<Lookup>(pos)
+			     - rankChild(pos)
+			     + rankPrefixKey(node_num)
 			     - 1);
-    if (is_prefix_key && label_bitmaps_->readBit(pos) && !child_indicator_bitmaps_->readBit(pos))
+    if (is_prefix_key && hasLabel(pos) && !hasChild(pos))
 	suffix_pos--;
     return suffix_pos;
 }
 
+uint32_t LoudsDense::getLayoutFlags() const {
+    uint32_t flags = 0;
+    if (isNodeInterleaved())
+	flags |= kLayoutInterleaved;
+    if (hasChildBases())
+	flags |= kLayoutChildBases;
+    if (hasRootStride())
+	flags |= kLayoutRootStride;
+    return flags;
+}
+
+void LoudsDense::buildRootStride() {
+    std::vector<word_t> bits(kRootStrideBits / kWordSize, 0);
+    for (position_t label0 = 0; label0 < kNodeFanout; label0++) {
+	if (!hasLabel(label0) || !hasChild(label0))
+	    continue;
+	position_t node_start_pos = getChildNodeNum(label0) * kNodeFanout;
+	for (position_t label1 = 0; label1 < kNodeFanout; label1++) {
+	    position_t pos = node_start_pos + label1;
+	    if (hasLabel(pos) && hasChild(pos)) {
+		position_t stride = label0 * kNodeFanout + label1;
+		bits[stride / kWordSize] |= (kMsbMask >> (stride % kWordSize));
+	    }
+	}
+    }
+    // level-2 nodes are numbered in (label0, label1) order after the
+    // root's children
+    root_stride_base_ = rankChild(kNodeFanout - 1);
+    std::vector<std::vector<word_t> > bits_per_level(1, bits);
+    std::vector<position_t> num_bits_per_level(1, (position_t)kRootStrideBits);
+    root_stride_bits_ = new BitvectorRank(kRankBasicBlockSize, bits_per_level,
+					  num_bits_per_level);
+}
+
+bool LoudsDense::hasLabel(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->readLabelBit(pos);
+    return label_bitmaps_->readBit(pos);
+}
+
+bool LoudsDense::hasChild(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->readChildBit(pos);
+    if (hasChildBases())
+	return child_indicator_bases_->readBit(pos);
+    return child_indicator_bitmaps_->readBit(pos);
+}
+
+bool LoudsDense::isPrefixKey(const position_t node_num) const {
+    if (isNodeInterleaved())
+	return node_blocks_->readPrefixKeyBit(node_num);
+    return prefixkey_indicator_bits_->readBit(node_num);
+}
+
+template <typename Lookup>
+position_t LoudsDense::rankLabel(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->rankLabel(pos);
+    return Lookup::rank(*label_bitmaps_, pos);
+}
+
+position_t LoudsDense::rankChild(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->rankChild(pos);
+    if (hasChildBases())
+	return child_indicator_bases_->rank(pos);
+    return child_indicator_bitmaps_->rank(pos);
+}
+
+position_t LoudsDense::rankPrefixKey(const position_t node_num) const {
+    if (isNodeInterleaved())
+	return node_blocks_->rankPrefixKey(node_num);
+    return prefixkey_indicator_bits_->rank(node_num);
+}
+
+position_t LoudsDense::distanceToNextLabel(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->distanceToNextLabel(pos);
+    return label_bitmaps_->distanceToNextSetBit(pos);
+}
+
+position_t LoudsDense::distanceToPrevLabel(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->distanceToPrevLabel(pos);
+    return label_bitmaps_->distanceToPrevSetBit(pos);
+}
+
 position_t LoudsDense::getNextPos(const position_t pos) const {
-    return pos + label_bitmaps_->distanceToNextSetBit(pos);
+    return pos + distanceToNextLabel(pos);
 }
 
 position_t LoudsDense::getPrevPos(const position_t pos, bool* is_out_of_bound) const {
-    position_t distance = label_bitmaps_->distanceToPrevSetBit(pos);
+    position_t distance = distanceToPrevLabel(pos);
     if (pos <= distance) {
 	*is_out_of_bound = true;
 	return 0;
@@ -435,7 +895,9 @@ bool LoudsDense::compareSuffixGreaterThan(const position_t pos, const std::strin
 					  LoudsDense::Iter& iter) const {
     position_t suffix_pos = getSuffixPos(pos, false);
     int compare = suffixes_->compare(suffix_pos, key, level);
-    if ((compare != kCouldBePositive) && (compare < 0)) {
+    // in exact mode, kCouldBePositive means the stored key equals key
+    if (((compare != kCouldBePositive) && (compare < 0))
+	|| ((compare == kCouldBePositive) && isExact() && !inclusive)) {
 	iter++;
 	return false;
     }
@@ -444,6 +906,21 @@ bool LoudsDense::compareSuffixGreaterThan(const position_t pos, const std::strin
     return true;
 }
 
+bool LoudsDense::compareSuffixLessThan(const position_t pos, const std::string& key,
+				       const level_t level, const bool inclusive,
+				       LoudsDense::Iter& iter) const {
+    position_t suffix_pos = getSuffixPos(pos, false);
+    int compare = suffixes_->compare(suffix_pos, key, level);
+    if (((compare != kCouldBePositive) && (compare > 0))
+	|| ((compare == kCouldBePositive) && isExact() && !inclusive)) {
+	iter--;
+	return false;
+    }
+    // valid, search complete, moveLeft complete, moveRight complete
+    iter.setFlags(true, true, true, true);
+    return (compare == kCouldBePositive);
+}
+
 //============================================================================
 
 void LoudsDense::Iter::clear() {
@@ -533,7 +1010,7 @@ void LoudsDense::Iter::setFlags(const bool is_valid,
 }
 
 void LoudsDense::Iter::setToFirstLabelInRoot() {
-    if (trie_->label_bitmaps_->readBit(0)) {
+    if (trie_->hasLabel(0)) {
 	pos_in_trie_[0] = 0;
 	key_[0] = (label_t)0;
     } else {
@@ -554,14 +1031,14 @@ void LoudsDense::Iter::moveToLeftMostKey() {
     assert(key_len_ > 0);
     level_t level = key_len_ - 1;
     position_t pos = pos_in_trie_[level];
-    if (!trie_->child_indicator_bitmaps_->readBit(pos))
+    if (!trie_->hasChild(pos))
 	// valid, search complete, moveLeft complete, moveRight complete
 	return setFlags(true, true, true, true);
 
     while (level < trie_->getHeight() - 1) {
 	position_t node_num = trie_->getChildNodeNum(pos);
 	//if the current prefix is also a key
-	if (trie_->prefixkey_indicator_bits_->readBit(node_num)) {
+	if (trie_->isPrefixKey(node_num)) {
 	    append(trie_->getNextPos(node_num * kNodeFanout - 1));
 	    is_at_prefix_key_ = true;
 	    // valid, search complete, moveLeft complete, moveRight complete
@@ -572,7 +1049,7 @@ void LoudsDense::Iter::moveToLeftMostKey() {
 	append(pos);
 
 	// if trie branch terminates
-	if (!trie_->child_indicator_bitmaps_->readBit(pos))
+	if (!trie_->hasChild(pos))
 	    // valid, search complete, moveLeft complete, moveRight complete
 	    return setFlags(true, true, true, true);
 
@@ -587,7 +1064,7 @@ void LoudsDense::Iter::moveToRightMostKey() {
     assert(key_len_ > 0);
     level_t level = key_len_ - 1;
     position_t pos = pos_in_trie_[level];
-    if (!trie_->child_indicator_bitmaps_->readBit(pos))
+    if (!trie_->hasChild(pos))
 	// valid, search complete, moveLeft complete, moveRight complete
 	return setFlags(true, true, true, true);
 
@@ -602,7 +1079,7 @@ void LoudsDense::Iter::moveToRightMostKey() {
 	append(pos);
 
 	// if trie branch terminates
-	if (!trie_->child_indicator_bitmaps_->readBit(pos))
+	if (!trie_->hasChild(pos))
 	    // valid, search complete, moveLeft complete, moveRight complete
 	    return setFlags(true, true, true, true);
 
@@ -653,7 +1130,7 @@ void LoudsDense::Iter::operator --(int) {
     while ((prev_pos / kNodeFanout) < (pos / kNodeFanout)) {
 	//if the current prefix is also a key
 	position_t node_num = pos / kNodeFanout;
-	if (trie_->prefixkey_indicator_bits_->readBit(node_num)) {
+	if (trie_->isPrefixKey(node_num)) {
 	    is_at_prefix_key_ = true;
 	    // valid, search complete, moveLeft complete, moveRight complete
 	    return setFlags(true, true, true, true);
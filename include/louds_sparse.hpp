@@ -1,12 +1,20 @@
 #ifndef LOUDSSPARSE_H_
 #define LOUDSSPARSE_H_
 
+#include <algorithm>
 #include <string>
 
 #include "config.hpp"
+#include "key_pattern.hpp"
 #include "label_vector.hpp"
-#include "rank.hpp"
+#include "lookup_policy.hpp"
+#include "rank_interleaved.hpp"
 #include "select.hpp"
+#include "single_child_chains.hpp"
+#include "sparse_hot_nodes.hpp"
+#include "sparse_node_bitmaps.hpp"
+#include "sparse_node_blocks.hpp"
+#include "sparse_subtree_clusters.hpp"
 #include "suffix.hpp"
 #include "surf_builder.hpp"
 
@@ -64,35 +72,111 @@ public:
 
 public:
     LoudsSparse() {};
-    inline LoudsSparse(const SuRFBuilder* builder);
+    // interleave_nodes selects the SparseNodeBlocks layout instead of
+    // separate label, child indicator and LOUDS arrays, if the levels
+    // fit its 32-bit counters (SparseNodeBlocks::fits).
+    // chain_min_len > 0 builds a SingleChildChains index over the chains
+    // of at least that many single-child nodes.
+    // bitmap_min_fanout > 0 gives the nodes with at least that many labels
+    // a label bitmap (SparseNodeBitmaps).
+    // split_suffixes selects the split BitvectorSuffix layout (uniform
+    // suffix lengths only).
+    // cluster_bytes > 0 adds a subtree-clustered copy of the nodes, in
+    // clusters of about that many bytes, that point queries walk
+    // instead (SparseSubtreeClusters).
+    // select_sample_interval is the sampling interval of the LOUDS bits
+    // select directory (see kSparseSelectSampleInterval).
+    inline LoudsSparse(const SuRFBuilder* builder,
+		       const bool interleave_nodes = kInterleaveSparseNodes,
+		       const level_t chain_min_len = kSparseChainMinLen,
+		       const position_t bitmap_min_fanout = kSparseBitmapMinFanout,
+		       const bool split_suffixes = kSplitSuffixes,
+		       const position_t cluster_bytes = kSparseClusterBytes,
+		       const position_t select_sample_interval = kSparseSelectSampleInterval);
     LoudsSparse(const LoudsSparse& other)
         : height_(other.height_),
           start_level_(other.start_level_),
           node_count_dense_(other.node_count_dense_),
           child_count_dense_(other.child_count_dense_),
-          labels_(new LabelVector(*other.labels_)),
-          child_indicator_bits_(new BitvectorRank(*other.child_indicator_bits_)),
-          louds_bits_(new BitvectorSelect(*other.louds_bits_)),
+          labels_(nullptr),
+          child_indicator_bits_(nullptr),
+          louds_bits_(nullptr),
+          node_blocks_(nullptr),
+          chains_(nullptr),
+          node_bitmaps_(nullptr),
+          clusters_(nullptr),
+          hot_nodes_(nullptr),
           suffixes_(new BitvectorSuffix(*other.suffixes_)){
         level_cuts_ = new position_t[height_];
         memmove(level_cuts_, other.level_cuts_, height_*sizeof(position_t));
+	if (other.node_blocks_ != nullptr) {
+	    node_blocks_ = new SparseNodeBlocks(*other.node_blocks_);
+	} else {
+	    labels_ = new LabelVector(*other.labels_);
+	    child_indicator_bits_ = new BitvectorRankInterleaved(*other.child_indicator_bits_);
+	    louds_bits_ = new BitvectorSelect(*other.louds_bits_);
+	}
+	if (other.chains_ != nullptr)
+	    chains_ = new SingleChildChains(*other.chains_);
+	if (other.node_bitmaps_ != nullptr)
+	    node_bitmaps_ = new SparseNodeBitmaps(*other.node_bitmaps_);
+	if (other.clusters_ != nullptr)
+	    clusters_ = new SparseSubtreeClusters(*other.clusters_);
+	if (other.hot_nodes_ != nullptr)
+	    hot_nodes_ = new SparseHotNodes(*other.hot_nodes_);
     }
 
     ~LoudsSparse() {}
 
     // point query: trie walk starts at node "in_node_num" instead of root
     // in_node_num is provided by louds-dense's lookupKey function
-    inline bool lookupKey(const std::string& key, const position_t in_node_num) const;
+    // fp_probability: see LoudsDense::lookupKey
+    // Lookup: see lookup_policy.hpp.
+    template <typename Lookup = DynamicLookup>
+    inline bool lookupKey(const PreparedKey& key, const position_t in_node_num,
+			  double* fp_probability = nullptr) const;
+    // Continues LoudsDense::longestPrefixMatch from node "in_node_num"
+    inline void longestPrefixMatch(const std::string& key, const position_t in_node_num,
+				   std::vector<PrefixRange>& ranges, level_t& depth) const;
+    // Continues LoudsDense::matchPattern from node "in_node_num", which
+    // is reached by prefix
+    inline bool matchPattern(const KeyPattern& pattern, const position_t in_node_num,
+			     std::string& prefix, std::vector<std::string>* prefixes) const;
     // return value indicates potential false positive
     inline bool moveToKeyGreaterThan(const std::string& key,
 			      const bool inclusive, LoudsSparse::Iter& iter) const;
+    // return value indicates potential false positive
+    inline bool moveToKeyLessThan(const std::string& key,
+			   const bool inclusive, LoudsSparse::Iter& iter) const;
     inline uint64_t approxCount(const LoudsSparse::Iter* iter_left,
 			 const LoudsSparse::Iter* iter_right,
 			 const position_t in_node_num_left,
 			 const position_t in_node_num_right) const;
+    // Gives the nodes that the point queries keys visit most, starting at
+    // nodes in_node_nums (see lookupKey), the LOUDS-Dense encoding
+    // (SparseHotNodes), in at most max_bytes; lookupKey then crosses
+    // them without the LOUDS select. Replaces earlier hot nodes.
+    inline void promoteHotNodes(const std::vector<std::string>& keys,
+				const std::vector<position_t>& in_node_nums,
+				const uint64_t max_bytes);
 
     level_t getHeight() const { return height_; };
     level_t getStartLevel() const { return start_level_; };
+    bool isNodeInterleaved() const { return (node_blocks_ != nullptr); };
+    bool isExact() const { return suffixes_->isExact(); };
+    SuffixType getSuffixType() const { return suffixes_->getType(); };
+    // 0 with the SparseNodeBlocks layout, which has its own directory
+    position_t getSelectSampleInterval() const {
+	return (louds_bits_ == nullptr) ? 0 : louds_bits_->getSampleInterval();
+    };
+    position_t numChains() const { return (chains_ == nullptr) ? 0 : chains_->numChains(); };
+    position_t numBitmapNodes() const {
+	return (node_bitmaps_ == nullptr) ? 0 : node_bitmaps_->numNodes();
+    };
+    bool hasClusters() const { return (clusters_ != nullptr); };
+    position_t numHotNodes() const {
+	return (hot_nodes_ == nullptr) ? 0 : hot_nodes_->numHotNodes();
+    };
     inline uint64_t serializedSize() const;
     inline uint64_t getMemoryUsage() const;
 
@@ -101,18 +185,29 @@ public:
 	dst += sizeof(height_);
 	*reinterpret_cast<uint32_t*>(dst) = htobe32(start_level_);
 	dst += sizeof(start_level_);
-	*reinterpret_cast<uint32_t*>(dst) = htobe32(node_count_dense_);
-	dst += sizeof(node_count_dense_);
-	*reinterpret_cast<uint32_t*>(dst) = htobe32(child_count_dense_);
-	dst += sizeof(child_count_dense_);
+	writePosition(dst, node_count_dense_);
+	writePosition(dst, child_count_dense_);
 	for(int i=0;i<height_;i++){
-		*reinterpret_cast<uint32_t*>(dst) = htobe32(level_cuts_[i]);
-		dst += sizeof(position_t);
+		writePosition(dst, level_cuts_[i]);
 	}
+	*reinterpret_cast<uint32_t*>(dst) = htobe32(getLayoutFlags());
+	dst += sizeof(uint32_t);
 	//align(dst);
-	labels_->serialize(dst);
-	child_indicator_bits_->serialize(dst);
-	louds_bits_->serialize(dst);
+	if (isNodeInterleaved()) {
+	    node_blocks_->serialize(dst);
+	} else {
+	    labels_->serialize(dst);
+	    child_indicator_bits_->serialize(dst);
+	    louds_bits_->serialize(dst);
+	}
+	if (chains_ != nullptr)
+	    chains_->serialize(dst);
+	if (node_bitmaps_ != nullptr)
+	    node_bitmaps_->serialize(dst);
+	if (clusters_ != nullptr)
+	    clusters_->serialize(dst);
+	if (hot_nodes_ != nullptr)
+	    hot_nodes_->serialize(dst);
 	suffixes_->serialize(dst);
 	//align(dst);
     }
@@ -123,54 +218,164 @@ public:
 	src += sizeof(louds_sparse->height_);
 	louds_sparse->start_level_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
 	src += sizeof(louds_sparse->start_level_);
-	louds_sparse->node_count_dense_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
-	src += sizeof(louds_sparse->node_count_dense_);
-	louds_sparse->child_count_dense_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
-	src += sizeof(louds_sparse->child_count_dense_);
+	louds_sparse->node_count_dense_ = readPosition(src);
+	louds_sparse->child_count_dense_ = readPosition(src);
 	louds_sparse->level_cuts_ = new position_t[louds_sparse->height_];
 	for(int i=0;i<louds_sparse->height_;i++){
-		louds_sparse->level_cuts_[i] = be32toh(*reinterpret_cast<const uint32_t*>(src));
-		src += sizeof(uint32_t);
+		louds_sparse->level_cuts_[i] = readPosition(src);
 	}
+	uint32_t layout_flags = be32toh(*reinterpret_cast<const uint32_t*>(src));
+	src += sizeof(uint32_t);
 	//align(src);
-	louds_sparse->labels_ = new LabelVector();
-	louds_sparse->labels_->deSerialize(src);
-	louds_sparse->child_indicator_bits_ = new BitvectorRank();
-	louds_sparse->child_indicator_bits_->deSerialize(src);
-	louds_sparse->louds_bits_ = new BitvectorSelect();
-	louds_sparse->louds_bits_->deSerialize(src);
+	louds_sparse->labels_ = nullptr;
+	louds_sparse->child_indicator_bits_ = nullptr;
+	louds_sparse->louds_bits_ = nullptr;
+	louds_sparse->node_blocks_ = nullptr;
+	louds_sparse->chains_ = nullptr;
+	louds_sparse->node_bitmaps_ = nullptr;
+	louds_sparse->clusters_ = nullptr;
+	louds_sparse->hot_nodes_ = nullptr;
+	if (layout_flags & kLayoutInterleaved) {
+	    louds_sparse->node_blocks_ = new SparseNodeBlocks();
+	    louds_sparse->node_blocks_->deSerialize(src);
+	} else {
+	    louds_sparse->labels_ = new LabelVector();
+	    louds_sparse->labels_->deSerialize(src);
+	    louds_sparse->child_indicator_bits_ = new BitvectorRankInterleaved();
+	    louds_sparse->child_indicator_bits_->deSerialize(src);
+	    louds_sparse->louds_bits_ = new BitvectorSelect();
+	    louds_sparse->louds_bits_->deSerialize(src);
+	}
+	if (layout_flags & kLayoutChains) {
+	    louds_sparse->chains_ = new SingleChildChains();
+	    louds_sparse->chains_->deSerialize(src);
+	}
+	if (layout_flags & kLayoutNodeBitmaps) {
+	    louds_sparse->node_bitmaps_ = new SparseNodeBitmaps();
+	    louds_sparse->node_bitmaps_->deSerialize(src);
+	}
+	if (layout_flags & kLayoutClusters) {
+	    louds_sparse->clusters_ = new SparseSubtreeClusters();
+	    louds_sparse->clusters_->deSerialize(src);
+	}
+	if (layout_flags & kLayoutHotNodes) {
+	    louds_sparse->hot_nodes_ = new SparseHotNodes();
+	    louds_sparse->hot_nodes_->deSerialize(src);
+	}
 	louds_sparse->suffixes_ = new BitvectorSuffix();
 	louds_sparse->suffixes_->deSerialize(src);
 	//align(src);
 	return louds_sparse;
     }
 
+    // Reads the version 0 layout (32-bit fields, no layout flags, child
+    // indicator rank directory as BitvectorRank), see kSerializeVersion
+    static LoudsSparse* deSerializeV0(const char*& src) {
+	LoudsSparse* louds_sparse = new LoudsSparse();
+	louds_sparse->height_ = readUint32(src);
+	louds_sparse->start_level_ = readUint32(src);
+	louds_sparse->node_count_dense_ = readUint32(src);
+	louds_sparse->child_count_dense_ = readUint32(src);
+	louds_sparse->level_cuts_ = new position_t[louds_sparse->height_];
+	for (level_t i = 0; i < louds_sparse->height_; i++)
+	    louds_sparse->level_cuts_[i] = readUint32(src);
+	louds_sparse->labels_ = new LabelVector();
+	louds_sparse->labels_->deSerializeV0(src);
+	louds_sparse->child_indicator_bits_ = new BitvectorRankInterleaved();
+	louds_sparse->child_indicator_bits_->deSerializeV0(src);
+	louds_sparse->louds_bits_ = new BitvectorSelect();
+	louds_sparse->louds_bits_->deSerializeV0(src);
+	louds_sparse->node_blocks_ = nullptr;
+	louds_sparse->chains_ = nullptr;
+	louds_sparse->node_bitmaps_ = nullptr;
+	louds_sparse->clusters_ = nullptr;
+	louds_sparse->hot_nodes_ = nullptr;
+	louds_sparse->suffixes_ = new BitvectorSuffix();
+	louds_sparse->suffixes_->deSerializeV0(src);
+	return louds_sparse;
+    }
+
     void destroy() {
 	delete[] level_cuts_;
-	labels_->destroy();
-        delete labels_;
-	child_indicator_bits_->destroy();
-	delete child_indicator_bits_;
-	louds_bits_->destroy();
-	delete louds_bits_;
+	if (isNodeInterleaved()) {
+	    node_blocks_->destroy();
+	    delete node_blocks_;
+	} else {
+	    labels_->destroy();
+	    delete labels_;
+	    child_indicator_bits_->destroy();
+	    delete child_indicator_bits_;
+	    louds_bits_->destroy();
+	    delete louds_bits_;
+	}
+	if (chains_ != nullptr) {
+	    chains_->destroy();
+	    delete chains_;
+	}
+	if (node_bitmaps_ != nullptr) {
+	    node_bitmaps_->destroy();
+	    delete node_bitmaps_;
+	}
+	if (clusters_ != nullptr) {
+	    clusters_->destroy();
+	    delete clusters_;
+	}
+	destroyHotNodes();
 	suffixes_->destroy();
 	delete suffixes_;
     }
 
 private:
     inline position_t getChildNodeNum(const position_t pos) const;
+    template <typename Lookup = DynamicLookup>
     inline position_t getFirstLabelPos(const position_t node_num) const;
     inline position_t getLastLabelPos(const position_t node_num) const;
     inline position_t getSuffixPos(const position_t pos) const;
     inline position_t nodeSize(const position_t pos) const;
     inline bool isEndofNode(const position_t pos) const;
 
+    // Accessors that hide which of the two layouts is in use
+    inline label_t readLabel(const position_t pos) const;
+    inline bool hasChild(const position_t pos) const;
+    inline position_t rankChild(const position_t pos) const;
+    inline bool isNodeStart(const position_t pos) const;
+    inline position_t numLabels() const;
+    inline position_t numNodes() const;
+    inline uint32_t getLayoutFlags() const;
+
+    inline void buildChains(const level_t min_len);
+    inline void buildNodeBitmaps(const position_t min_fanout);
+    inline void buildClusters(const position_t cluster_bytes, const position_t num_roots);
+    template <typename Lookup>
+    inline bool lookupKeyInClusters(const PreparedKey& key, const position_t in_node_num,
+				    double* fp_probability) const;
+    // Adds 1 to visits[id] for each sparse node id that the point query
+    // key reads a label from
+    inline void countNodeVisits(const std::string& key, const position_t in_node_num,
+				std::vector<position_t>& visits) const;
+    inline bool isHotNode(const position_t node_num) const;
+    inline void destroyHotNodes();
+    // Returns the number of levels skipped (see SingleChildChains::skip)
+    inline level_t skipChain(const std::string& key, const level_t level,
+			     position_t& node_num) const;
+    inline bool searchLabel(const label_t target, position_t& pos,
+			    const position_t search_len) const;
+    inline bool searchLabelGreaterThan(const label_t target, position_t& pos,
+				       const position_t search_len) const;
+    inline bool searchLabelLessThan(const label_t target, position_t& pos,
+				    const position_t search_len) const;
+
     inline void moveToLeftInNextSubtrie(position_t pos, const position_t node_size,
 				 const label_t label, LoudsSparse::Iter& iter) const;
+    inline void moveToRightInPrevSubtrie(const position_t pos, const position_t node_size,
+				  const label_t label, LoudsSparse::Iter& iter) const;
     // return value indicates potential false positive
     inline bool compareSuffixGreaterThan(const position_t pos, const std::string& key,
 				  const level_t level, const bool inclusive, 
 				  LoudsSparse::Iter& iter) const;
+    inline bool compareSuffixLessThan(const position_t pos, const std::string& key,
+			       const level_t level, const bool inclusive,
+			       LoudsSparse::Iter& iter) const;
 
     inline position_t appendToPosList(std::vector<position_t>& pos_list,
 			       const position_t node_num, const level_t level,
@@ -181,8 +386,12 @@ private:
 		       const position_t right_in_node_num) const;
 
 private:
-    static const position_t kRankBasicBlockSize = 512;
-    static const position_t kSelectSampleInterval = 64;
+    // bits of the serialized layout flags
+    static const uint32_t kLayoutInterleaved = 1;
+    static const uint32_t kLayoutChains = 2;
+    static const uint32_t kLayoutNodeBitmaps = 4;
+    static const uint32_t kLayoutClusters = 8;
+    static const uint32_t kLayoutHotNodes = 16;
 
     level_t height_; // trie height
     level_t start_level_; // louds-sparse encoding starts at this level
@@ -193,13 +402,22 @@ private:
     position_t* level_cuts_; // position of the last bit at each level
 
     LabelVector* labels_;
-    BitvectorRank* child_indicator_bits_;
+    BitvectorRankInterleaved* child_indicator_bits_;
     BitvectorSelect* louds_bits_;
+    // replaces the three structures above when not null
+    SparseNodeBlocks* node_blocks_;
+    SingleChildChains* chains_; // optional
+    SparseNodeBitmaps* node_bitmaps_; // optional
+    SparseSubtreeClusters* clusters_; // optional
+    SparseHotNodes* hot_nodes_; // optional
     BitvectorSuffix* suffixes_;
 };
 
 
-LoudsSparse::LoudsSparse(const SuRFBuilder* builder) {
+LoudsSparse::LoudsSparse(const SuRFBuilder* builder, const bool interleave_nodes,
+			 const level_t chain_min_len, const position_t bitmap_min_fanout,
+			 const bool split_suffixes, const position_t cluster_bytes,
+			 const position_t select_sample_interval) {
     height_ = builder->getLabels().size();
     start_level_ = builder->getSparseStartLevel();
 
@@ -212,8 +430,6 @@ LoudsSparse::LoudsSparse(const SuRFBuilder* builder) {
     else
 	child_count_dense_ = node_count_dense_ + builder->getNodeCounts()[start_level_] - 1;
 
-    labels_ = new LabelVector(builder->getLabels(), start_level_, height_);
-
     std::vector<position_t> num_items_per_level;
     for (level_t level = 0; level < height_; level++)
 	num_items_per_level.push_back(builder->getLabels()[level].size());
@@ -228,13 +444,38 @@ LoudsSparse::LoudsSparse(const SuRFBuilder* builder) {
 	level_cuts_[level] = bit_count - 1;
     }
 
-    child_indicator_bits_ = new BitvectorRank(kRankBasicBlockSize, builder->getChildIndicatorBits(), 
-					      num_items_per_level, start_level_, height_);
-    louds_bits_ = new BitvectorSelect(kSelectSampleInterval, builder->getLoudsBits(), 
-				      num_items_per_level, start_level_, height_);
+    labels_ = nullptr;
+    child_indicator_bits_ = nullptr;
+    louds_bits_ = nullptr;
+    node_blocks_ = nullptr;
+    if (interleave_nodes && SparseNodeBlocks::fits(bit_count)) {
+	node_blocks_ = new SparseNodeBlocks(builder->getLabels(), builder->getChildIndicatorBits(),
+					    builder->getLoudsBits(), start_level_, height_);
+    } else {
+	labels_ = new LabelVector(builder->getLabels(), start_level_, height_);
+	child_indicator_bits_ = new BitvectorRankInterleaved(builder->getChildIndicatorBits(),
+							     num_items_per_level, start_level_, height_);
+	louds_bits_ = new BitvectorSelect(select_sample_interval, builder->getLoudsBits(),
+					  num_items_per_level, start_level_, height_, true);
+    }
+
+    chains_ = nullptr;
+    if (chain_min_len > 0)
+	buildChains(chain_min_len);
+    node_bitmaps_ = nullptr;
+    if (bitmap_min_fanout > 0)
+	buildNodeBitmaps(bitmap_min_fanout);
+    clusters_ = nullptr;
+    hot_nodes_ = nullptr;
+    if ((cluster_bytes > 0) && (start_level_ < height_))
+	buildClusters(cluster_bytes, builder->getNodeCounts()[start_level_]);
 
     if (builder->getSuffixType() == kNone) {
-	suffixes_ = new BitvectorSuffix();
+	suffixes_ = new BitvectorSuffix(builder->isExact());
+    } else if (!builder->getHashSuffixLens().empty()) {
+	suffixes_ = new BitvectorSuffix(builder->getSuffixType(), builder->getHashSuffixLens(),
+					builder->getRealSuffixLen(), builder->getSuffixes(),
+					builder->getSuffixCounts(), start_level_, height_);
     } else {
 	level_t hash_suffix_len = builder->getHashSuffixLen();
         level_t real_suffix_len = builder->getRealSuffixLen();
@@ -245,32 +486,153 @@ LoudsSparse::LoudsSparse(const SuRFBuilder* builder) {
 
 	suffixes_ = new BitvectorSuffix(builder->getSuffixType(), hash_suffix_len, real_suffix_len,
                                         builder->getSuffixes(),
-					num_suffix_bits_per_level, start_level_, height_);
+					num_suffix_bits_per_level, start_level_, height_,
+					split_suffixes);
     }
+    suffixes_->setSuffixHash(builder->getSuffixHash());
 }
 
-bool LoudsSparse::lookupKey(const std::string& key, const position_t in_node_num) const {
+template <typename Lookup>
+bool LoudsSparse::lookupKey(const PreparedKey& prepared_key, const position_t in_node_num,
+			    double* fp_probability) const {
+    if (clusters_ != nullptr)
+	return lookupKeyInClusters<Lookup>(prepared_key, in_node_num, fp_probability);
+    const std::string& key = prepared_key.key();
     position_t node_num = in_node_num;
-    position_t pos = getFirstLabelPos(node_num);
-    level_t level = 0;
-    for (level = start_level_; level < key.length(); level++) {
+    level_t level = start_level_;
+    level += skipChain(key, level, node_num);
+    position_t pos;
+    for (; level < key.length(); level++) {
+	if (isHotNode(node_num)) {
+	    position_t next;
+	    bool is_leaf;
+	    if (!hot_nodes_->step(node_num - node_count_dense_, (label_t)key[level],
+				  next, is_leaf))
+		return false;
+	    if (is_leaf) {
+		if (fp_probability != nullptr)
+		    *fp_probability = suffixes_->estimateFpProbability(next);
+		return Lookup::checkEquality(*suffixes_, next, prepared_key, level + 1);
+	    }
+	    node_num = next;
+	    level += skipChain(key, level + 1, node_num);
+	    continue;
+	}
+	pos = getFirstLabelPos<Lookup>(node_num);
 	//child_indicator_bits_->prefetch(pos);
-	if (!labels_->search((label_t)key[level], pos, nodeSize(pos)))
+	if (!searchLabel((label_t)key[level], pos, nodeSize(pos)))
 	    return false;
 
 	// if trie branch terminates
-	if (!child_indicator_bits_->readBit(pos))
-	    return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1);
+	if (!hasChild(pos)) {
+	    if (fp_probability != nullptr)
+		*fp_probability = suffixes_->estimateFpProbability(getSuffixPos(pos));
+	    return Lookup::checkEquality(*suffixes_, getSuffixPos(pos), prepared_key, level + 1);
+	}
 
 	// move to child
 	node_num = getChildNodeNum(pos);
-	pos = getFirstLabelPos(node_num);
+	level += skipChain(key, level + 1, node_num);
+    }
+    pos = getFirstLabelPos<Lookup>(node_num);
+    if ((readLabel(pos) == kTerminator) && (!hasChild(pos))) {
+	if (fp_probability != nullptr)
+	    *fp_probability = 0;
+	return Lookup::checkEquality(*suffixes_, getSuffixPos(pos), prepared_key, level + 1);
     }
-    if ((labels_->read(pos) == kTerminator) && (!child_indicator_bits_->readBit(pos)))
-	return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1);
     return false;
 }
 
+template <typename Lookup>
+bool LoudsSparse::lookupKeyInClusters(const PreparedKey& prepared_key,
+				      const position_t in_node_num,
+				      double* fp_probability) const {
+    const std::string& key = prepared_key.key();
+    level_t level = start_level_;
+    position_t suffix_pos;
+    if (!clusters_->walk(key, in_node_num - node_count_dense_, level, suffix_pos))
+	return false;
+    // a walk that ran out of key bytes ended at a prefix key
+    if (fp_probability != nullptr)
+	*fp_probability = ((level < key.length())
+			   ? suffixes_->estimateFpProbability(suffix_pos) : 0);
+    return Lookup::checkEquality(*suffixes_, suffix_pos, prepared_key, level + 1);
+}
+
+void LoudsSparse::longestPrefixMatch(const std::string& key, const position_t in_node_num,
+				     std::vector<PrefixRange>& ranges, level_t& depth) const {
+    position_t node_num = in_node_num;
+    level_t level = start_level_;
+    // chain nodes hold no prefix keys, so skipping them loses no match
+    level += skipChain(key, level, node_num);
+    position_t pos = getFirstLabelPos(node_num);
+    for (; level < key.length(); level++) {
+	depth = level;
+	// if the prefix is also a key
+	if ((level > 0) && (readLabel(pos) == kTerminator) && (!hasChild(pos)))
+	    ranges.push_back({suffixes_, getSuffixPos(pos), level, level, level + 1});
+	if (!searchLabel((label_t)key[level], pos, nodeSize(pos)))
+	    return;
+
+	// if trie branch terminates
+	if (!hasChild(pos)) {
+	    depth = level + 1;
+	    ranges.push_back({suffixes_, getSuffixPos(pos), level + 1,
+			      (level_t)key.length(), level + 1});
+	    return;
+	}
+
+	// move to child
+	node_num = getChildNodeNum(pos);
+	level += skipChain(key, level + 1, node_num);
+	pos = getFirstLabelPos(node_num);
+    }
+    depth = level;
+    if ((level > 0) && (readLabel(pos) == kTerminator) && (!hasChild(pos)))
+	ranges.push_back({suffixes_, getSuffixPos(pos), level, level, level + 1});
+}
+
+bool LoudsSparse::matchPattern(const KeyPattern& pattern, const position_t in_node_num,
+			       std::string& prefix, std::vector<std::string>* prefixes) const {
+    level_t level = prefix.length();
+    // the whole pattern is matched; the node is non-empty
+    if (level >= pattern.size()) {
+	if (prefixes != nullptr)
+	    prefixes->push_back(prefix);
+	return true;
+    }
+    bool found = false;
+    position_t pos = getFirstLabelPos(in_node_num);
+    position_t end_pos = pos + nodeSize(pos);
+    // prefix keys are shorter than the pattern and never match
+    if ((readLabel(pos) == kTerminator) && (!hasChild(pos))
+	&& (end_pos - pos > 1))
+	pos++;
+    for (; pos < end_pos; pos++) {
+	label_t label = readLabel(pos);
+	if (label < pattern.low(level))
+	    continue;
+	if (label > pattern.high(level))
+	    break;
+	prefix.push_back((char)label);
+	if (!hasChild(pos)) {
+	    // trie branch terminates: the truncated key may match,
+	    // unless it is a whole key shorter than the pattern
+	    if (!isExact() || (level + 1 == pattern.size())) {
+		if (prefixes != nullptr)
+		    prefixes->push_back(prefix);
+		found = true;
+	    }
+	} else {
+	    found |= matchPattern(pattern, getChildNodeNum(pos), prefix, prefixes);
+	}
+	prefix.pop_back();
+	if (found && (prefixes == nullptr))
+	    return true;
+    }
+    return found;
+}
+
 bool LoudsSparse::moveToKeyGreaterThan(const std::string& key, 
 				       const bool inclusive, LoudsSparse::Iter& iter) const {
     position_t node_num = iter.getStartNodeNum();
@@ -279,16 +641,17 @@ bool LoudsSparse::moveToKeyGreaterThan(const std::string& key,
     level_t level;
     for (level = start_level_; level < key.length(); level++) {
 	position_t node_size = nodeSize(pos);
+	position_t node_start_pos = pos;
 	// if no exact match
-	if (!labels_->search((label_t)key[level], pos, node_size)) {
-	    moveToLeftInNextSubtrie(pos, node_size, key[level], iter);
+	if (!searchLabel((label_t)key[level], pos, node_size)) {
+	    moveToLeftInNextSubtrie(node_start_pos, node_size, key[level], iter);
 	    return false;
 	}
 
 	iter.append(key[level], pos);
 
 	// if trie branch terminates
-	if (!child_indicator_bits_->readBit(pos))
+	if (!hasChild(pos))
 	    return compareSuffixGreaterThan(pos, key, level+1, inclusive, iter);
 
 	// move to child
@@ -296,8 +659,8 @@ bool LoudsSparse::moveToKeyGreaterThan(const std::string& key,
 	pos = getFirstLabelPos(node_num);
     }
 
-    if ((labels_->read(pos) == kTerminator)
-	&& (!child_indicator_bits_->readBit(pos))
+    if ((readLabel(pos) == kTerminator)
+	&& (!hasChild(pos))
 	&& !isEndofNode(pos)) {
 	iter.append(kTerminator, pos);
 	iter.is_at_terminator_ = true;
@@ -316,6 +679,51 @@ bool LoudsSparse::moveToKeyGreaterThan(const std::string& key,
     return true;
 }
 
+bool LoudsSparse::moveToKeyLessThan(const std::string& key,
+				    const bool inclusive, LoudsSparse::Iter& iter) const {
+    position_t node_num = iter.getStartNodeNum();
+    position_t pos = getFirstLabelPos(node_num);
+
+    level_t level;
+    for (level = start_level_; level < key.length(); level++) {
+	position_t node_size = nodeSize(pos);
+	position_t node_start_pos = pos;
+	// if no exact match
+	if (!searchLabel((label_t)key[level], pos, node_size)) {
+	    moveToRightInPrevSubtrie(node_start_pos, node_size, key[level], iter);
+	    return false;
+	}
+
+	iter.append(key[level], pos);
+
+	// if trie branch terminates
+	if (!hasChild(pos))
+	    return compareSuffixLessThan(pos, key, level+1, inclusive, iter);
+
+	// move to child
+	node_num = getChildNodeNum(pos);
+	pos = getFirstLabelPos(node_num);
+    }
+
+    if ((readLabel(pos) == kTerminator)
+	&& (!hasChild(pos))
+	&& !isEndofNode(pos)) {
+	iter.append(kTerminator, pos);
+	iter.is_at_terminator_ = true;
+	if (!inclusive) {
+	    iter--;
+	    return false;
+	}
+	iter.is_valid_ = true;
+	return true;
+    }
+
+    // every key in this subtrie is greater than key
+    iter.append(pos);
+    iter--;
+    return false;
+}
+
 position_t LoudsSparse::appendToPosList(std::vector<position_t>& pos_list,
 					const position_t node_num,
 					const level_t level,
@@ -360,14 +768,14 @@ void LoudsSparse::extendPosList(std::vector<position_t>& left_pos_list,
 	if (left_pos == right_pos) break;
 	if (!left_done && left_pos_list.size() <= i) {
 	    left_node_num = getChildNodeNum(left_pos);
-	    if (!child_indicator_bits_->readBit(left_pos))
+	    if (!hasChild(left_pos))
 		left_node_num++;
 	    left_pos = appendToPosList(left_pos_list, left_node_num,
 				       i, true, left_done);
 	}
 	if (!right_done && right_pos_list.size() <= i) {
 	    right_node_num = getChildNodeNum(right_pos);
-	    if (!child_indicator_bits_->readBit(right_pos))
+	    if (!hasChild(right_pos))
 		right_node_num++;
 	    right_pos = appendToPosList(right_pos_list, right_node_num,
 					i, false, right_done);
@@ -405,12 +813,12 @@ uint64_t LoudsSparse::approxCount(const LoudsSparse::Iter* iter_left,
 	    right_pos = level_cuts_[start_level_ + i] + 1;
 	//assert(left_pos <= right_pos);
 	if (left_pos < right_pos) {
-	    position_t rank_left = child_indicator_bits_->rank(left_pos);
-	    position_t rank_right = child_indicator_bits_->rank(right_pos);
+	    position_t rank_left = rankChild(left_pos);
+	    position_t rank_right = rankChild(right_pos);
 	    position_t num_leafs = (right_pos - left_pos) - (rank_right - rank_left);
-	    if (child_indicator_bits_->readBit(right_pos))
+	    if (hasChild(right_pos))
 		num_leafs++;
-	    if (child_indicator_bits_->readBit(left_pos))
+	    if (hasChild(left_pos))
 		num_leafs--;
 	    if (i == ori_left_len - 1)
 		num_leafs--;
@@ -424,56 +832,379 @@ uint64_t LoudsSparse::serializedSize() const {
     uint64_t size = sizeof(height_) + sizeof(start_level_)
 	+ sizeof(node_count_dense_) + sizeof(child_count_dense_)
 	+ (sizeof(position_t) * height_);
+    size += sizeof(uint32_t); // layout flag
     //sizeAlign(size);
-    size += (labels_->serializedSize()
-	     + child_indicator_bits_->serializedSize()
-	     + louds_bits_->serializedSize()
-	     + suffixes_->serializedSize());
+    if (isNodeInterleaved())
+	size += node_blocks_->serializedSize();
+    else
+	size += (labels_->serializedSize()
+		 + child_indicator_bits_->serializedSize()
+		 + louds_bits_->serializedSize());
+    if (chains_ != nullptr)
+	size += chains_->serializedSize();
+    if (node_bitmaps_ != nullptr)
+	size += node_bitmaps_->serializedSize();
+    if (clusters_ != nullptr)
+	size += clusters_->serializedSize();
+    if (hot_nodes_ != nullptr)
+	size += hot_nodes_->serializedSize();
+    size += suffixes_->serializedSize();
     //sizeAlign(size);
     return size;
 }
 
 uint64_t LoudsSparse::getMemoryUsage() const {
-    return (sizeof(this)
-	    + labels_->size()
-	    + child_indicator_bits_->size()
-	    + louds_bits_->size()
-	    + suffixes_->size());
+    uint64_t size = sizeof(this) + suffixes_->size();
+    if (isNodeInterleaved())
+	size += node_blocks_->size();
+    else
+	size += (labels_->size() + child_indicator_bits_->size() + louds_bits_->size());
+    if (chains_ != nullptr)
+	size += chains_->size();
+    if (node_bitmaps_ != nullptr)
+	size += node_bitmaps_->size();
+    if (clusters_ != nullptr)
+	size += clusters_->size();
+    if (hot_nodes_ != nullptr)
+	size += hot_nodes_->size();
+    return size;
 }
 
 position_t LoudsSparse::getChildNodeNum(const position_t pos) const {
-    return (child_indicator_bits_->rank(pos) + child_count_dense_);
+    return (rankChild(pos) + child_count_dense_);
 }
 
+template <typename Lookup>
 position_t LoudsSparse::getFirstLabelPos(const position_t node_num) const {
-    return louds_bits_->select(node_num + 1 - node_count_dense_);
+    if (isNodeInterleaved())
+	return node_blocks_->selectNode(node_num + 1 - node_count_dense_);
+    return Lookup::select(*louds_bits_, node_num + 1 - node_count_dense_);
 }
 
 position_t LoudsSparse::getLastLabelPos(const position_t node_num) const {
     position_t next_rank = node_num + 2 - node_count_dense_;
+    if (isNodeInterleaved()) {
+	if (next_rank > node_blocks_->numNodes())
+	    return (numLabels() - 1);
+	return (node_blocks_->selectNode(next_rank) - 1);
+    }
     if (next_rank > louds_bits_->numOnes())
-	return (louds_bits_->numBits() - 1);
+	return (numLabels() - 1);
     return (louds_bits_->select(next_rank) - 1);
 }
 
 position_t LoudsSparse::getSuffixPos(const position_t pos) const {
-    return (pos - child_indicator_bits_->rank(pos));
+    return (pos - rankChild(pos));
 }
 
 position_t LoudsSparse::nodeSize(const position_t pos) const {
-    assert(louds_bits_->readBit(pos));
+    assert(isNodeStart(pos));
+    if (isNodeInterleaved())
+	return node_blocks_->distanceToNextNode(pos);
     return louds_bits_->distanceToNextSetBit(pos);
 }
 
 bool LoudsSparse::isEndofNode(const position_t pos) const {
-    return ((pos == louds_bits_->numBits() - 1)
-	    || louds_bits_->readBit(pos + 1));
+    return ((pos == numLabels() - 1)
+	    || isNodeStart(pos + 1));
+}
+
+label_t LoudsSparse::readLabel(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->readLabel(pos);
+    return labels_->read(pos);
+}
+
+bool LoudsSparse::hasChild(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->readChildBit(pos);
+    return child_indicator_bits_->readBit(pos);
+}
+
+position_t LoudsSparse::rankChild(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->rankChild(pos);
+    return child_indicator_bits_->rank(pos);
+}
+
+bool LoudsSparse::isNodeStart(const position_t pos) const {
+    if (isNodeInterleaved())
+	return node_blocks_->readLoudsBit(pos);
+    return louds_bits_->readBit(pos);
 }
 
+position_t LoudsSparse::numLabels() const {
+    if (isNodeInterleaved())
+	return node_blocks_->numLabels();
+    return louds_bits_->numBits();
+}
+
+position_t LoudsSparse::numNodes() const {
+    if (isNodeInterleaved())
+	return node_blocks_->numNodes();
+    return louds_bits_->numOnes();
+}
+
+uint32_t LoudsSparse::getLayoutFlags() const {
+    uint32_t flags = 0;
+    if (isNodeInterleaved())
+	flags |= kLayoutInterleaved;
+    if (chains_ != nullptr)
+	flags |= kLayoutChains;
+    if (node_bitmaps_ != nullptr)
+	flags |= kLayoutNodeBitmaps;
+    if (clusters_ != nullptr)
+	flags |= kLayoutClusters;
+    if (hot_nodes_ != nullptr)
+	flags |= kLayoutHotNodes;
+    return flags;
+}
+
+void LoudsSparse::buildChains(const level_t min_len) {
+    position_t num_nodes = numNodes();
+    std::vector<word_t> head_bits(num_nodes / kWordSize + 1, 0);
+    std::vector<bool> is_in_chain(num_nodes, false);
+    std::vector<position_t> end_node_nums;
+    std::vector<std::string> runs;
+    // nodes are numbered level by level, so a chain is met at its head first
+    for (position_t i = 0; i < num_nodes; i++) {
+	if (is_in_chain[i])
+	    continue;
+	position_t node_num = i + node_count_dense_;
+	std::string run;
+	while (node_num - node_count_dense_ < num_nodes) {
+	    position_t pos = getFirstLabelPos(node_num);
+	    if ((nodeSize(pos) != 1) || !hasChild(pos))
+		break;
+	    is_in_chain[node_num - node_count_dense_] = true;
+	    run.push_back((char)readLabel(pos));
+	    node_num = getChildNodeNum(pos);
+	}
+	if (run.length() >= min_len) {
+	    head_bits[i / kWordSize] |= (kMsbMask >> (i % kWordSize));
+	    end_node_nums.push_back(node_num);
+	    runs.push_back(run);
+	}
+    }
+    chains_ = new SingleChildChains(node_count_dense_, num_nodes, head_bits,
+				    end_node_nums, runs);
+}
+
+void LoudsSparse::buildNodeBitmaps(const position_t min_fanout) {
+    position_t num_labels = numLabels();
+    std::vector<word_t> node_start_bits(num_labels / kWordSize + 1, 0);
+    std::vector<word_t> bitmaps;
+    position_t num_nodes = numNodes();
+    for (position_t i = 0; i < num_nodes; i++) {
+	position_t pos = getFirstLabelPos(i + node_count_dense_);
+	position_t node_size = nodeSize(pos);
+	// a one-label node cannot tell a terminator from label 255
+	if ((node_size < min_fanout) || (node_size < 2))
+	    continue;
+	node_start_bits[pos / kWordSize] |= (kMsbMask >> (pos % kWordSize));
+	std::vector<word_t> bitmap(SparseNodeBitmaps::kBitmapWords, 0);
+	position_t first = ((readLabel(pos) == kTerminator) ? 1 : 0);
+	for (position_t j = first; j < node_size; j++)
+	    SparseNodeBitmaps::setBit(bitmap, readLabel(pos + j));
+	bitmaps.insert(bitmaps.end(), bitmap.begin(), bitmap.end());
+    }
+    node_bitmaps_ = new SparseNodeBitmaps(min_fanout, num_labels, node_start_bits, bitmaps);
+}
+
+// Clusters are filled breadth-first from their root; a node that does
+// not fit roots a later cluster. The clusters below a cluster follow it
+// depth-first, so the walk into a subtree stays close in memory.
+void LoudsSparse::buildClusters(const position_t cluster_bytes, const position_t num_roots) {
+    position_t num_nodes = numNodes();
+    std::vector<position_t> offsets(num_nodes, 0);
+    std::vector<position_t> node_order; // sparse node ids by record offset
+    position_t records_size = 0;
+    std::vector<position_t> cluster_roots; // stack
+    for (position_t i = num_roots; i > 0; i--)
+	cluster_roots.push_back(i - 1);
+    while (!cluster_roots.empty()) {
+	std::vector<position_t> queue(1, cluster_roots.back());
+	cluster_roots.pop_back();
+	std::vector<position_t> next_roots;
+	position_t cluster_size = 0;
+	for (position_t head = 0; head < queue.size(); head++) {
+	    position_t node_id = queue[head];
+	    position_t pos = getFirstLabelPos(node_id + node_count_dense_);
+	    position_t node_size = nodeSize(pos);
+	    std::vector<position_t> child_ids;
+	    for (position_t j = 0; j < node_size; j++) {
+		if (hasChild(pos + j))
+		    child_ids.push_back(getChildNodeNum(pos + j) - node_count_dense_);
+	    }
+	    position_t record_size
+		= SparseSubtreeClusters::recordSize(node_size, child_ids.size());
+	    if ((cluster_size > 0) && (cluster_size + record_size > cluster_bytes)) {
+		next_roots.push_back(node_id);
+		continue;
+	    }
+	    offsets[node_id] = records_size;
+	    node_order.push_back(node_id);
+	    records_size += record_size;
+	    cluster_size += record_size;
+	    queue.insert(queue.end(), child_ids.begin(), child_ids.end());
+	}
+	for (position_t i = next_roots.size(); i > 0; i--)
+	    cluster_roots.push_back(next_roots[i - 1]);
+    }
+
+    std::string records;
+    records.reserve(records_size);
+    for (position_t i = 0; i < node_order.size(); i++) {
+	position_t pos = getFirstLabelPos(node_order[i] + node_count_dense_);
+	position_t node_size = nodeSize(pos);
+	std::string labels;
+	std::vector<bool> has_child;
+	std::vector<position_t> child_offsets;
+	position_t suffix_pos = 0;
+	bool has_leaf = false;
+	for (position_t j = 0; j < node_size; j++) {
+	    labels.push_back((char)readLabel(pos + j));
+	    has_child.push_back(hasChild(pos + j));
+	    if (has_child[j]) {
+		child_offsets.push_back(offsets[getChildNodeNum(pos + j) - node_count_dense_]);
+	    } else if (!has_leaf) {
+		// the leaves of a node have consecutive suffixes
+		suffix_pos = getSuffixPos(pos + j);
+		has_leaf = true;
+	    }
+	}
+	SparseSubtreeClusters::appendRecord(records, labels, has_child, suffix_pos,
+					    child_offsets);
+    }
+    assert(records.length() == records_size);
+    std::vector<position_t> root_offsets(offsets.begin(), offsets.begin() + num_roots);
+    clusters_ = new SparseSubtreeClusters(cluster_bytes, root_offsets, records);
+}
+
+void LoudsSparse::promoteHotNodes(const std::vector<std::string>& keys,
+				  const std::vector<position_t>& in_node_nums,
+				  const uint64_t max_bytes) {
+    assert(keys.size() == in_node_nums.size());
+    destroyHotNodes();
+    position_t num_nodes = numNodes();
+    std::vector<position_t> visits(num_nodes, 0);
+    for (position_t i = 0; i < keys.size(); i++)
+	countNodeVisits(keys[i], in_node_nums[i], visits);
+
+    // A node is visited at least as often as its children and comes
+    // before them, so the hottest nodes are the tops of subtrees.
+    std::vector<position_t> node_ids;
+    for (position_t i = 0; i < num_nodes; i++) {
+	if (visits[i] > 0)
+	    node_ids.push_back(i);
+    }
+    std::stable_sort(node_ids.begin(), node_ids.end(),
+		     [&visits](const position_t a, const position_t b) {
+			 return visits[a] > visits[b];
+		     });
+    uint64_t num_bytes = SparseHotNodes::baseSize(num_nodes);
+    position_t num_hot_nodes = 0;
+    while ((num_hot_nodes < node_ids.size())
+	   && (num_bytes + SparseHotNodes::kNodeSize <= max_bytes)) {
+	num_bytes += SparseHotNodes::kNodeSize;
+	num_hot_nodes++;
+    }
+    if (num_hot_nodes == 0)
+	return;
+    node_ids.resize(num_hot_nodes);
+    std::sort(node_ids.begin(), node_ids.end());
+
+    std::vector<word_t> hot_bits(num_nodes / kWordSize + 1, 0);
+    std::vector<word_t> bitmaps(num_hot_nodes * SparseHotNodes::kRecordWords, 0);
+    std::vector<position_t> child_bases;
+    std::vector<position_t> leaf_bases;
+    for (position_t i = 0; i < num_hot_nodes; i++) {
+	hot_bits[node_ids[i] / kWordSize] |= (kMsbMask >> (node_ids[i] % kWordSize));
+	position_t pos = getFirstLabelPos(node_ids[i] + node_count_dense_);
+	position_t node_size = nodeSize(pos);
+	position_t first = 0;
+	// skip terminator label
+	if ((node_size > 1) && (readLabel(pos) == kTerminator))
+	    first = 1;
+	word_t* labels = &bitmaps[i * SparseHotNodes::kRecordWords];
+	for (position_t j = first; j < node_size; j++) {
+	    SparseHotNodes::setBit(labels, readLabel(pos + j));
+	    if (hasChild(pos + j))
+		SparseHotNodes::setBit(labels + SparseHotNodes::kBitmapWords, readLabel(pos + j));
+	}
+	position_t num_children_before = rankChild(pos) - (hasChild(pos) ? 1 : 0);
+	child_bases.push_back(num_children_before + 1 + child_count_dense_);
+	leaf_bases.push_back(pos + first - num_children_before);
+    }
+    hot_nodes_ = new SparseHotNodes(num_nodes, hot_bits, bitmaps, child_bases, leaf_bases);
+}
+
+void LoudsSparse::countNodeVisits(const std::string& key, const position_t in_node_num,
+				  std::vector<position_t>& visits) const {
+    position_t node_num = in_node_num;
+    level_t level = start_level_;
+    level += skipChain(key, level, node_num);
+    for (; level < key.length(); level++) {
+	visits[node_num - node_count_dense_]++;
+	position_t pos = getFirstLabelPos(node_num);
+	if (!searchLabel((label_t)key[level], pos, nodeSize(pos)) || !hasChild(pos))
+	    return;
+	node_num = getChildNodeNum(pos);
+	level += skipChain(key, level + 1, node_num);
+    }
+}
+
+bool LoudsSparse::isHotNode(const position_t node_num) const {
+    return ((hot_nodes_ != nullptr) && hot_nodes_->isHot(node_num - node_count_dense_));
+}
+
+void LoudsSparse::destroyHotNodes() {
+    if (hot_nodes_ != nullptr) {
+	hot_nodes_->destroy();
+	delete hot_nodes_;
+	hot_nodes_ = nullptr;
+    }
+}
+
+level_t LoudsSparse::skipChain(const std::string& key, const level_t level,
+			       position_t& node_num) const {
+    if (chains_ == nullptr)
+	return 0;
+    return chains_->skip(key, level, node_num);
+}
+
+bool LoudsSparse::searchLabel(const label_t target, position_t& pos,
+			      const position_t search_len) const {
+    if ((node_bitmaps_ != nullptr) && node_bitmaps_->hasBitmap(pos, search_len))
+	return node_bitmaps_->search(target, pos, readLabel(pos) == kTerminator);
+    if (isNodeInterleaved())
+	return node_blocks_->search(target, pos, search_len);
+    return labels_->search(target, pos, search_len);
+}
+
+bool LoudsSparse::searchLabelGreaterThan(const label_t target, position_t& pos,
+					 const position_t search_len) const {
+    if ((node_bitmaps_ != nullptr) && node_bitmaps_->hasBitmap(pos, search_len))
+	return node_bitmaps_->searchGreaterThan(target, pos, readLabel(pos) == kTerminator);
+    if (isNodeInterleaved())
+	return node_blocks_->searchGreaterThan(target, pos, search_len);
+    return labels_->searchGreaterThan(target, pos, search_len);
+}
+
+bool LoudsSparse::searchLabelLessThan(const label_t target, position_t& pos,
+				      const position_t search_len) const {
+    if ((node_bitmaps_ != nullptr) && node_bitmaps_->hasBitmap(pos, search_len))
+	return node_bitmaps_->searchLessThan(target, pos, readLabel(pos) == kTerminator);
+    if (isNodeInterleaved())
+	return node_blocks_->searchLessThan(target, pos, search_len);
+    return labels_->searchLessThan(target, pos, search_len);
+}
+
+// pos is the first label position of the node
 void LoudsSparse::moveToLeftInNextSubtrie(position_t pos, const position_t node_size, 
 					  const label_t label, LoudsSparse::Iter& iter) const {
     // if no label is greater than key[level] in this node
-    if (!labels_->searchGreaterThan(label, pos, node_size)) {
+    if (!searchLabelGreaterThan(label, pos, node_size)) {
 	iter.append(pos + node_size - 1);
 	return iter++;
     } else {
@@ -482,12 +1213,30 @@ void LoudsSparse::moveToLeftInNextSubtrie(position_t pos, const position_t node_
     }
 }
 
+// pos is the first label position of the node
+void LoudsSparse::moveToRightInPrevSubtrie(const position_t pos, const position_t node_size,
+					   const label_t label, LoudsSparse::Iter& iter) const {
+    position_t search_pos = pos;
+    // if some label is smaller than key[level] in this node
+    if (searchLabelLessThan(label, search_pos, node_size)) {
+	iter.append(search_pos);
+	return iter.moveToRightMostKey();
+    }
+    iter.append(pos);
+    // the terminator (prefix key) sorts before every label in the node
+    if ((readLabel(pos) == kTerminator) && !isEndofNode(pos))
+	return iter.moveToRightMostKey();
+    return iter--;
+}
+
 bool LoudsSparse::compareSuffixGreaterThan(const position_t pos, const std::string& key, 
 					   const level_t level, const bool inclusive, 
 					   LoudsSparse::Iter& iter) const {
     position_t suffix_pos = getSuffixPos(pos);
     int compare = suffixes_->compare(suffix_pos, key, level);
-    if ((compare != kCouldBePositive) && (compare < 0)) {
+    // in exact mode, kCouldBePositive means the stored key equals key
+    if (((compare != kCouldBePositive) && (compare < 0))
+	|| ((compare == kCouldBePositive) && isExact() && !inclusive)) {
 	iter++;
 	return false;
     }
@@ -495,6 +1244,20 @@ bool LoudsSparse::compareSuffixGreaterThan(const position_t pos, const std::stri
     return true;
 }
 
+bool LoudsSparse::compareSuffixLessThan(const position_t pos, const std::string& key,
+					const level_t level, const bool inclusive,
+					LoudsSparse::Iter& iter) const {
+    position_t suffix_pos = getSuffixPos(pos);
+    int compare = suffixes_->compare(suffix_pos, key, level);
+    if (((compare != kCouldBePositive) && (compare > 0))
+	|| ((compare == kCouldBePositive) && isExact() && !inclusive)) {
+	iter--;
+	return false;
+    }
+    iter.is_valid_ = true;
+    return (compare == kCouldBePositive);
+}
+
 //============================================================================
 
 void LoudsSparse::Iter::clear() {
@@ -559,7 +1322,7 @@ std::string LoudsSparse::Iter::getKeyWithSuffix(unsigned* bitlen) const {
 
 void LoudsSparse::Iter::append(const position_t pos) {
     assert(key_len_ < key_.size());
-    key_[key_len_] = trie_->labels_->read(pos);
+    key_[key_len_] = trie_->readLabel(pos);
     pos_in_trie_[key_len_] = pos;
     key_len_++;
 }
@@ -573,34 +1336,34 @@ void LoudsSparse::Iter::append(const label_t label, const position_t pos) {
 
 void LoudsSparse::Iter::set(const level_t level, const position_t pos) {
     assert(level < key_.size());
-    key_[level] = trie_->labels_->read(pos);
+    key_[level] = trie_->readLabel(pos);
     pos_in_trie_[level] = pos;
 }
 
 void LoudsSparse::Iter::setToFirstLabelInRoot() {
     assert(start_level_ == 0);
     pos_in_trie_[0] = 0;
-    key_[0] = trie_->labels_->read(0);
+    key_[0] = trie_->readLabel(0);
 }
 
 void LoudsSparse::Iter::setToLastLabelInRoot() {
     assert(start_level_ == 0);
     pos_in_trie_[0] = trie_->getLastLabelPos(0);
-    key_[0] = trie_->labels_->read(pos_in_trie_[0]);
+    key_[0] = trie_->readLabel(pos_in_trie_[0]);
 }
 
 void LoudsSparse::Iter::moveToLeftMostKey() {
     if (key_len_ == 0) {
 	position_t pos = trie_->getFirstLabelPos(start_node_num_);
-	label_t label = trie_->labels_->read(pos);
+	label_t label = trie_->readLabel(pos);
 	append(label, pos);
     }
 
     level_t level = key_len_ - 1;
     position_t pos = pos_in_trie_[level];
-    label_t label = trie_->labels_->read(pos);
+    label_t label = trie_->readLabel(pos);
 
-    if (!trie_->child_indicator_bits_->readBit(pos)) {
+    if (!trie_->hasChild(pos)) {
 	if ((label == kTerminator)
 	    && !trie_->isEndofNode(pos))
 	    is_at_terminator_ = true;
@@ -611,9 +1374,9 @@ void LoudsSparse::Iter::moveToLeftMostKey() {
     while (level < trie_->getHeight()) {
 	position_t node_num = trie_->getChildNodeNum(pos);
 	pos = trie_->getFirstLabelPos(node_num);
-	label = trie_->labels_->read(pos);
+	label = trie_->readLabel(pos);
 	// if trie branch terminates
-	if (!trie_->child_indicator_bits_->readBit(pos)) {
+	if (!trie_->hasChild(pos)) {
 	    append(label, pos);
 	    if ((label == kTerminator)
 		&& !trie_->isEndofNode(pos))
@@ -631,15 +1394,15 @@ void LoudsSparse::Iter::moveToRightMostKey() {
     if (key_len_ == 0) {
 	position_t pos = trie_->getFirstLabelPos(start_node_num_);
 	pos = trie_->getLastLabelPos(start_node_num_);
-	label_t label = trie_->labels_->read(pos);
+	label_t label = trie_->readLabel(pos);
 	append(label, pos);
     }
 
     level_t level = key_len_ - 1;
     position_t pos = pos_in_trie_[level];
-    label_t label = trie_->labels_->read(pos);
+    label_t label = trie_->readLabel(pos);
 
-    if (!trie_->child_indicator_bits_->readBit(pos)) {
+    if (!trie_->hasChild(pos)) {
 	if ((label == kTerminator)
 	    && !trie_->isEndofNode(pos))
 	    is_at_terminator_ = true;
@@ -650,9 +1413,9 @@ void LoudsSparse::Iter::moveToRightMostKey() {
     while (level < trie_->getHeight()) {
 	position_t node_num = trie_->getChildNodeNum(pos);
 	pos = trie_->getLastLabelPos(node_num);
-	label = trie_->labels_->read(pos);
+	label = trie_->readLabel(pos);
 	// if trie branch terminates
-	if (!trie_->child_indicator_bits_->readBit(pos)) {
+	if (!trie_->hasChild(pos)) {
 	    append(label, pos);
 	    if ((label == kTerminator)
 		&& !trie_->isEndofNode(pos))
@@ -671,7 +1434,7 @@ void LoudsSparse::Iter::operator ++(int) {
     is_at_terminator_ = false;
     position_t pos = pos_in_trie_[key_len_ - 1];
     pos++;
-    while (pos >= trie_->louds_bits_->numBits() || trie_->louds_bits_->readBit(pos)) {
+    while (pos >= trie_->numLabels() || trie_->isNodeStart(pos)) {
 	key_len_--;
 	if (key_len_ == 0) {
 	    is_valid_ = false;
@@ -692,7 +1455,7 @@ void LoudsSparse::Iter::operator --(int) {
 	is_valid_ = false;
 	return;
     }
-    while (trie_->louds_bits_->readBit(pos)) {
+    while (trie_->isNodeStart(pos)) {
 	key_len_--;
 	if (key_len_ == 0) {
 	    is_valid_ = false;
@@ -68,7 +68,37 @@ inline int suxpopcount(uint64_t x) {
 #define popcountsize 64ULL
 #define popcountmask (popcountsize - 1)
 
-inline uint64_t popcountLinear(uint64_t *bits, uint64_t x, uint64_t nbits) {
+// CPU features that the build does not assume (e.g., no -mbmi2), read
+// once at startup with CPUID; the kernels below then take the fastest
+// variant the CPU runs, so that one binary serves every generation.
+// Before static initialization completes, the features read as
+// missing and the portable variants are used.
+struct CpuFeatures {
+    CpuFeatures() {
+        __builtin_cpu_init();
+        has_bmi2 = __builtin_cpu_supports("bmi2");
+        has_avx512_popcount = __builtin_cpu_supports("avx512f")
+            && __builtin_cpu_supports("avx512vpopcntdq");
+    }
+
+    bool has_bmi2;
+    bool has_avx512_popcount; // VPOPCNTDQ
+};
+
+// A template, so that the header defines the single instance
+template <typename T = void>
+struct CpuDispatch {
+    static const CpuFeatures kFeatures;
+};
+
+template <typename T>
+const CpuFeatures CpuDispatch<T>::kFeatures;
+
+inline const CpuFeatures& cpuFeatures() {
+    return CpuDispatch<>::kFeatures;
+}
+
+inline uint64_t popcountLinear_scalar(uint64_t *bits, uint64_t x, uint64_t nbits) {
     if (nbits == 0) { return 0; }
     uint64_t lastword = (nbits - 1) / popcountsize;
     uint64_t p = 0;
@@ -87,6 +117,40 @@ inline uint64_t popcountLinear(uint64_t *bits, uint64_t x, uint64_t nbits) {
     return p;
 }
 
+// Same as popcountLinear_scalar, 8 words per AVX-512 VPOPCNTDQ
+__attribute__((target("popcnt,avx512f,avx512vpopcntdq")))
+inline uint64_t popcountLinear_avx512(uint64_t *bits, uint64_t x, uint64_t nbits) {
+    if (nbits == 0) { return 0; }
+    uint64_t lastword = (nbits - 1) / popcountsize;
+    __builtin_prefetch(bits + x + 7, 0);
+    __m512i counts = _mm512_setzero_si512();
+    uint64_t i = 0;
+    for (; i + 8 <= lastword; i += 8)
+        counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(_mm512_loadu_si512(bits + x + i)));
+    if (i < lastword) {
+        __mmask8 mask = (__mmask8)((1U << (lastword - i)) - 1);
+        counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(mask, bits + x + i)));
+    }
+    uint64_t lanes[8];
+    _mm512_storeu_si512(lanes, counts);
+    uint64_t p = 0;
+    for (int j = 0; j < 8; j++)
+        p += lanes[j];
+    uint64_t lastshifted = bits[x+lastword] >> (63 - ((nbits - 1) & popcountmask));
+    p += _mm_popcnt_u64(lastshifted);
+    return p;
+}
+
+inline uint64_t popcountLinear(uint64_t *bits, uint64_t x, uint64_t nbits) {
+#ifdef __AVX512VPOPCNTDQ__
+    return popcountLinear_avx512(bits, x, nbits);
+#else
+    if (cpuFeatures().has_avx512_popcount)
+        return popcountLinear_avx512(bits, x, nbits);
+    return popcountLinear_scalar(bits, x, nbits);
+#endif
+}
+
 // Return the index of the kth bit set in x 
 inline int select64_naive(uint64_t x, int k) {
     int count = -1;
@@ -145,8 +209,22 @@ inline int select64_broadword(uint64_t x, int k) {
     return place + ( LEQ_STEP_8( bit_sums, byte_rank_step_8 ) * ONES_STEP_8 >> 56 );   
 }
 
+// Same as select64_popcount_search (bits counted from the most
+// significant end) with one pdep: deposit a single 1 onto the
+// (popcount(x) - k)-th set bit counted from the least significant end.
+__attribute__((target("popcnt,bmi2")))
+inline int select64_pdep(uint64_t x, int k) {
+    return __builtin_clzll(_pdep_u64(1ULL << (_mm_popcnt_u64(x) - k), x));
+}
+
 inline int select64(uint64_t x, int k) {
+#ifdef __BMI2__
+    return select64_pdep(x, k);
+#else
+    if (cpuFeatures().has_bmi2)
+        return select64_pdep(x, k);
     return select64_popcount_search(x, k);
+#endif
 }
 
 // x is the starting offset of the 512 bits;
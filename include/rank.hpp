@@ -35,12 +35,20 @@ public:
     // pos is zero-based; count is one-based.
     // E.g., for bitvector: 100101000, rank(3) = 2
     position_t rank(position_t pos) const {
-        assert(pos <= num_bits_);
-        position_t word_per_basic_block = basic_block_size_ / kWordSize;
-        position_t block_id = pos / basic_block_size_;
-        position_t offset = pos & (basic_block_size_ - 1);
-        return (rank_lut_[block_id] 
-		+ popcountLinear(bits_, block_id * word_per_basic_block, offset + 1));
+	return rankInBlocks(pos, basic_block_size_);
+    }
+
+    // As above, with the basic block size fixed at compile time, so that
+    // the divisions fold to shifts (see StaticLookup); it must match the
+    // one the bitvector was built with.
+    template <position_t kBasicBlockSize>
+    position_t rank(position_t pos) const {
+	assert(basic_block_size_ == kBasicBlockSize);
+	return rankInBlocks(pos, kBasicBlockSize);
+    }
+
+    position_t getBasicBlockSize() const {
+	return basic_block_size_;
     }
 
     position_t rankLutSize() const {
@@ -64,10 +72,8 @@ public:
     }
 
     void serialize(char*& dst) const {
-        *reinterpret_cast<uint32_t*>(dst) = htobe32(num_bits_);
-	dst += sizeof(num_bits_);
-    *reinterpret_cast<uint32_t*>(dst) = htobe32(basic_block_size_);
-	dst += sizeof(basic_block_size_);
+        writePosition(dst, num_bits_);
+    writePosition(dst, basic_block_size_);
     auto num_words = numWords();
     for(int i=0;i<num_words;i++) {
         *reinterpret_cast<uint64_t*>(dst) = htobe64(bits_[i]);
@@ -75,17 +81,14 @@ public:
     }
     position_t num_blocks = num_bits_ / basic_block_size_ + 1;
     for(int i=0;i<num_blocks;i++) {
-        *reinterpret_cast<uint32_t*>(dst) = htobe32(rank_lut_[i]);
-        dst += sizeof(uint32_t);
+        writePosition(dst, rank_lut_[i]);
     }
 	//align(dst);
     }
 
     int deSerialize(const char*& src) {
-        num_bits_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
-	src += sizeof(num_bits_);
-    basic_block_size_=be32toh(*reinterpret_cast<const uint32_t*>(src));
-	src += sizeof(basic_block_size_);
+        num_bits_ = readPosition(src);
+    basic_block_size_ = readPosition(src);
     auto num_words = numWords();
 	bits_ = new word_t[num_words];
     for(int i=0;i<num_words;i++) {
@@ -95,19 +98,43 @@ public:
 	position_t num_blocks = num_bits_ / basic_block_size_ + 1;
 	rank_lut_ = new position_t[num_blocks];
     for(int i=0;i<num_blocks;i++) {
-        rank_lut_[i] = be32toh(*reinterpret_cast<const uint32_t*>(src));
-        src += sizeof(uint32_t);
+        rank_lut_[i] = readPosition(src);
     }
 	//align(src);
 	return 0;
     }
 
+    // Reads the version 0 layout (32-bit fields), see kSerializeVersion
+    int deSerializeV0(const char*& src) {
+	num_bits_ = readUint32(src);
+	basic_block_size_ = readUint32(src);
+	bits_ = new word_t[numWords()];
+	for (position_t i = 0; i < numWords(); i++) {
+	    bits_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+	    src += sizeof(uint64_t);
+	}
+	position_t num_blocks = num_bits_ / basic_block_size_ + 1;
+	rank_lut_ = new position_t[num_blocks];
+	for (position_t i = 0; i < num_blocks; i++)
+	    rank_lut_[i] = readUint32(src);
+	return 0;
+    }
+
     void destroy() {
 	delete[] bits_;
 	delete[] rank_lut_;
     }
 
 private:
+    position_t rankInBlocks(const position_t pos, const position_t basic_block_size) const {
+        assert(pos <= num_bits_);
+        position_t word_per_basic_block = basic_block_size / kWordSize;
+        position_t block_id = pos / basic_block_size;
+        position_t offset = pos & (basic_block_size - 1);
+        return (rank_lut_[block_id] 
+		+ popcountLinear(bits_, block_id * word_per_basic_block, offset + 1));
+    }
+
     void initRankLut() {
         position_t word_per_basic_block = basic_block_size_ / kWordSize;
         position_t num_blocks = num_bits_ / basic_block_size_ + 1;
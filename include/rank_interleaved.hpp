@@ -0,0 +1,205 @@
+#ifndef RANKINTERLEAVED_H_
+#define RANKINTERLEAVED_H_
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "config.hpp"
+
+namespace surf {
+
+// Rank-supporting bitvector whose rank directory is interleaved with
+// the bits, so that readBit and rank touch a single cache line.
+// Each 64-byte block holds one header word and 7 data words (448 bits).
+// The header keeps the number of 1's before the block in its high 37
+// bits and, in its low 27 bits, the number of 1's in the first 2, 4 and
+// 6 data words (9 bits each), as in rank9.
+// The same interface as BitvectorRank, minus the bit-scanning functions.
+class BitvectorRankInterleaved {
+public:
+    BitvectorRankInterleaved() : num_bits_(0), num_blocks_(0), blocks_(nullptr) {};
+    BitvectorRankInterleaved(const BitvectorRankInterleaved& other)
+	: num_bits_(other.num_bits_), num_blocks_(other.num_blocks_) {
+	allocate();
+	memcpy(blocks_, other.blocks_, blocksSize());
+    }
+    BitvectorRankInterleaved(const std::vector<std::vector<word_t> >& bitvector_per_level,
+			     const std::vector<position_t>& num_bits_per_level,
+			     const level_t start_level = 0,
+			     level_t end_level = 0/* non-inclusive */) {
+	if (end_level == 0)
+	    end_level = bitvector_per_level.size();
+	num_bits_ = 0;
+	for (level_t level = start_level; level < end_level; level++)
+	    num_bits_ += num_bits_per_level[level];
+	num_blocks_ = num_bits_ / kBitsPerBlock + 1;
+	allocate();
+	memset(blocks_, 0, blocksSize());
+
+	position_t bit_shift = 0;
+	for (level_t level = start_level; level < end_level; level++) {
+	    const std::vector<word_t>& bits = bitvector_per_level[level];
+	    for (position_t word_id = 0; word_id < bits.size(); word_id++) {
+		word_t word = bits[word_id];
+		while (word != 0) {
+		    position_t offset = __builtin_clzll(word);
+		    position_t pos = word_id * kWordSize + offset;
+		    if (pos >= num_bits_per_level[level])
+			break;
+		    setBit(bit_shift + pos);
+		    word &= ~(kMsbMask >> offset);
+		}
+	    }
+	    bit_shift += num_bits_per_level[level];
+	}
+	initHeaders();
+    }
+
+    ~BitvectorRankInterleaved() {}
+
+    position_t numBits() const {
+	return num_bits_;
+    }
+
+    bool readBit(const position_t pos) const {
+	assert(pos <= num_bits_);
+	position_t offset = pos % kBitsPerBlock;
+	const word_t* block = blocks_ + (pos / kBitsPerBlock) * kWordsPerBlock;
+	return block[1 + offset / kWordSize] & (kMsbMask >> (offset & (kWordSize - 1)));
+    }
+
+    // Counts the number of 1's in the bitvector up to position pos.
+    // pos is zero-based; count is one-based.
+    // E.g., for bitvector: 100101000, rank(3) = 2
+    position_t rank(const position_t pos) const {
+	assert(pos <= num_bits_);
+	position_t offset = pos % kBitsPerBlock;
+	const word_t* block = blocks_ + (pos / kBitsPerBlock) * kWordsPerBlock;
+	word_t header = block[0];
+	position_t word_id = offset / kWordSize;
+	position_t rank = (position_t)(header >> kBaseShift);
+	if (word_id >= 2)
+	    rank += (header >> (kSubCountBits * (word_id / 2 - 1))) & kSubCountMask;
+	if (word_id & 1)
+	    rank += __builtin_popcountll(block[word_id]);
+	return (rank + __builtin_popcountll(block[1 + word_id]
+					    >> (kWordSize - 1 - (offset & (kWordSize - 1)))));
+    }
+
+    // in bytes
+    position_t blocksSize() const {
+	return (num_blocks_ * kWordsPerBlock * sizeof(word_t));
+    }
+
+    position_t serializedSize() const {
+	return (sizeof(num_bits_) + blocksSize());
+    }
+
+    position_t size() const {
+	return (sizeof(BitvectorRankInterleaved) + blocksSize());
+    }
+
+    void prefetch(position_t pos) const {
+	__builtin_prefetch(blocks_ + (pos / kBitsPerBlock) * kWordsPerBlock);
+    }
+
+    void serialize(char*& dst) const {
+	writePosition(dst, num_bits_);
+	position_t num_words = num_blocks_ * kWordsPerBlock;
+	for (position_t i = 0; i < num_words; i++) {
+	    *reinterpret_cast<uint64_t*>(dst) = htobe64(blocks_[i]);
+	    dst += sizeof(uint64_t);
+	}
+    }
+
+    int deSerialize(const char*& src) {
+	num_bits_ = readPosition(src);
+	num_blocks_ = num_bits_ / kBitsPerBlock + 1;
+	allocate();
+	position_t num_words = num_blocks_ * kWordsPerBlock;
+	for (position_t i = 0; i < num_words; i++) {
+	    blocks_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+	    src += sizeof(uint64_t);
+	}
+	return 0;
+    }
+
+    // Reads a BitvectorRank in the version 0 layout (32-bit fields, see
+    // kSerializeVersion) and interleaves its rank directory
+    int deSerializeV0(const char*& src) {
+	num_bits_ = readUint32(src);
+	position_t basic_block_size = readUint32(src);
+	num_blocks_ = num_bits_ / kBitsPerBlock + 1;
+	allocate();
+	memset(blocks_, 0, blocksSize());
+	position_t num_words = num_bits_ / kWordSize + ((num_bits_ % kWordSize) ? 1 : 0);
+	for (position_t word_id = 0; word_id < num_words; word_id++) {
+	    word_t word = be64toh(*reinterpret_cast<const uint64_t*>(src));
+	    src += sizeof(uint64_t);
+	    while (word != 0) {
+		position_t offset = __builtin_clzll(word);
+		position_t pos = word_id * kWordSize + offset;
+		if (pos >= num_bits_)
+		    break;
+		setBit(pos);
+		word &= ~(kMsbMask >> offset);
+	    }
+	}
+	// the rank look-up table is rebuilt as the block headers
+	src += (num_bits_ / basic_block_size + 1) * sizeof(uint32_t);
+	initHeaders();
+	return 0;
+    }
+
+    void destroy() {
+	free(blocks_);
+	blocks_ = nullptr;
+    }
+
+private:
+    static const position_t kWordsPerBlock = 8; // one cache line
+    static const position_t kBitsPerBlock = (kWordsPerBlock - 1) * kWordSize;
+    static const position_t kSubCountBits = 9;
+    static const word_t kSubCountMask = (1 << kSubCountBits) - 1;
+    static const position_t kBaseShift = 3 * kSubCountBits;
+
+    void allocate() {
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, kWordsPerBlock * sizeof(word_t), blocksSize()) != 0)
+	    ptr = nullptr;
+	assert(ptr != nullptr);
+	blocks_ = reinterpret_cast<word_t*>(ptr);
+    }
+
+    void setBit(const position_t pos) {
+	position_t offset = pos % kBitsPerBlock;
+	word_t* block = blocks_ + (pos / kBitsPerBlock) * kWordsPerBlock;
+	block[1 + offset / kWordSize] |= (kMsbMask >> (offset & (kWordSize - 1)));
+    }
+
+    void initHeaders() {
+	position_t cumu_rank = 0;
+	for (position_t i = 0; i < num_blocks_; i++) {
+	    word_t* block = blocks_ + i * kWordsPerBlock;
+	    word_t header = (word_t)cumu_rank << kBaseShift;
+	    position_t block_rank = 0;
+	    for (position_t j = 0; j < kWordsPerBlock - 1; j++) {
+		if ((j > 0) && (j % 2 == 0))
+		    header |= (word_t)block_rank << (kSubCountBits * (j / 2 - 1));
+		block_rank += __builtin_popcountll(block[1 + j]);
+	    }
+	    block[0] = header;
+	    cumu_rank += block_rank;
+	}
+    }
+
+    position_t num_bits_;
+    position_t num_blocks_;
+    word_t* blocks_; // aligned to the cache line
+};
+
+} // namespace surf
+
+#endif // RANKINTERLEAVED_H_
@@ -14,21 +14,36 @@ namespace surf {
 
 class BitvectorSelect : public Bitvector {
 public:
-    BitvectorSelect() : sample_interval_(0), num_ones_(0), select_lut_(nullptr) {};
-    BitvectorSelect(const BitvectorSelect& other):Bitvector(other), sample_interval_(other.sample_interval_), num_ones_(other.num_ones_) {
+    BitvectorSelect() : sample_interval_(0), num_ones_(0), select_lut_(nullptr),
+			num_rank_blocks_(0), rank_lut_(nullptr) {};
+    BitvectorSelect(const BitvectorSelect& other):Bitvector(other), sample_interval_(other.sample_interval_), num_ones_(other.num_ones_),
+						  num_rank_blocks_(other.num_rank_blocks_) {
         auto select_lut_sz = selectLutSize();
         auto num_samples = select_lut_sz/sizeof(position_t);
         select_lut_ = new position_t[num_samples];
         memmove(select_lut_, other.select_lut_, num_samples*sizeof(position_t));
+	rank_lut_ = nullptr;
+	if (num_rank_blocks_ > 0) {
+	    rank_lut_ = new position_t[num_rank_blocks_ + 1];
+	    memmove(rank_lut_, other.rank_lut_, rankLutSize());
+	}
     }
+    // use_rank_lut adds a rank look-up table (one entry per 512-bit block)
+    // that select uses to skip whole blocks after the sampled position,
+    // so that the word-by-word scan never exceeds one block.
     BitvectorSelect(const position_t sample_interval, 
 		    const std::vector<std::vector<word_t> >& bitvector_per_level, 
 		    const std::vector<position_t>& num_bits_per_level,
 		    const level_t start_level = 0,
-		    const level_t end_level = 0/* non-inclusive */) 
+		    const level_t end_level = 0/* non-inclusive */,
+		    const bool use_rank_lut = false)
 	: Bitvector(bitvector_per_level, num_bits_per_level, start_level, end_level) {
 	sample_interval_ = sample_interval;
 	initSelectLut();
+	num_rank_blocks_ = 0;
+	rank_lut_ = nullptr;
+	if (use_rank_lut)
+	    initRankLut();
     }
 
     ~BitvectorSelect() {}
@@ -37,52 +52,40 @@ public:
     // posistion is zero-based; rank is one-based.
     // E.g., for bitvector: 100101000, select(3) = 5
     position_t select(position_t rank) const {
-	assert(rank > 0);
-	assert(rank <= num_ones_ + 1);
-	position_t lut_idx = rank / sample_interval_;
-	position_t rank_left = rank % sample_interval_;
-	// The first slot in select_lut_ stores the position of the first 1 bit.
-	// Slot i > 0 stores the position of (i * sample_interval_)-th 1 bit
-	if (lut_idx == 0)
-	    rank_left--;
-
-	position_t pos = select_lut_[lut_idx];
+	return selectSampled(rank, sample_interval_);
+    }
 
-	if (rank_left == 0)
-	    return pos;
+    // As above, with the sample interval fixed at compile time (see
+    // StaticLookup); it must match the one the bitvector was built with.
+    template <position_t kSampleInterval>
+    position_t select(position_t rank) const {
+	assert(sample_interval_ == kSampleInterval);
+	return selectSampled(rank, kSampleInterval);
+    }
 
-	position_t word_id = pos / kWordSize;
-	position_t offset = pos % kWordSize;
-	if (offset == kWordSize - 1) {
-	    word_id++;
-	    offset = 0;
-	} else {
-	    offset++;
-	}
-	word_t word = bits_[word_id] << offset >> offset; //zero-out most significant bits
-	position_t ones_count_in_word = popcount(word);
-	while (ones_count_in_word < rank_left) {
-	    word_id++;
-	    word = bits_[word_id];
-	    rank_left -= ones_count_in_word;
-	    ones_count_in_word = popcount(word);
-	}
-	return (word_id * kWordSize + select64_popcount_search(word, rank_left));
+    position_t getSampleInterval() const {
+	return sample_interval_;
     }
 
     position_t selectLutSize() const {
 	return ((num_ones_ / sample_interval_ + 1) * sizeof(position_t));
     }
 
+    position_t rankLutSize() const {
+	if (num_rank_blocks_ == 0)
+	    return 0;
+	return ((num_rank_blocks_ + 1) * sizeof(position_t));
+    }
+
     position_t serializedSize() const {
 	position_t size = sizeof(num_bits_) + sizeof(sample_interval_) + sizeof(num_ones_)
-	    + bitsSize() + selectLutSize();
+	    + sizeof(num_rank_blocks_) + bitsSize() + selectLutSize() + rankLutSize();
 	//sizeAlign(size);
 	return size;
     }
 
     position_t size() const {
-	return (sizeof(BitvectorSelect) + bitsSize() + selectLutSize());
+	return (sizeof(BitvectorSelect) + bitsSize() + selectLutSize() + rankLutSize());
     }
 
     position_t numOnes() const {
@@ -90,31 +93,28 @@ public:
     }
 
     void serialize(char*& dst) const {
-		*reinterpret_cast<uint32_t*>(dst) = htobe32(num_bits_);
-	dst += sizeof(num_bits_);
-	*reinterpret_cast<uint32_t*>(dst) = htobe32(sample_interval_);
-	dst += sizeof(sample_interval_);
-	*reinterpret_cast<uint32_t*>(dst) = htobe32(num_ones_);
-	dst += sizeof(num_ones_);
+		writePosition(dst, num_bits_);
+	writePosition(dst, sample_interval_);
+	writePosition(dst, num_ones_);
 	for(int i=0;i<numWords();i++) {
 		*reinterpret_cast<uint64_t*>(dst) = htobe64(bits_[i]);
 		dst += sizeof(uint64_t);
 	}
 	auto num_samples = num_ones_ / sample_interval_ + 1;
 	for(int i=0;i<num_samples;i++){
-		*reinterpret_cast<uint32_t*>(dst) = htobe32(select_lut_[i]);
-		dst += sizeof(uint32_t);
+		writePosition(dst, select_lut_[i]);
+	}
+	writePosition(dst, num_rank_blocks_);
+	for (position_t i = 0; i < rankLutSize() / sizeof(position_t); i++) {
+	    writePosition(dst, rank_lut_[i]);
 	}
 	//align(dst);
     }
 
     int deSerialize(const char*& src) {
-		num_bits_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
-	src += sizeof(num_bits_);
-	sample_interval_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
-	src += sizeof(sample_interval_);
-	num_ones_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
-	src += sizeof(num_ones_);
+		num_bits_ = readPosition(src);
+	sample_interval_ = readPosition(src);
+	num_ones_ = readPosition(src);
 	auto num_words = numWords();
 	bits_ = new word_t[num_words];
 	for(int i=0;i<num_words;i++){
@@ -124,16 +124,44 @@ public:
 	auto num_samples = num_ones_ / sample_interval_ + 1;
 	select_lut_ = new position_t[num_samples];
 	for(int i=0;i<num_samples;i++){
-		select_lut_[i] = be32toh(*reinterpret_cast<const uint32_t*>(src));
-		src += sizeof(uint32_t);
+		select_lut_[i] = readPosition(src);
+	}
+	num_rank_blocks_ = readPosition(src);
+	rank_lut_ = nullptr;
+	if (num_rank_blocks_ > 0) {
+	    rank_lut_ = new position_t[num_rank_blocks_ + 1];
+	    for (position_t i = 0; i <= num_rank_blocks_; i++) {
+		rank_lut_[i] = readPosition(src);
+	    }
 	}
 	//align(src);
 	return 0;
     }
 
+    // Reads the version 0 layout (32-bit fields, no rank look-up table),
+    // see kSerializeVersion
+    int deSerializeV0(const char*& src) {
+	num_bits_ = readUint32(src);
+	sample_interval_ = readUint32(src);
+	num_ones_ = readUint32(src);
+	bits_ = new word_t[numWords()];
+	for (position_t i = 0; i < numWords(); i++) {
+	    bits_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+	    src += sizeof(uint64_t);
+	}
+	position_t num_samples = num_ones_ / sample_interval_ + 1;
+	select_lut_ = new position_t[num_samples];
+	for (position_t i = 0; i < num_samples; i++)
+	    select_lut_[i] = readUint32(src);
+	num_rank_blocks_ = 0;
+	rank_lut_ = nullptr;
+	return 0;
+    }
+
     void destroy() {
 	delete[] bits_;
 	delete[] select_lut_;
+	delete[] rank_lut_;
     }
 
 private:
@@ -149,10 +177,20 @@ private:
 	position_t sampling_ones = sample_interval_;
 	position_t cumu_ones_upto_word = 0;
 	for (position_t i = 0; i < num_words; i++) {
+	    // skip kSkipWords at a time while they hold no sample
+	    while ((i + kSkipWords <= num_words) && (i % kSkipWords == 0)) {
+		position_t num_ones_in_words = popcountLinear(bits_, i, kSkipWords * kWordSize);
+		if (sampling_ones <= (cumu_ones_upto_word + num_ones_in_words))
+		    break;
+		cumu_ones_upto_word += num_ones_in_words;
+		i += kSkipWords;
+	    }
+	    if (i == num_words)
+		break;
 	    position_t num_ones_in_word = popcount(bits_[i]);
 	    while (sampling_ones <= (cumu_ones_upto_word + num_ones_in_word)) {
 		int diff = sampling_ones - cumu_ones_upto_word;
-		position_t result_pos = i * kWordSize + select64_popcount_search(bits_[i], diff);
+		position_t result_pos = i * kWordSize + select64(bits_[i], diff);
 		select_lut_vector.push_back(result_pos);
 		sampling_ones += sample_interval_;
 	    }
@@ -167,10 +205,86 @@ private:
     }
 
 
+    // rank_lut_[i] = number of 1's before block i; the last entry
+    // (i = num_rank_blocks_) is the total
+    void initRankLut() {
+	position_t word_per_block = kRankBlockSize / kWordSize;
+	num_rank_blocks_ = num_bits_ / kRankBlockSize + 1;
+	rank_lut_ = new position_t[num_rank_blocks_ + 1];
+	position_t cumu_rank = 0;
+	for (position_t i = 0; i < num_rank_blocks_; i++) {
+	    rank_lut_[i] = cumu_rank;
+	    if ((i + 1) * word_per_block <= numWords()) {
+		cumu_rank += popcountLinear(bits_, i * word_per_block, kRankBlockSize);
+		continue;
+	    }
+	    for (position_t j = i * word_per_block; j < numWords(); j++)
+		cumu_rank += popcount(bits_[j]);
+	}
+	rank_lut_[num_rank_blocks_] = cumu_rank;
+    }
+
 private:
+    position_t selectSampled(const position_t rank, const position_t sample_interval) const {
+	assert(rank > 0);
+	assert(rank <= num_ones_ + 1);
+	// one past the last 1, e.g., the first position of a node that
+	// does not exist
+	if (rank > num_ones_)
+	    return num_bits_;
+	position_t lut_idx = rank / sample_interval;
+	position_t rank_left = rank % sample_interval;
+	// The first slot in select_lut_ stores the position of the first 1 bit.
+	// Slot i > 0 stores the position of (i * sample_interval)-th 1 bit
+	if (lut_idx == 0)
+	    rank_left--;
+
+	position_t pos = select_lut_[lut_idx];
+
+	if (rank_left == 0)
+	    return pos;
+
+	position_t word_id = pos / kWordSize;
+	position_t offset = pos % kWordSize;
+	word_t word;
+	position_t block_id = pos / kRankBlockSize;
+	if ((rank_lut_ != nullptr) && (rank_lut_[block_id + 1] < rank)) {
+	    // the target is past the sampled block: skip to its block
+	    block_id++;
+	    while ((block_id + 1 < num_rank_blocks_) && (rank_lut_[block_id + 1] < rank))
+		block_id++;
+	    rank_left = rank - rank_lut_[block_id];
+	    word_id = block_id * (kRankBlockSize / kWordSize);
+	    word = bits_[word_id];
+	} else {
+	    if (offset == kWordSize - 1) {
+		word_id++;
+		offset = 0;
+	    } else {
+		offset++;
+	    }
+	    word = bits_[word_id] << offset >> offset; //zero-out most significant bits
+	}
+	position_t ones_count_in_word = popcount(word);
+	while (ones_count_in_word < rank_left) {
+	    word_id++;
+	    word = bits_[word_id];
+	    rank_left -= ones_count_in_word;
+	    ones_count_in_word = popcount(word);
+	}
+	return (word_id * kWordSize + select64(word, rank_left));
+    }
+
+    static const position_t kRankBlockSize = 512;
+    // words counted at a time (one AVX-512 popcount) while building the
+    // select look-up table
+    static const position_t kSkipWords = 8;
+
     position_t sample_interval_;
     position_t num_ones_;
     position_t* select_lut_; //select look-up table
+    position_t num_rank_blocks_; // 0 if there is no rank look-up table
+    position_t* rank_lut_; //rank look-up table, optional
 };
 
 } // namespace surf
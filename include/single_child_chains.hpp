@@ -0,0 +1,165 @@
+#ifndef SINGLECHILDCHAINS_H_
+#define SINGLECHILDCHAINS_H_
+
+#include <assert.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "rank_interleaved.hpp"
+
+namespace surf {
+
+// Path compression index for LOUDS-Sparse point queries.
+// A chain is a maximal run of nodes that have a single label with a
+// child (e.g., the shared "com.gmail@" of reversed-hostname emails).
+// For each chain at least min_len nodes long, the head node is marked
+// and the chain's labels are stored as one inline run, together with
+// the node reached after the chain. A lookup arriving at a head node
+// compares the run with memcmp and jumps past the chain, instead of
+// paying a select, a label search and a rank per node.
+// The chain nodes stay in the LOUDS encoding, so iterators and range
+// queries are unaffected.
+class SingleChildChains {
+public:
+    SingleChildChains() : start_node_num_(0), num_nodes_(0), num_chains_(0),
+			  heads_(nullptr), end_node_nums_(nullptr),
+			  run_offsets_(nullptr), runs_(nullptr) {};
+    SingleChildChains(const SingleChildChains& other)
+	: start_node_num_(other.start_node_num_), num_nodes_(other.num_nodes_),
+	  num_chains_(other.num_chains_),
+	  heads_(new BitvectorRankInterleaved(*other.heads_)) {
+	allocate(other.runsSize());
+	memcpy(end_node_nums_, other.end_node_nums_, num_chains_ * sizeof(position_t));
+	memcpy(run_offsets_, other.run_offsets_, (num_chains_ + 1) * sizeof(position_t));
+	memcpy(runs_, other.runs_, other.runsSize());
+    }
+    // Node numbers are global; start_node_num is the first node covered.
+    // head_bits (MSB first) marks the head nodes, relative to start_node_num,
+    // in the order of end_node_nums and runs.
+    SingleChildChains(const position_t start_node_num, const position_t num_nodes,
+		      const std::vector<word_t>& head_bits,
+		      const std::vector<position_t>& end_node_nums,
+		      const std::vector<std::string>& runs)
+	: start_node_num_(start_node_num), num_nodes_(num_nodes),
+	  num_chains_(end_node_nums.size()) {
+	std::vector<std::vector<word_t> > head_bits_per_level(1, head_bits);
+	std::vector<position_t> num_bits_per_level(1, num_nodes);
+	heads_ = new BitvectorRankInterleaved(head_bits_per_level, num_bits_per_level);
+	position_t runs_size = 0;
+	for (position_t i = 0; i < num_chains_; i++)
+	    runs_size += runs[i].length();
+	allocate(runs_size);
+	position_t offset = 0;
+	for (position_t i = 0; i < num_chains_; i++) {
+	    end_node_nums_[i] = end_node_nums[i];
+	    run_offsets_[i] = offset;
+	    memcpy(runs_ + offset, runs[i].data(), runs[i].length());
+	    offset += runs[i].length();
+	}
+	run_offsets_[num_chains_] = offset;
+    }
+
+    ~SingleChildChains() {}
+
+    position_t numChains() const {
+	return num_chains_;
+    }
+
+    // If node_num heads a chain whose labels match key from position
+    // level on, moves node_num past the chain and returns the chain
+    // length; otherwise returns 0.
+    level_t skip(const std::string& key, const level_t level, position_t& node_num) const {
+	position_t idx = node_num - start_node_num_;
+	if ((node_num < start_node_num_) || (idx >= num_nodes_) || !heads_->readBit(idx))
+	    return 0;
+	position_t chain_id = heads_->rank(idx) - 1;
+	position_t len = run_offsets_[chain_id + 1] - run_offsets_[chain_id];
+	if (level + len > key.length())
+	    return 0;
+	if (memcmp(key.data() + level, runs_ + run_offsets_[chain_id], len) != 0)
+	    return 0;
+	node_num = end_node_nums_[chain_id];
+	return len;
+    }
+
+    // in bytes
+    position_t runsSize() const {
+	return run_offsets_[num_chains_];
+    }
+
+    position_t serializedSize() const {
+	return (sizeof(start_node_num_) + sizeof(num_nodes_) + sizeof(num_chains_)
+		+ heads_->serializedSize()
+		+ (2 * num_chains_ + 1) * sizeof(position_t) + runsSize());
+    }
+
+    position_t size() const {
+	return (sizeof(SingleChildChains) + heads_->size()
+		+ (2 * num_chains_ + 1) * sizeof(position_t) + runsSize());
+    }
+
+    void serialize(char*& dst) const {
+	writePosition(dst, start_node_num_);
+	writePosition(dst, num_nodes_);
+	writePosition(dst, num_chains_);
+	heads_->serialize(dst);
+	for (position_t i = 0; i < num_chains_; i++) {
+	    writePosition(dst, end_node_nums_[i]);
+	}
+	for (position_t i = 0; i <= num_chains_; i++) {
+	    writePosition(dst, run_offsets_[i]);
+	}
+	memcpy(dst, runs_, runsSize());
+	dst += runsSize();
+    }
+
+    int deSerialize(const char*& src) {
+	start_node_num_ = readPosition(src);
+	num_nodes_ = readPosition(src);
+	num_chains_ = readPosition(src);
+	heads_ = new BitvectorRankInterleaved();
+	heads_->deSerialize(src);
+	end_node_nums_ = new position_t[num_chains_];
+	for (position_t i = 0; i < num_chains_; i++) {
+	    end_node_nums_[i] = readPosition(src);
+	}
+	run_offsets_ = new position_t[num_chains_ + 1];
+	for (position_t i = 0; i <= num_chains_; i++) {
+	    run_offsets_[i] = readPosition(src);
+	}
+	runs_ = new char[runsSize()];
+	memcpy(runs_, src, runsSize());
+	src += runsSize();
+	return 0;
+    }
+
+    void destroy() {
+	heads_->destroy();
+	delete heads_;
+	delete[] end_node_nums_;
+	delete[] run_offsets_;
+	delete[] runs_;
+    }
+
+private:
+    void allocate(const position_t runs_size) {
+	end_node_nums_ = new position_t[num_chains_];
+	run_offsets_ = new position_t[num_chains_ + 1];
+	runs_ = new char[runs_size];
+    }
+
+    position_t start_node_num_;
+    position_t num_nodes_;
+    position_t num_chains_;
+    BitvectorRankInterleaved* heads_; // 1 bit per node
+    position_t* end_node_nums_; // node reached after each chain
+    position_t* run_offsets_; // num_chains_ + 1 entries into runs_
+    char* runs_; // labels of the chains, concatenated
+};
+
+} // namespace surf
+
+#endif // SINGLECHILDCHAINS_H_
@@ -0,0 +1,190 @@
+#ifndef SPARSEHOTNODES_H_
+#define SPARSEHOTNODES_H_
+
+#include <assert.h>
+#include <string.h>
+
+#include <vector>
+
+#include "config.hpp"
+#include "rank_interleaved.hpp"
+
+namespace surf {
+
+// LOUDS-Dense encoding of the hot LOUDS-Sparse nodes, i.e., those that
+// a sample of the query workload visits most (LoudsSparse::promoteHotNodes).
+// A hot node has, as in LoudsDense, a 256-bit label bitmap and a 256-bit
+// child indicator bitmap, stored together in one 64-byte record, plus
+// the numbers of its first child and of its first leaf. A point query
+// at a hot node then finds the label and the next node with a bit test
+// and popcounts over the record, and, while it stays in hot nodes,
+// never selects on the LOUDS bits.
+// One bit per sparse node marks the hot nodes; its rank is the node's
+// record. A leading terminator label is not part of the bitmaps; a
+// query that ends at a hot node is resolved by the LOUDS encoding.
+class SparseHotNodes {
+public:
+    SparseHotNodes() : num_hot_nodes_(0), hot_bits_(nullptr), bitmaps_(nullptr),
+		       child_bases_(nullptr), leaf_bases_(nullptr) {};
+    SparseHotNodes(const SparseHotNodes& other)
+	: num_hot_nodes_(other.num_hot_nodes_),
+	  hot_bits_(new BitvectorRankInterleaved(*other.hot_bits_)) {
+	allocate();
+	memcpy(bitmaps_, other.bitmaps_, bitmapsSize());
+	memcpy(child_bases_, other.child_bases_, num_hot_nodes_ * sizeof(position_t));
+	memcpy(leaf_bases_, other.leaf_bases_, num_hot_nodes_ * sizeof(position_t));
+    }
+    // hot_bits (MSB first, num_nodes bits) marks the hot sparse nodes,
+    // whose records are concatenated in the same order in bitmaps.
+    // child_bases holds the node number of each hot node's first child,
+    // and leaf_bases the suffix position of its first non-terminator leaf.
+    SparseHotNodes(const position_t num_nodes, const std::vector<word_t>& hot_bits,
+		   const std::vector<word_t>& bitmaps,
+		   const std::vector<position_t>& child_bases,
+		   const std::vector<position_t>& leaf_bases)
+	: num_hot_nodes_(child_bases.size()) {
+	std::vector<std::vector<word_t> > hot_bits_per_level(1, hot_bits);
+	std::vector<position_t> num_bits_per_level(1, num_nodes);
+	hot_bits_ = new BitvectorRankInterleaved(hot_bits_per_level, num_bits_per_level);
+	allocate();
+	for (position_t i = 0; i < num_hot_nodes_ * kRecordWords; i++)
+	    bitmaps_[i] = bitmaps[i];
+	for (position_t i = 0; i < num_hot_nodes_; i++) {
+	    child_bases_[i] = child_bases[i];
+	    leaf_bases_[i] = leaf_bases[i];
+	}
+    }
+
+    ~SparseHotNodes() {}
+
+    position_t numHotNodes() const {
+	return num_hot_nodes_;
+    }
+
+    bool isHot(const position_t node_id) const {
+	return hot_bits_->readBit(node_id);
+    }
+
+    // Follows label target out of hot sparse node node_id. Returns false
+    // if the node has no such label. Otherwise, if the label has a
+    // child, sets is_leaf to false and next to the child's node number;
+    // if not, sets is_leaf to true and next to the leaf's suffix position.
+    bool step(const position_t node_id, const label_t target,
+	      position_t& next, bool& is_leaf) const {
+	assert(isHot(node_id));
+	position_t slot = hot_bits_->rank(node_id) - 1;
+	const word_t* labels = bitmaps_ + slot * kRecordWords;
+	const word_t* children = labels + kBitmapWords;
+	if (!readBit(labels, target))
+	    return false;
+	position_t num_children_below = countBelow(children, target);
+	is_leaf = !readBit(children, target);
+	if (is_leaf)
+	    next = leaf_bases_[slot] + countBelow(labels, target) - num_children_below;
+	else
+	    next = child_bases_[slot] + num_children_below;
+	return true;
+    }
+
+    // in bytes
+    position_t bitmapsSize() const {
+	return (num_hot_nodes_ * kRecordWords * sizeof(word_t));
+    }
+
+    position_t serializedSize() const {
+	return (sizeof(num_hot_nodes_) + hot_bits_->serializedSize() + bitmapsSize()
+		+ 2 * num_hot_nodes_ * sizeof(position_t));
+    }
+
+    position_t size() const {
+	return (sizeof(SparseHotNodes) + hot_bits_->size() + bitmapsSize()
+		+ 2 * num_hot_nodes_ * sizeof(position_t));
+    }
+
+    void serialize(char*& dst) const {
+	writePosition(dst, num_hot_nodes_);
+	hot_bits_->serialize(dst);
+	for (position_t i = 0; i < num_hot_nodes_ * kRecordWords; i++) {
+	    *reinterpret_cast<uint64_t*>(dst) = htobe64(bitmaps_[i]);
+	    dst += sizeof(uint64_t);
+	}
+	for (position_t i = 0; i < num_hot_nodes_; i++)
+	    writePosition(dst, child_bases_[i]);
+	for (position_t i = 0; i < num_hot_nodes_; i++)
+	    writePosition(dst, leaf_bases_[i]);
+    }
+
+    int deSerialize(const char*& src) {
+	num_hot_nodes_ = readPosition(src);
+	hot_bits_ = new BitvectorRankInterleaved();
+	hot_bits_->deSerialize(src);
+	allocate();
+	for (position_t i = 0; i < num_hot_nodes_ * kRecordWords; i++) {
+	    bitmaps_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+	    src += sizeof(uint64_t);
+	}
+	for (position_t i = 0; i < num_hot_nodes_; i++)
+	    child_bases_[i] = readPosition(src);
+	for (position_t i = 0; i < num_hot_nodes_; i++)
+	    leaf_bases_[i] = readPosition(src);
+	return 0;
+    }
+
+    void destroy() {
+	hot_bits_->destroy();
+	delete hot_bits_;
+	delete[] bitmaps_;
+	delete[] child_bases_;
+	delete[] leaf_bases_;
+    }
+
+    static const position_t kBitmapWords = kFanout / kWordSize;
+    // a label bitmap followed by a child indicator bitmap
+    static const position_t kRecordWords = 2 * kBitmapWords;
+    // in bytes per hot node, including its bases
+    static const position_t kNodeSize = kRecordWords * sizeof(word_t) + 2 * sizeof(position_t);
+
+    // Size in bytes with no hot node, over num_nodes sparse nodes; the
+    // hot bits are in BitvectorRankInterleaved blocks of 448 bits each.
+    static uint64_t baseSize(const position_t num_nodes) {
+	return (sizeof(SparseHotNodes) + sizeof(BitvectorRankInterleaved)
+		+ (num_nodes / (7 * kWordSize) + 1) * 8 * sizeof(word_t));
+    }
+
+    static void setBit(word_t* bitmap, const position_t pos) {
+	bitmap[pos / kWordSize] |= (kMsbMask >> (pos % kWordSize));
+    }
+
+private:
+    void allocate() {
+	bitmaps_ = new word_t[num_hot_nodes_ * kRecordWords];
+	child_bases_ = new position_t[num_hot_nodes_];
+	leaf_bases_ = new position_t[num_hot_nodes_];
+    }
+
+    static bool readBit(const word_t* bitmap, const label_t label) {
+	return bitmap[label / kWordSize] & (kMsbMask >> (label % kWordSize));
+    }
+
+    // Number of set bits in the bitmap below label
+    static position_t countBelow(const word_t* bitmap, const position_t label) {
+	position_t word_id = label / kWordSize;
+	position_t offset = label % kWordSize;
+	position_t count = 0;
+	for (position_t i = 0; i < word_id; i++)
+	    count += __builtin_popcountll(bitmap[i]);
+	if (offset > 0)
+	    count += __builtin_popcountll(bitmap[word_id] >> (kWordSize - offset));
+	return count;
+    }
+
+    position_t num_hot_nodes_;
+    BitvectorRankInterleaved* hot_bits_; // 1 bit per sparse node
+    word_t* bitmaps_; // kRecordWords words per hot node
+    position_t* child_bases_; // node number of the first child
+    position_t* leaf_bases_; // suffix position of the first non-terminator leaf
+};
+
+} // namespace surf
+
+#endif // SPARSEHOTNODES_H_
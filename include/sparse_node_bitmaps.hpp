@@ -0,0 +1,181 @@
+#ifndef SPARSENODEBITMAPS_H_
+#define SPARSENODEBITMAPS_H_
+
+#include <assert.h>
+#include <string.h>
+
+#include <vector>
+
+#include "config.hpp"
+#include "rank_interleaved.hpp"
+
+namespace surf {
+
+// Node-type directory for LOUDS-Sparse: nodes with at least min_fanout
+// labels also get a 256-bit label bitmap, as in the dense levels, so
+// that a label search on a wide node at a deep level is a bit test and
+// a popcount instead of a scan over the sorted labels.
+// One bit per label position marks the first label of each bitmap node;
+// its rank is the node's slot in bitmaps_.
+// A leading terminator label is not part of the bitmap; the caller
+// reports it, and it is skipped exactly as LabelVector does.
+class SparseNodeBitmaps {
+public:
+    SparseNodeBitmaps() : min_fanout_(0), num_nodes_(0), node_starts_(nullptr),
+			  bitmaps_(nullptr) {};
+    SparseNodeBitmaps(const SparseNodeBitmaps& other)
+	: min_fanout_(other.min_fanout_), num_nodes_(other.num_nodes_),
+	  node_starts_(new BitvectorRankInterleaved(*other.node_starts_)) {
+	bitmaps_ = new word_t[num_nodes_ * kBitmapWords];
+	memcpy(bitmaps_, other.bitmaps_, bitmapsSize());
+    }
+    // node_start_bits (MSB first, num_labels bits) marks the first label of
+    // the bitmap nodes, whose bitmaps are concatenated in the same order.
+    SparseNodeBitmaps(const position_t min_fanout, const position_t num_labels,
+		      const std::vector<word_t>& node_start_bits,
+		      const std::vector<word_t>& bitmaps)
+	: min_fanout_(min_fanout), num_nodes_(bitmaps.size() / kBitmapWords) {
+	std::vector<std::vector<word_t> > node_start_bits_per_level(1, node_start_bits);
+	std::vector<position_t> num_bits_per_level(1, num_labels);
+	node_starts_ = new BitvectorRankInterleaved(node_start_bits_per_level,
+						    num_bits_per_level);
+	bitmaps_ = new word_t[num_nodes_ * kBitmapWords];
+	for (position_t i = 0; i < num_nodes_ * kBitmapWords; i++)
+	    bitmaps_[i] = bitmaps[i];
+    }
+
+    ~SparseNodeBitmaps() {}
+
+    position_t numNodes() const {
+	return num_nodes_;
+    }
+
+    // Whether a search starting at pos over search_len labels can use a
+    // bitmap, i.e., whether pos is the first label of a bitmap node.
+    bool hasBitmap(const position_t pos, const position_t search_len) const {
+	return ((search_len >= min_fanout_) && node_starts_->readBit(pos));
+    }
+
+    // The search functions below have the same semantics as those of
+    // LabelVector; pos must be the first label of a bitmap node.
+    bool search(const label_t target, position_t& pos, const bool has_terminator) const {
+	const word_t* bitmap = getBitmap(pos);
+	if (has_terminator)
+	    pos++;
+	if (!readBit(bitmap, target))
+	    return false;
+	pos += countBelow(bitmap, target);
+	return true;
+    }
+
+    bool searchGreaterThan(const label_t target, position_t& pos,
+			   const bool has_terminator) const {
+	const word_t* bitmap = getBitmap(pos);
+	if (has_terminator)
+	    pos++;
+	if (target == kFanout - 1)
+	    return false;
+	position_t word_id = (target + 1) / kWordSize;
+	position_t offset = (target + 1) % kWordSize;
+	word_t word = bitmap[word_id] << offset >> offset;
+	while ((word == 0) && (word_id < kBitmapWords - 1))
+	    word = bitmap[++word_id];
+	if (word == 0)
+	    return false;
+	pos += countBelow(bitmap, word_id * kWordSize + __builtin_clzll(word));
+	return true;
+    }
+
+    bool searchLessThan(const label_t target, position_t& pos,
+			const bool has_terminator) const {
+	const word_t* bitmap = getBitmap(pos);
+	if (has_terminator)
+	    pos++;
+	position_t num_below = countBelow(bitmap, target);
+	if (num_below == 0)
+	    return false;
+	pos += (num_below - 1);
+	return true;
+    }
+
+    // in bytes
+    position_t bitmapsSize() const {
+	return (num_nodes_ * kBitmapWords * sizeof(word_t));
+    }
+
+    position_t serializedSize() const {
+	return (sizeof(min_fanout_) + sizeof(num_nodes_)
+		+ node_starts_->serializedSize() + bitmapsSize());
+    }
+
+    position_t size() const {
+	return (sizeof(SparseNodeBitmaps) + node_starts_->size() + bitmapsSize());
+    }
+
+    void serialize(char*& dst) const {
+	writePosition(dst, min_fanout_);
+	writePosition(dst, num_nodes_);
+	node_starts_->serialize(dst);
+	for (position_t i = 0; i < num_nodes_ * kBitmapWords; i++) {
+	    *reinterpret_cast<uint64_t*>(dst) = htobe64(bitmaps_[i]);
+	    dst += sizeof(uint64_t);
+	}
+    }
+
+    int deSerialize(const char*& src) {
+	min_fanout_ = readPosition(src);
+	num_nodes_ = readPosition(src);
+	node_starts_ = new BitvectorRankInterleaved();
+	node_starts_->deSerialize(src);
+	bitmaps_ = new word_t[num_nodes_ * kBitmapWords];
+	for (position_t i = 0; i < num_nodes_ * kBitmapWords; i++) {
+	    bitmaps_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+	    src += sizeof(uint64_t);
+	}
+	return 0;
+    }
+
+    void destroy() {
+	node_starts_->destroy();
+	delete node_starts_;
+	delete[] bitmaps_;
+    }
+
+    static const position_t kFanout = 256;
+    static const position_t kBitmapWords = kFanout / kWordSize;
+
+    static void setBit(std::vector<word_t>& bitmap, const position_t pos) {
+	bitmap[pos / kWordSize] |= (kMsbMask >> (pos % kWordSize));
+    }
+
+private:
+    const word_t* getBitmap(const position_t pos) const {
+	assert(node_starts_->readBit(pos));
+	return bitmaps_ + (node_starts_->rank(pos) - 1) * kBitmapWords;
+    }
+
+    static bool readBit(const word_t* bitmap, const label_t label) {
+	return bitmap[label / kWordSize] & (kMsbMask >> (label % kWordSize));
+    }
+
+    // Number of labels in the bitmap that are smaller than label
+    static position_t countBelow(const word_t* bitmap, const position_t label) {
+	position_t word_id = label / kWordSize;
+	position_t offset = label % kWordSize;
+	position_t count = 0;
+	for (position_t i = 0; i < word_id; i++)
+	    count += __builtin_popcountll(bitmap[i]);
+	if (offset > 0)
+	    count += __builtin_popcountll(bitmap[word_id] >> (kWordSize - offset));
+	return count;
+    }
+
+    position_t min_fanout_;
+    position_t num_nodes_;
+    BitvectorRankInterleaved* node_starts_; // 1 bit per label position
+    word_t* bitmaps_; // kBitmapWords words per bitmap node
+};
+
+} // namespace surf
+
+#endif // SPARSENODEBITMAPS_H_
@@ -0,0 +1,372 @@
+#ifndef SPARSENODEBLOCKS_H_
+#define SPARSENODEBLOCKS_H_
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "config.hpp"
+#include "popcount.h"
+#include "surf_builder.hpp"
+
+namespace surf {
+
+// Node-interleaved LOUDS-Sparse encoding: the labels, child indicator
+// bits and LOUDS bits of 48 consecutive positions share one 64-byte,
+// cache-aligned block, together with the child indicator rank:
+//   bytes  0-3 : number of child indicator 1's before the block
+//   bytes  4-9 : child indicator bits (bit i for position i)
+//   bytes 10-15: LOUDS bits
+//   bytes 16-63: labels
+// A compact directory (LOUDS 1's before each block, plus a block id for
+// every kSelectSampleInterval-th 1) resolves select. Reading a node
+// (select, label search, child bit and rank) therefore touches the
+// directory and, unless the node crosses a block boundary, one block.
+class SparseNodeBlocks {
+public:
+    SparseNodeBlocks() : num_labels_(0), num_blocks_(0), num_nodes_(0),
+			 blocks_(nullptr), louds_ranks_(nullptr), select_lut_(nullptr) {};
+    SparseNodeBlocks(const SparseNodeBlocks& other)
+	: num_labels_(other.num_labels_), num_blocks_(other.num_blocks_),
+	  num_nodes_(other.num_nodes_) {
+	allocate();
+	memcpy(blocks_, other.blocks_, blocksSize());
+	memcpy(louds_ranks_, other.louds_ranks_, loudsRanksSize());
+	memcpy(select_lut_, other.select_lut_, selectLutSize());
+    }
+    SparseNodeBlocks(const std::vector<std::vector<label_t> >& labels_per_level,
+		     const std::vector<std::vector<word_t> >& child_indicator_bits_per_level,
+		     const std::vector<std::vector<word_t> >& louds_bits_per_level,
+		     const level_t start_level = 0,
+		     level_t end_level = 0/* non-inclusive */) {
+	if (end_level == 0)
+	    end_level = labels_per_level.size();
+	num_labels_ = 0;
+	num_nodes_ = 0;
+	for (level_t level = start_level; level < end_level; level++)
+	    num_labels_ += labels_per_level[level].size();
+	num_blocks_ = num_labels_ / kLabelsPerBlock + 1;
+	allocateBlocks();
+	memset(blocks_, 0, blocksSize());
+
+	position_t pos = 0;
+	for (level_t level = start_level; level < end_level; level++) {
+	    for (position_t idx = 0; idx < labels_per_level[level].size(); idx++) {
+		label_t* block = getBlock(pos);
+		position_t offset = pos % kLabelsPerBlock;
+		block[kLabelsOffset + offset] = labels_per_level[level][idx];
+		if (SuRFBuilder::readBit(child_indicator_bits_per_level[level], idx))
+		    block[kChildBitsOffset + offset / 8] |= (1 << (offset % 8));
+		if (SuRFBuilder::readBit(louds_bits_per_level[level], idx)) {
+		    block[kLoudsBitsOffset + offset / 8] |= (1 << (offset % 8));
+		    num_nodes_++;
+		}
+		pos++;
+	    }
+	}
+	allocateDirectory();
+	initDirectory();
+    }
+
+    ~SparseNodeBlocks() {}
+
+    // Whether num_labels positions fit the 32-bit rank field of the
+    // blocks; always true with 32-bit positions
+    static bool fits(const position_t num_labels) {
+	return ((uint64_t)num_labels <= UINT32_MAX);
+    }
+
+    position_t numLabels() const {
+	return num_labels_;
+    }
+
+    position_t numNodes() const {
+	return num_nodes_;
+    }
+
+    label_t readLabel(const position_t pos) const {
+	return getBlock(pos)[kLabelsOffset + pos % kLabelsPerBlock];
+    }
+
+    bool readChildBit(const position_t pos) const {
+	return (readBits(getBlock(pos), kChildBitsOffset) >> (pos % kLabelsPerBlock)) & 1;
+    }
+
+    bool readLoudsBit(const position_t pos) const {
+	return (readBits(getBlock(pos), kLoudsBitsOffset) >> (pos % kLabelsPerBlock)) & 1;
+    }
+
+    // Number of child indicator 1's up to position pos (inclusive)
+    position_t rankChild(const position_t pos) const {
+	const label_t* block = getBlock(pos);
+	uint32_t rank;
+	memcpy(&rank, block, sizeof(rank));
+	word_t mask = (2ULL << (pos % kLabelsPerBlock)) - 1;
+	return le32toh(rank) + popcount(readBits(block, kChildBitsOffset) & mask);
+    }
+
+    // Position of the rank-th LOUDS 1 (rank is one-based);
+    // numLabels() for the one past the last node
+    position_t selectNode(const position_t rank) const {
+	assert(rank > 0);
+	assert(rank <= num_nodes_ + 1);
+	if (rank > num_nodes_)
+	    return num_labels_;
+	position_t block_id = select_lut_[(rank - 1) / kSelectSampleInterval];
+	while (louds_ranks_[block_id + 1] < rank)
+	    block_id++;
+	word_t bits = readBits(blocks_ + block_id * kBlockSize, kLoudsBitsOffset);
+	return (block_id * kLabelsPerBlock + select64Lsb(bits, rank - louds_ranks_[block_id]));
+    }
+
+    // Distance to the next LOUDS 1 after pos, or to the end
+    position_t distanceToNextNode(const position_t pos) const {
+	position_t block_id = pos / kLabelsPerBlock;
+	position_t offset = pos % kLabelsPerBlock;
+	word_t bits = readBits(blocks_ + block_id * kBlockSize, kLoudsBitsOffset) >> (offset + 1);
+	if (bits != 0)
+	    return (__builtin_ctzll(bits) + 1);
+	position_t distance = kLabelsPerBlock - offset;
+	for (block_id++; block_id < num_blocks_; block_id++) {
+	    bits = readBits(blocks_ + block_id * kBlockSize, kLoudsBitsOffset);
+	    if (bits != 0)
+		return (distance + __builtin_ctzll(bits));
+	    distance += kLabelsPerBlock;
+	}
+	return (num_labels_ - pos);
+    }
+
+    // Same semantics as the LabelVector functions of the same names
+    inline bool search(const label_t target, position_t& pos, const position_t search_len) const;
+    inline bool searchGreaterThan(const label_t target, position_t& pos, const position_t search_len) const;
+    inline bool searchLessThan(const label_t target, position_t& pos, const position_t search_len) const;
+
+    // in bytes
+    position_t blocksSize() const {
+	return (num_blocks_ * kBlockSize);
+    }
+
+    position_t loudsRanksSize() const {
+	return ((num_blocks_ + 1) * sizeof(position_t));
+    }
+
+    position_t selectLutSize() const {
+	return ((num_nodes_ / kSelectSampleInterval + 1) * sizeof(position_t));
+    }
+
+    position_t serializedSize() const {
+	return (sizeof(num_labels_) + sizeof(num_nodes_)
+		+ blocksSize() + loudsRanksSize() + selectLutSize());
+    }
+
+    position_t size() const {
+	return (sizeof(SparseNodeBlocks) + blocksSize() + loudsRanksSize() + selectLutSize());
+    }
+
+    void serialize(char*& dst) const {
+	writePosition(dst, num_labels_);
+	writePosition(dst, num_nodes_);
+	// block fields are little-endian byte sequences
+	memcpy(dst, blocks_, blocksSize());
+	dst += blocksSize();
+	for (position_t i = 0; i < loudsRanksSize() / sizeof(position_t); i++) {
+	    writePosition(dst, louds_ranks_[i]);
+	}
+	for (position_t i = 0; i < selectLutSize() / sizeof(position_t); i++) {
+	    writePosition(dst, select_lut_[i]);
+	}
+    }
+
+    int deSerialize(const char*& src) {
+	num_labels_ = readPosition(src);
+	num_nodes_ = readPosition(src);
+	num_blocks_ = num_labels_ / kLabelsPerBlock + 1;
+	allocate();
+	memcpy(blocks_, src, blocksSize());
+	src += blocksSize();
+	for (position_t i = 0; i < loudsRanksSize() / sizeof(position_t); i++) {
+	    louds_ranks_[i] = readPosition(src);
+	}
+	for (position_t i = 0; i < selectLutSize() / sizeof(position_t); i++) {
+	    select_lut_[i] = readPosition(src);
+	}
+	return 0;
+    }
+
+    void destroy() {
+	free(blocks_);
+	blocks_ = nullptr;
+	delete[] louds_ranks_;
+	delete[] select_lut_;
+    }
+
+private:
+    static const position_t kBlockSize = 64; // one cache line, in bytes
+    static const position_t kLabelsPerBlock = 48;
+    static const position_t kChildBitsOffset = 4;
+    static const position_t kLoudsBitsOffset = 10;
+    static const position_t kLabelsOffset = 16;
+    static const position_t kSelectSampleInterval = 64;
+    static const word_t kBitsMask = (1ULL << kLabelsPerBlock) - 1;
+
+    void allocate() {
+	allocateBlocks();
+	allocateDirectory();
+    }
+
+    void allocateBlocks() {
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, kBlockSize, blocksSize()) != 0)
+	    ptr = nullptr;
+	assert(ptr != nullptr);
+	blocks_ = reinterpret_cast<label_t*>(ptr);
+    }
+
+    // requires num_nodes_
+    void allocateDirectory() {
+	louds_ranks_ = new position_t[num_blocks_ + 1];
+	select_lut_ = new position_t[num_nodes_ / kSelectSampleInterval + 1];
+    }
+
+    label_t* getBlock(const position_t pos) const {
+	return blocks_ + (pos / kLabelsPerBlock) * kBlockSize;
+    }
+
+    static word_t readBits(const label_t* block, const position_t offset) {
+	word_t bits;
+	memcpy(&bits, block + offset, sizeof(bits));
+	return (le64toh(bits) & kBitsMask);
+    }
+
+    // Position of the k-th 1 counted from the least significant bit
+    static position_t select64Lsb(word_t bits, const position_t k) {
+#ifdef __BMI2__
+	return __builtin_ctzll(_pdep_u64(1ULL << (k - 1), bits));
+#else
+	for (position_t i = 1; i < k; i++)
+	    bits &= (bits - 1);
+	return __builtin_ctzll(bits);
+#endif
+    }
+
+    // Returns the node's labels contiguously: in place if the node
+    // does not cross a block boundary, otherwise copied into buf
+    const label_t* getNodeLabels(const position_t pos, const position_t len,
+				 label_t* buf) const {
+	if ((pos % kLabelsPerBlock) + len <= kLabelsPerBlock)
+	    return getBlock(pos) + kLabelsOffset + (pos % kLabelsPerBlock);
+	for (position_t i = 0; i < len; i++)
+	    buf[i] = readLabel(pos + i);
+	return buf;
+    }
+
+    void initDirectory() {
+	position_t cumu_child_rank = 0;
+	position_t cumu_louds_rank = 0;
+	std::vector<position_t> select_lut_vector;
+	for (position_t i = 0; i < num_blocks_; i++) {
+	    label_t* block = blocks_ + i * kBlockSize;
+	    // the in-block rank field is 32 bits wide, whatever position_t is (see fits)
+	    assert(cumu_child_rank <= UINT32_MAX);
+	    uint32_t rank = htole32(cumu_child_rank);
+	    memcpy(block, &rank, sizeof(rank));
+	    cumu_child_rank += popcount(readBits(block, kChildBitsOffset));
+
+	    louds_ranks_[i] = cumu_louds_rank;
+	    position_t num_ones = popcount(readBits(block, kLoudsBitsOffset));
+	    // block i holds 1's number cumu_louds_rank + 1 ... + num_ones
+	    while (select_lut_vector.size() * kSelectSampleInterval < cumu_louds_rank + num_ones)
+		select_lut_vector.push_back(i);
+	    cumu_louds_rank += num_ones;
+	}
+	louds_ranks_[num_blocks_] = cumu_louds_rank;
+	for (position_t i = 0; i < num_nodes_ / kSelectSampleInterval + 1; i++)
+	    select_lut_[i] = (i < select_lut_vector.size()) ? select_lut_vector[i] : (num_blocks_ - 1);
+    }
+
+    position_t num_labels_;
+    position_t num_blocks_;
+    position_t num_nodes_; // number of LOUDS 1's
+    label_t* blocks_; // aligned to the cache line
+    position_t* louds_ranks_; // LOUDS 1's before each block; last entry is the total
+    position_t* select_lut_; // block of the (i * kSelectSampleInterval + 1)-th LOUDS 1
+};
+
+// As in LabelVector, pos moves past a skipped terminator even when
+// the search fails
+bool SparseNodeBlocks::search(const label_t target, position_t& pos, position_t search_len) const {
+    //skip terminator label
+    if ((search_len > 1) && (readLabel(pos) == kTerminator)) {
+	pos++;
+	search_len--;
+    }
+    label_t buf[kFanout + 1];
+    const label_t* labels = getNodeLabels(pos, search_len, buf);
+    position_t l = 0;
+    position_t r = search_len;
+    while (l < r) {
+	position_t m = (l + r) >> 1;
+	if (target < labels[m]) {
+	    r = m;
+	} else if (target == labels[m]) {
+	    pos += m;
+	    return true;
+	} else {
+	    l = m + 1;
+	}
+    }
+    return false;
+}
+
+bool SparseNodeBlocks::searchGreaterThan(const label_t target, position_t& pos, position_t search_len) const {
+    //skip terminator label
+    if ((search_len > 1) && (readLabel(pos) == kTerminator)) {
+	pos++;
+	search_len--;
+    }
+    label_t buf[kFanout + 1];
+    const label_t* labels = getNodeLabels(pos, search_len, buf);
+    position_t l = 0;
+    position_t r = search_len;
+    while (l < r) {
+	position_t m = (l + r) >> 1;
+	if (target < labels[m])
+	    r = m;
+	else
+	    l = m + 1;
+    }
+    if (l < search_len) {
+	pos += l;
+	return true;
+    }
+    return false;
+}
+
+bool SparseNodeBlocks::searchLessThan(const label_t target, position_t& pos, position_t search_len) const {
+    //skip terminator label
+    if ((search_len > 1) && (readLabel(pos) == kTerminator)) {
+	pos++;
+	search_len--;
+    }
+    label_t buf[kFanout + 1];
+    const label_t* labels = getNodeLabels(pos, search_len, buf);
+    position_t l = 0;
+    position_t r = search_len;
+    while (l < r) {
+	position_t m = (l + r) >> 1;
+	if (labels[m] < target)
+	    l = m + 1;
+	else
+	    r = m;
+    }
+    if (l > 0) {
+	pos += (l - 1);
+	return true;
+    }
+    return false;
+}
+
+} // namespace surf
+
+#endif // SPARSENODEBLOCKS_H_
@@ -0,0 +1,219 @@
+#ifndef SPARSESUBTREECLUSTERS_H_
+#define SPARSESUBTREECLUSTERS_H_
+
+#include <assert.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+
+namespace surf {
+
+// Subtree-clustered copy of the LOUDS-Sparse nodes for point queries.
+// LOUDS stores nodes level by level, so a root-to-leaf walk touches a
+// distant part of each array at every level. Here the nodes are cut
+// into clusters: a cluster is the top of a subtree, filled in
+// breadth-first order up to about cluster_bytes, and the subtrees
+// below its last nodes form the next clusters, laid out depth-first
+// after it. A walk then pays about one cache miss per cluster instead
+// of one per level.
+// Each node is a self-contained record:
+//   1 byte          number of labels - 1
+//   position_t      suffix position of the node's first leaf
+//   n bytes         labels, as in LabelVector
+//   (n + 7) / 8     child indicator bits, MSB first
+//   position_t      record offset of each child, in label order
+// The root offsets of the nodes at the first sparse level are the
+// translation directory from LOUDS node numbers. Positions are
+// big-endian, as serialized, so the records are copied as they are.
+// The LOUDS arrays stay, so iterators and range queries are unaffected.
+class SparseSubtreeClusters {
+public:
+    SparseSubtreeClusters() : cluster_bytes_(0), num_roots_(0), records_size_(0),
+			      root_offsets_(nullptr), records_(nullptr) {};
+    SparseSubtreeClusters(const SparseSubtreeClusters& other)
+	: cluster_bytes_(other.cluster_bytes_), num_roots_(other.num_roots_),
+	  records_size_(other.records_size_) {
+	allocate();
+	memcpy(root_offsets_, other.root_offsets_, num_roots_ * sizeof(position_t));
+	memcpy(records_, other.records_, records_size_);
+    }
+    // root_offsets[i] is the record offset of sparse node i, for the
+    // nodes of the first sparse level; records holds all the nodes.
+    SparseSubtreeClusters(const position_t cluster_bytes,
+			  const std::vector<position_t>& root_offsets,
+			  const std::string& records)
+	: cluster_bytes_(cluster_bytes), num_roots_(root_offsets.size()),
+	  records_size_(records.length()) {
+	allocate();
+	for (position_t i = 0; i < num_roots_; i++)
+	    root_offsets_[i] = root_offsets[i];
+	memcpy(records_, records.data(), records_size_);
+    }
+
+    ~SparseSubtreeClusters() {}
+
+    // Size in bytes of a record with num_labels labels, of which
+    // num_children have a child
+    static position_t recordSize(const position_t num_labels, const position_t num_children) {
+	return (1 + sizeof(position_t) + num_labels + (num_labels + 7) / 8
+		+ num_children * sizeof(position_t));
+    }
+
+    static void appendRecord(std::string& records, const std::string& labels,
+			     const std::vector<bool>& has_child, const position_t suffix_pos,
+			     const std::vector<position_t>& child_offsets) {
+	assert((labels.length() > 0) && (labels.length() <= 256));
+	records.push_back((char)(labels.length() - 1));
+	appendPosition(records, suffix_pos);
+	records.append(labels);
+	std::string child_bits((labels.length() + 7) / 8, 0);
+	for (position_t i = 0; i < labels.length(); i++) {
+	    if (has_child[i])
+		child_bits[i / 8] |= (char)(0x80 >> (i % 8));
+	}
+	records.append(child_bits);
+	for (position_t i = 0; i < child_offsets.size(); i++)
+	    appendPosition(records, child_offsets[i]);
+    }
+
+    // Walks key from position level on, starting at sparse node
+    // root_id of the first sparse level. Returns false if the key
+    // leaves the trie. Otherwise, the walk ended at a leaf whose label
+    // is key[level], or, with level == key.length(), at a prefix key;
+    // suffix_pos is then the leaf's suffix position.
+    bool walk(const std::string& key, const position_t root_id, level_t& level,
+	      position_t& suffix_pos) const {
+	assert(root_id < num_roots_);
+	const char* record = records_ + root_offsets_[root_id];
+	for (; level < key.length(); level++) {
+	    position_t num_labels = (label_t)record[0] + 1;
+	    const char* labels = record + kLabelsOffset;
+	    position_t i;
+	    if (!search((label_t)key[level], labels, num_labels, i))
+		return false;
+	    const unsigned char* child_bits
+		= reinterpret_cast<const unsigned char*>(labels + num_labels);
+	    position_t num_children_before = countBits(child_bits, i);
+	    if (!readBit(child_bits, i)) {
+		suffix_pos = readRecordPosition(record + 1) + (i - num_children_before);
+		return true;
+	    }
+	    const char* child_offsets = labels + num_labels + (num_labels + 7) / 8;
+	    record = records_ + readRecordPosition(child_offsets
+						   + num_children_before * sizeof(position_t));
+	}
+	const unsigned char* child_bits
+	    = reinterpret_cast<const unsigned char*>(record + kLabelsOffset + (label_t)record[0] + 1);
+	if (((label_t)record[kLabelsOffset] == kTerminator) && !readBit(child_bits, 0)) {
+	    suffix_pos = readRecordPosition(record + 1);
+	    return true;
+	}
+	return false;
+    }
+
+    position_t getClusterBytes() const {
+	return cluster_bytes_;
+    }
+
+    // in bytes
+    position_t recordsSize() const {
+	return records_size_;
+    }
+
+    position_t serializedSize() const {
+	return (sizeof(cluster_bytes_) + sizeof(num_roots_) + sizeof(records_size_)
+		+ num_roots_ * sizeof(position_t) + records_size_);
+    }
+
+    position_t size() const {
+	return (sizeof(SparseSubtreeClusters) + num_roots_ * sizeof(position_t) + records_size_);
+    }
+
+    void serialize(char*& dst) const {
+	writePosition(dst, cluster_bytes_);
+	writePosition(dst, num_roots_);
+	writePosition(dst, records_size_);
+	for (position_t i = 0; i < num_roots_; i++)
+	    writePosition(dst, root_offsets_[i]);
+	memcpy(dst, records_, records_size_);
+	dst += records_size_;
+    }
+
+    int deSerialize(const char*& src) {
+	cluster_bytes_ = readPosition(src);
+	num_roots_ = readPosition(src);
+	records_size_ = readPosition(src);
+	allocate();
+	for (position_t i = 0; i < num_roots_; i++)
+	    root_offsets_[i] = readPosition(src);
+	memcpy(records_, src, records_size_);
+	src += records_size_;
+	return 0;
+    }
+
+    void destroy() {
+	delete[] root_offsets_;
+	delete[] records_;
+    }
+
+private:
+    static const position_t kLabelsOffset = 1 + sizeof(position_t);
+
+    void allocate() {
+	root_offsets_ = new position_t[num_roots_];
+	records_ = new char[records_size_];
+    }
+
+    static void appendPosition(std::string& records, const position_t pos) {
+	char buf[sizeof(position_t)];
+	char* dst = buf;
+	writePosition(dst, pos);
+	records.append(buf, sizeof(position_t));
+    }
+
+    static position_t readRecordPosition(const char* src) {
+	return readPosition(src);
+    }
+
+    // Same semantics as LabelVector::search, with pos relative to labels
+    static bool search(const label_t target, const char* labels,
+		       const position_t num_labels, position_t& pos) {
+	position_t first = 0;
+	// skip terminator label
+	if ((num_labels > 1) && ((label_t)labels[0] == kTerminator))
+	    first = 1;
+	const void* match = memchr(labels + first, (char)target, num_labels - first);
+	if (match == nullptr)
+	    return false;
+	pos = static_cast<const char*>(match) - labels;
+	return true;
+    }
+
+    static bool readBit(const unsigned char* bits, const position_t pos) {
+	return (bits[pos / 8] & (0x80 >> (pos % 8)));
+    }
+
+    // Number of set bits before pos
+    static position_t countBits(const unsigned char* bits, const position_t pos) {
+	position_t count = 0;
+	position_t num_bytes = pos / 8;
+	for (position_t i = 0; i < num_bytes; i++)
+	    count += __builtin_popcount(bits[i]);
+	if (pos % 8 > 0)
+	    count += __builtin_popcount(bits[num_bytes] >> (8 - pos % 8));
+	return count;
+    }
+
+    position_t cluster_bytes_;
+    position_t num_roots_;
+    position_t records_size_; // in bytes
+    position_t* root_offsets_; // translation directory
+    char* records_;
+};
+
+} // namespace surf
+
+#endif // SPARSESUBTREECLUSTERS_H_
@@ -4,7 +4,10 @@
 #include "bitvector.hpp"
 
 #include <assert.h>
+#include <math.h>
+#include <string.h>
 
+#include <algorithm>
 #include <vector>
 
 #include "config.hpp"
@@ -12,29 +15,258 @@
 
 namespace surf {
 
+// Fixed-width suffix array, one lane of a split BitvectorSuffix.
+// 8- and 16-bit suffixes are stored as a plain byte or 16-bit array,
+// so that reading one is a single load; other widths are bit-packed,
+// MSB first, as in BitvectorSuffix.
+class SuffixArray {
+public:
+    SuffixArray() : width_(0), num_suffixes_(0), words_(nullptr) {};
+    SuffixArray(const SuffixArray& other)
+	: width_(other.width_), num_suffixes_(other.num_suffixes_) {
+	words_ = new word_t[numWords()];
+	memcpy(words_, other.words_, dataSize());
+    }
+    SuffixArray(const level_t width, const position_t num_suffixes)
+	: width_(width), num_suffixes_(num_suffixes) {
+	assert(width <= kWordSize);
+	words_ = new word_t[numWords()];
+	memset(words_, 0, dataSize());
+    }
+
+    ~SuffixArray() {}
+
+    level_t getWidth() const {
+	return width_;
+    }
+
+    word_t read(const position_t idx) const {
+	assert(idx < num_suffixes_);
+	switch (width_) {
+	case 0:
+	    return 0;
+	case 8:
+	    return reinterpret_cast<const uint8_t*>(words_)[idx];
+	case 16:
+	    return reinterpret_cast<const uint16_t*>(words_)[idx];
+	default:
+	    break;
+	}
+	position_t bit_pos = idx * width_;
+	position_t word_id = bit_pos / kWordSize;
+	position_t offset = bit_pos & (kWordSize - 1);
+	word_t ret_word = (words_[word_id] << offset) >> (kWordSize - width_);
+	if (offset + width_ > kWordSize)
+	    ret_word += (words_[word_id+1] >> (2 * kWordSize - offset - width_));
+	return ret_word;
+    }
+
+    void write(const position_t idx, const word_t suffix) {
+	assert(idx < num_suffixes_);
+	switch (width_) {
+	case 0:
+	    return;
+	case 8:
+	    reinterpret_cast<uint8_t*>(words_)[idx] = (uint8_t)suffix;
+	    return;
+	case 16:
+	    reinterpret_cast<uint16_t*>(words_)[idx] = (uint16_t)suffix;
+	    return;
+	default:
+	    break;
+	}
+	position_t bit_pos = idx * width_;
+	position_t word_id = bit_pos / kWordSize;
+	position_t offset = bit_pos & (kWordSize - 1);
+	if (offset + width_ <= kWordSize) {
+	    words_[word_id] |= (suffix << (kWordSize - offset - width_));
+	} else {
+	    words_[word_id] |= (suffix >> (offset + width_ - kWordSize));
+	    words_[word_id+1] |= (suffix << (2 * kWordSize - offset - width_));
+	}
+    }
+
+    position_t numWords() const {
+	position_t num_bits = num_suffixes_ * width_;
+	if (num_bits % kWordSize == 0)
+	    return (num_bits / kWordSize);
+	else
+	    return (num_bits / kWordSize + 1);
+    }
+
+    // in bytes
+    position_t dataSize() const {
+	return (numWords() * sizeof(word_t));
+    }
+
+    position_t serializedSize() const {
+	return (sizeof(uint32_t) + sizeof(num_suffixes_) + dataSize());
+    }
+
+    position_t size() const {
+	return (sizeof(SuffixArray) + dataSize());
+    }
+
+    void serialize(char*& dst) const {
+	*reinterpret_cast<uint32_t*>(dst) = htobe32(width_);
+	dst += sizeof(uint32_t);
+	writePosition(dst, num_suffixes_);
+	if (width_ == 8) {
+	    memcpy(dst, words_, dataSize());
+	    dst += dataSize();
+	} else if (width_ == 16) {
+	    const uint16_t* shorts = reinterpret_cast<const uint16_t*>(words_);
+	    for (position_t i = 0; i < dataSize() / sizeof(uint16_t); i++) {
+		*reinterpret_cast<uint16_t*>(dst) = htobe16(shorts[i]);
+		dst += sizeof(uint16_t);
+	    }
+	} else {
+	    for (position_t i = 0; i < numWords(); i++) {
+		*reinterpret_cast<uint64_t*>(dst) = htobe64(words_[i]);
+		dst += sizeof(uint64_t);
+	    }
+	}
+    }
+
+    int deSerialize(const char*& src) {
+	width_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
+	src += sizeof(uint32_t);
+	num_suffixes_ = readPosition(src);
+	words_ = new word_t[numWords()];
+	if (width_ == 8) {
+	    memcpy(words_, src, dataSize());
+	    src += dataSize();
+	} else if (width_ == 16) {
+	    uint16_t* shorts = reinterpret_cast<uint16_t*>(words_);
+	    for (position_t i = 0; i < dataSize() / sizeof(uint16_t); i++) {
+		shorts[i] = be16toh(*reinterpret_cast<const uint16_t*>(src));
+		src += sizeof(uint16_t);
+	    }
+	} else {
+	    for (position_t i = 0; i < numWords(); i++) {
+		words_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+		src += sizeof(uint64_t);
+	    }
+	}
+	return 0;
+    }
+
+    void destroy() {
+	delete[] words_;
+    }
+
+private:
+    level_t width_; // in bits
+    position_t num_suffixes_;
+    word_t* words_;
+};
+
 // Max suffix_len_ = 64 bits
 // For kReal suffixes, if the stored key is not long enough to provide
 // suffix_len_ suffix bits, its suffix field is cleared (i.e., all 0's)
 // to indicate that there is no suffix info associated with the key.
+// With split set, the hash and the real suffixes are moved out of the
+// packed bitvector into two SuffixArrays: checkEquality then reads
+// each part with one load (8- and 16-bit parts are byte or 16-bit
+// arrays), and compare reads only the real suffixes.
+// With per-level hash suffix lengths, the suffixes stay packed, each
+// level at its own width, and hash_suffix_len_ is the largest one.
+// An exact kNone suffix belongs to a trie that stores every key byte
+// (SuRFBuilder exact mode): a leaf's key ends at the leaf, so a query
+// matches only if it ends there too.
 class BitvectorSuffix : public Bitvector {
 public:
-    BitvectorSuffix() : type_(kNone), hash_suffix_len_(0), real_suffix_len_(0) {};
-    BitvectorSuffix(const BitvectorSuffix& other):Bitvector(other), type_(other.type_), hash_suffix_len_(other.hash_suffix_len_), real_suffix_len_(other.real_suffix_len_){}
+    BitvectorSuffix() : type_(kNone), hash_suffix_len_(0), real_suffix_len_(0),
+			layout_flags_(0), num_suffixes_(0),
+			hash_suffixes_(nullptr), real_suffixes_(nullptr),
+			num_levels_(0), level_hash_lens_(nullptr),
+			level_starts_(nullptr), level_bit_starts_(nullptr) {};
+    explicit BitvectorSuffix(const bool exact) : BitvectorSuffix() {
+	if (exact)
+	    layout_flags_ |= kLayoutExact;
+    }
+    BitvectorSuffix(const BitvectorSuffix& other):Bitvector(other), type_(other.type_), hash_suffix_len_(other.hash_suffix_len_), real_suffix_len_(other.real_suffix_len_),
+	layout_flags_(other.layout_flags_), num_suffixes_(other.num_suffixes_),
+	hash_suffixes_(nullptr), real_suffixes_(nullptr),
+	num_levels_(other.num_levels_), level_hash_lens_(nullptr),
+	level_starts_(nullptr), level_bit_starts_(nullptr) {
+	if (isSplit()) {
+	    hash_suffixes_ = new SuffixArray(*other.hash_suffixes_);
+	    real_suffixes_ = new SuffixArray(*other.real_suffixes_);
+	}
+	if (isPerLevel()) {
+	    allocateLevels();
+	    memcpy(level_hash_lens_, other.level_hash_lens_, num_levels_ * sizeof(level_t));
+	    memcpy(level_starts_, other.level_starts_, (num_levels_ + 1) * sizeof(position_t));
+	    memcpy(level_bit_starts_, other.level_bit_starts_, num_levels_ * sizeof(position_t));
+	}
+    }
     BitvectorSuffix(const SuffixType type,
                     const level_t hash_suffix_len, const level_t real_suffix_len,
                     const std::vector<std::vector<word_t> >& bitvector_per_level,
                     const std::vector<position_t>& num_bits_per_level,
                     const level_t start_level = 0,
-                    level_t end_level = 0/* non-inclusive */)
+                    level_t end_level = 0/* non-inclusive */,
+		    const bool split = false)
 	: Bitvector(bitvector_per_level, num_bits_per_level, start_level, end_level) {
 	assert((hash_suffix_len + real_suffix_len) <= kWordSize);
 	type_ = type;
 	hash_suffix_len_ = hash_suffix_len;
         real_suffix_len_ = real_suffix_len;
+	layout_flags_ = 0;
+	num_suffixes_ = 0;
+	hash_suffixes_ = nullptr;
+	real_suffixes_ = nullptr;
+	num_levels_ = 0;
+	level_hash_lens_ = nullptr;
+	level_starts_ = nullptr;
+	level_bit_starts_ = nullptr;
+	// a kHash (kReal) suffix is split only if it has no real (hash) bits
+	if (split && (getSuffixLen() > 0)
+	    && ((type_ == kMixed) || ((type_ == kHash) && (real_suffix_len_ == 0))
+		|| ((type_ == kReal) && (hash_suffix_len_ == 0))))
+	    splitSuffixes();
+    }
+    // The suffixes of level l are hash_suffix_lens[l] + real_suffix_len
+    // bits wide (see SuRFBuilder::getHashSuffixLens).
+    BitvectorSuffix(const SuffixType type,
+		    const std::vector<level_t>& hash_suffix_lens, const level_t real_suffix_len,
+		    const std::vector<std::vector<word_t> >& bitvector_per_level,
+		    const std::vector<position_t>& suffix_counts_per_level,
+		    const level_t start_level, const level_t end_level/* non-inclusive */)
+	: Bitvector(bitvector_per_level,
+		    numBitsPerLevel(hash_suffix_lens, real_suffix_len, suffix_counts_per_level),
+		    start_level, end_level),
+	  type_(type), hash_suffix_len_(0), real_suffix_len_(real_suffix_len),
+	  layout_flags_(kLayoutPerLevel), num_suffixes_(0),
+	  hash_suffixes_(nullptr), real_suffixes_(nullptr),
+	  num_levels_(end_level - start_level) {
+	allocateLevels();
+	position_t suffix_count = 0;
+	position_t bit_count = 0;
+	for (level_t i = 0; i < num_levels_; i++) {
+	    level_t level = start_level + i;
+	    assert((hash_suffix_lens[level] + real_suffix_len) <= kWordSize);
+	    hash_suffix_len_ = std::max(hash_suffix_len_, hash_suffix_lens[level]);
+	    level_hash_lens_[i] = hash_suffix_lens[level];
+	    level_starts_[i] = suffix_count;
+	    level_bit_starts_[i] = bit_count;
+	    suffix_count += suffix_counts_per_level[level];
+	    bit_count += suffix_counts_per_level[level] * (hash_suffix_lens[level] + real_suffix_len);
+	}
+	level_starts_[num_levels_] = suffix_count;
+    }
+
+    static word_t constructHashSuffix(const std::string& key, const level_t len,
+				      const SuffixHash suffix_hash = kLevelDbHash) {
+	if (len == 0)
+	    return 0;
+	return extractHashBits(suffixHash(suffix_hash, key.data(), key.size()), len);
     }
 
-    static word_t constructHashSuffix(const std::string& key, const level_t len) {
-	word_t suffix = suffixHash(key);
+    // The len hash suffix bits of the key hash hash
+    static word_t extractHashBits(const uint64_t hash, const level_t len) {
+	word_t suffix = hash;
 	suffix <<= (kWordSize - len - kHashShift);
 	suffix >>= (kWordSize - len);
 	return suffix;
@@ -65,8 +297,9 @@ public:
     }
 
     static word_t constructMixedSuffix(const std::string& key, const level_t hash_len,
-				       const level_t real_level, const level_t real_len) {
-        word_t hash_suffix = constructHashSuffix(key, hash_len);
+				       const level_t real_level, const level_t real_len,
+				       const SuffixHash suffix_hash = kLevelDbHash) {
+        word_t hash_suffix = constructHashSuffix(key, hash_len, suffix_hash);
         word_t real_suffix = constructRealSuffix(key, real_level, real_len);
         word_t suffix = hash_suffix;
         suffix <<= real_len;
@@ -76,14 +309,15 @@ public:
 
     static word_t constructSuffix(const SuffixType type, const std::string& key,
                                   const level_t hash_len,
-                                  const level_t real_level, const level_t real_len) {
+                                  const level_t real_level, const level_t real_len,
+				  const SuffixHash suffix_hash = kLevelDbHash) {
 	switch (type) {
 	case kHash:
-	    return constructHashSuffix(key, hash_len);
+	    return constructHashSuffix(key, hash_len, suffix_hash);
 	case kReal:
 	    return constructRealSuffix(key, real_level, real_len);
         case kMixed:
-            return constructMixedSuffix(key, hash_len, real_level, real_len);
+            return constructMixedSuffix(key, hash_len, real_level, real_len, suffix_hash);
 	default:
 	    return 0;
         }
@@ -116,52 +350,113 @@ public:
 	return real_suffix_len_;
     }
 
+    bool isSplit() const {
+	return (layout_flags_ & kLayoutSplit);
+    }
+
+    bool isPerLevel() const {
+	return (layout_flags_ & kLayoutPerLevel);
+    }
+
+    bool isExact() const {
+	return (layout_flags_ & kLayoutExact);
+    }
+
+    SuffixHash getSuffixHash() const {
+	return ((layout_flags_ & kLayoutWyHash) ? kWyHash : kLevelDbHash);
+    }
+
+    // Must match the hash function the suffixes were built with
+    void setSuffixHash(const SuffixHash suffix_hash) {
+	if (suffix_hash == kWyHash)
+	    layout_flags_ |= kLayoutWyHash;
+	else
+	    layout_flags_ &= ~kLayoutWyHash;
+    }
+
     position_t serializedSize() const {
 	position_t size = sizeof(num_bits_) + sizeof(type_)
-            + sizeof(hash_suffix_len_) + sizeof(real_suffix_len_) + bitsSize();
+            + sizeof(hash_suffix_len_) + sizeof(real_suffix_len_)
+	    + sizeof(layout_flags_) + bitsSize();
+	if (isSplit())
+	    size += sizeof(num_suffixes_) + hash_suffixes_->serializedSize()
+		+ real_suffixes_->serializedSize();
+	if (isPerLevel())
+	    size += sizeof(num_levels_) + levelsSize();
 	//sizeAlign(size);
 	return size;
     }
 
     position_t size() const {
-	return (sizeof(BitvectorSuffix) + bitsSize());
+	position_t size = sizeof(BitvectorSuffix) + bitsSize();
+	if (isSplit())
+	    size += hash_suffixes_->size() + real_suffixes_->size();
+	if (isPerLevel())
+	    size += levelsSize();
+	return size;
     }
 
     inline word_t read(const position_t idx) const;
     inline word_t readReal(const position_t idx) const;
-    inline bool checkEquality(const position_t idx, const std::string& key, const level_t level) const;
-
+    // The key is hashed at most once, however many checks it goes through
+    inline bool checkEquality(const position_t idx, const PreparedKey& key, const level_t level) const;
+    // As above, with the suffix type fixed at compile time (see
+    // StaticLookup); kType must be the type of the suffixes.
+    template <SuffixType kType>
+    inline bool checkEquality(const position_t idx, const PreparedKey& key, const level_t level) const;
+    // Estimated probability that a key passing checkEquality at idx is not
+    // the stored key: 2^-b, where b is the number of suffix bits compared
+    inline double estimateFpProbability(const position_t idx) const;
     // Compare stored suffix to querying suffix.
     // kReal suffix type only.
     inline int compare(const position_t idx, const std::string& key, const level_t level) const;
 
     void serialize(char*& dst) const {
-        *reinterpret_cast<uint32_t*>(dst) = htobe32(num_bits_);
-	dst += sizeof(num_bits_);
+        writePosition(dst, num_bits_);
     *reinterpret_cast<uint32_t*>(dst) = htobe32(type_);
 	dst += sizeof(type_);
     *reinterpret_cast<uint32_t*>(dst) = htobe32(hash_suffix_len_);
 	dst += sizeof(hash_suffix_len_);
     *reinterpret_cast<uint32_t*>(dst) = htobe32(real_suffix_len_);
 	dst += sizeof(real_suffix_len_);
+	*reinterpret_cast<uint32_t*>(dst) = htobe32(layout_flags_);
+	dst += sizeof(layout_flags_);
 	if (type_ != kNone) {
         for(int i=0;i<numWords();i++) {
             *reinterpret_cast<uint64_t*>(dst) = htobe64(bits_[i]);
             dst += sizeof(uint64_t);
         }
 	}
+	if (isSplit()) {
+	    writePosition(dst, num_suffixes_);
+	    hash_suffixes_->serialize(dst);
+	    real_suffixes_->serialize(dst);
+	}
+	if (isPerLevel()) {
+	    *reinterpret_cast<uint32_t*>(dst) = htobe32(num_levels_);
+	    dst += sizeof(num_levels_);
+	    for (level_t i = 0; i < num_levels_; i++) {
+		*reinterpret_cast<uint32_t*>(dst) = htobe32(level_hash_lens_[i]);
+		dst += sizeof(level_t);
+	    }
+	    for (level_t i = 0; i <= num_levels_; i++)
+		writePosition(dst, level_starts_[i]);
+	    for (level_t i = 0; i < num_levels_; i++)
+		writePosition(dst, level_bit_starts_[i]);
+	}
 	//align(dst);
     }
 
     int deSerialize(const char*& src) {
-        num_bits_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
-	src += sizeof(num_bits_);
+        num_bits_ = readPosition(src);
     type_ = static_cast<SuffixType>(be32toh(*reinterpret_cast<const uint32_t*>(src)));
 	src += sizeof(type_);
     hash_suffix_len_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
 	src += sizeof(hash_suffix_len_);
     real_suffix_len_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
 	src += sizeof(real_suffix_len_);
+	layout_flags_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
+	src += sizeof(layout_flags_);
 	if (type_ != kNone) {
         auto num_words = numWords();
 	    bits_ =  new word_t[num_words];
@@ -170,51 +465,247 @@ public:
             src += sizeof(uint64_t);
         }
 	}
+	num_suffixes_ = 0;
+	hash_suffixes_ = nullptr;
+	real_suffixes_ = nullptr;
+	if (isSplit()) {
+	    num_suffixes_ = readPosition(src);
+	    hash_suffixes_ = new SuffixArray();
+	    hash_suffixes_->deSerialize(src);
+	    real_suffixes_ = new SuffixArray();
+	    real_suffixes_->deSerialize(src);
+	}
+	num_levels_ = 0;
+	level_hash_lens_ = nullptr;
+	level_starts_ = nullptr;
+	level_bit_starts_ = nullptr;
+	if (isPerLevel()) {
+	    num_levels_ = be32toh(*reinterpret_cast<const uint32_t*>(src));
+	    src += sizeof(num_levels_);
+	    allocateLevels();
+	    for (level_t i = 0; i < num_levels_; i++) {
+		level_hash_lens_[i] = be32toh(*reinterpret_cast<const uint32_t*>(src));
+		src += sizeof(level_t);
+	    }
+	    for (level_t i = 0; i <= num_levels_; i++)
+		level_starts_[i] = readPosition(src);
+	    for (level_t i = 0; i < num_levels_; i++)
+		level_bit_starts_[i] = readPosition(src);
+	}
 	//align(src);
 	return 0;
     }
 
+    // Reads the version 0 layout (32-bit fields, no layout flags), see
+    // kSerializeVersion
+    int deSerializeV0(const char*& src) {
+	num_bits_ = readUint32(src);
+	type_ = static_cast<SuffixType>(readUint32(src));
+	hash_suffix_len_ = readUint32(src);
+	real_suffix_len_ = readUint32(src);
+	layout_flags_ = 0;
+	if (type_ != kNone) {
+	    bits_ = new word_t[numWords()];
+	    for (position_t i = 0; i < numWords(); i++) {
+		bits_[i] = be64toh(*reinterpret_cast<const uint64_t*>(src));
+		src += sizeof(uint64_t);
+	    }
+	}
+	num_suffixes_ = 0;
+	hash_suffixes_ = nullptr;
+	real_suffixes_ = nullptr;
+	num_levels_ = 0;
+	level_hash_lens_ = nullptr;
+	level_starts_ = nullptr;
+	level_bit_starts_ = nullptr;
+	return 0;
+    }
+
     void destroy() {
 	if (type_ != kNone)
 	    delete[] bits_;
+	if (isSplit()) {
+	    hash_suffixes_->destroy();
+	    delete hash_suffixes_;
+	    real_suffixes_->destroy();
+	    delete real_suffixes_;
+	}
+	if (isPerLevel()) {
+	    delete[] level_hash_lens_;
+	    delete[] level_starts_;
+	    delete[] level_bit_starts_;
+	}
     }
 
+    static const uint32_t kLayoutSplit = 1;
+    static const uint32_t kLayoutPerLevel = 2;
+    static const uint32_t kLayoutExact = 4;
+    static const uint32_t kLayoutWyHash = 8;
+
 private:
+    static std::vector<position_t> numBitsPerLevel(const std::vector<level_t>& hash_suffix_lens,
+						   const level_t real_suffix_len,
+						   const std::vector<position_t>& suffix_counts_per_level) {
+	std::vector<position_t> num_bits_per_level;
+	for (level_t level = 0; level < suffix_counts_per_level.size(); level++)
+	    num_bits_per_level.push_back(suffix_counts_per_level[level]
+					 * (hash_suffix_lens[level] + real_suffix_len));
+	return num_bits_per_level;
+    }
+
+    void allocateLevels() {
+	level_hash_lens_ = new level_t[num_levels_];
+	level_starts_ = new position_t[num_levels_ + 1];
+	level_bit_starts_ = new position_t[num_levels_];
+    }
+
+    // in bytes
+    position_t levelsSize() const {
+	return (num_levels_ * sizeof(level_t) + (2 * num_levels_ + 1) * sizeof(position_t));
+    }
+
+    inline bool hasSuffix(const position_t idx) const;
+    // Bit position and hash suffix length of the packed suffix at idx
+    inline void locate(const position_t idx, position_t& bit_pos, level_t& hash_len) const;
+    inline word_t readBits(const position_t bit_pos, const level_t len) const;
+    inline void splitSuffixes();
+    template <SuffixType kType>
+    inline bool checkEqualitySplit(const position_t idx, const PreparedKey& key,
+				   const level_t level) const;
+    inline word_t constructQueryHashSuffix(const PreparedKey& key, const level_t len) const;
+
     SuffixType type_;
     level_t hash_suffix_len_; // in bits
     level_t real_suffix_len_; // in bits
+    uint32_t layout_flags_;
+    position_t num_suffixes_; // split layout only
+    SuffixArray* hash_suffixes_;
+    SuffixArray* real_suffixes_;
+    // per-level layout only
+    level_t num_levels_;
+    level_t* level_hash_lens_;
+    position_t* level_starts_; // first suffix index; num_levels_ + 1 entries
+    position_t* level_bit_starts_;
+};
+
+// The key prefixes of lengths [min_len, max_len] that the trie leads to
+// the suffix at idx of suffixes, stored at the given level. They are
+// candidates of a longest prefix match, and each still has to pass
+// checkEquality (see SuRF::longestPrefixMatch).
+struct PrefixRange {
+    const BitvectorSuffix* suffixes;
+    position_t idx;
+    level_t min_len;
+    level_t max_len;
+    level_t level;
 };
 
+// Whether a suffix is stored at idx
+bool BitvectorSuffix::hasSuffix(const position_t idx) const {
+    if (isSplit())
+	return (idx < num_suffixes_);
+    if (isPerLevel())
+	return (idx < level_starts_[num_levels_]);
+    return (idx * getSuffixLen() < num_bits_);
+}
+
+void BitvectorSuffix::locate(const position_t idx, position_t& bit_pos, level_t& hash_len) const {
+    if (!isPerLevel()) {
+	hash_len = hash_suffix_len_;
+	bit_pos = idx * getSuffixLen();
+	return;
+    }
+    // the last level starting at or before idx; empty levels share
+    // their start with the next level
+    level_t i = std::upper_bound(level_starts_, level_starts_ + num_levels_ + 1, idx)
+	- level_starts_ - 1;
+    hash_len = level_hash_lens_[i];
+    bit_pos = level_bit_starts_[i] + (idx - level_starts_[i]) * (hash_len + real_suffix_len_);
+}
+
+// Moves the packed suffixes into the hash and real SuffixArrays
+void BitvectorSuffix::splitSuffixes() {
+    num_suffixes_ = num_bits_ / getSuffixLen();
+    hash_suffixes_ = new SuffixArray(hash_suffix_len_, num_suffixes_);
+    real_suffixes_ = new SuffixArray(real_suffix_len_, num_suffixes_);
+    for (position_t i = 0; i < num_suffixes_; i++) {
+	word_t suffix = read(i);
+	if (hash_suffix_len_ > 0)
+	    hash_suffixes_->write(i, extractHashSuffix(suffix, real_suffix_len_));
+	if (real_suffix_len_ > 0)
+	    real_suffixes_->write(i, extractRealSuffix(suffix, real_suffix_len_));
+    }
+    delete[] bits_;
+    bits_ = nullptr;
+    num_bits_ = 0;
+    layout_flags_ |= kLayoutSplit;
+}
+
 word_t BitvectorSuffix::read(const position_t idx) const {
     if (type_ == kNone) 
 	return 0;
-
-    level_t suffix_len = getSuffixLen();
-    if (idx * suffix_len >= num_bits_) 
+    if (!hasSuffix(idx))
 	return 0;
+    if (isSplit()) {
+	if (hash_suffix_len_ == 0)
+	    return real_suffixes_->read(idx);
+	return ((hash_suffixes_->read(idx) << real_suffix_len_) | real_suffixes_->read(idx));
+    }
+
+    position_t bit_pos;
+    level_t hash_len;
+    locate(idx, bit_pos, hash_len);
+    return readBits(bit_pos, hash_len + real_suffix_len_);
+}
 
-    position_t bit_pos = idx * suffix_len;
+word_t BitvectorSuffix::readBits(const position_t bit_pos, const level_t suffix_len) const {
+    if (suffix_len == 0)
+	return 0;
     position_t word_id = bit_pos / kWordSize;
     position_t offset = bit_pos & (kWordSize - 1);
     word_t ret_word = (bits_[word_id] << offset) >> (kWordSize - suffix_len);
     if (offset + suffix_len > kWordSize)
-	ret_word += (bits_[word_id+1] >> (kWordSize - offset - suffix_len));
+	ret_word += (bits_[word_id+1] >> (2 * kWordSize - offset - suffix_len));
     return ret_word;
 }
 
 word_t BitvectorSuffix::readReal(const position_t idx) const {
+    if (isSplit())
+	return (hasSuffix(idx) ? real_suffixes_->read(idx) : 0);
     return extractRealSuffix(read(idx), real_suffix_len_);
 }
 
 bool BitvectorSuffix::checkEquality(const position_t idx, 
-				    const std::string& key, const level_t level) const {
-    if (type_ == kNone) 
-	return true;
-    if (idx * getSuffixLen() >= num_bits_) 
-	return false;
+				    const PreparedKey& key, const level_t level) const {
+    switch (type_) {
+    case kHash:
+	return checkEquality<kHash>(idx, key, level);
+    case kReal:
+	return checkEquality<kReal>(idx, key, level);
+    case kMixed:
+	return checkEquality<kMixed>(idx, key, level);
+    default:
+	return checkEquality<kNone>(idx, key, level);
+    }
+}
 
-    word_t stored_suffix = read(idx);
-    if (type_ == kReal) {
+template <SuffixType kType>
+bool BitvectorSuffix::checkEquality(const position_t idx, 
+				    const PreparedKey& prepared_key, const level_t level) const {
+    assert(type_ == kType);
+    const std::string& key = prepared_key.key();
+    if (kType == kNone) 
+	return (!isExact() || (key.length() <= level));
+    if (!hasSuffix(idx))
+	return false;
+    if (isSplit())
+	return checkEqualitySplit<kType>(idx, prepared_key, level);
+
+    position_t bit_pos;
+    level_t hash_len;
+    locate(idx, bit_pos, hash_len);
+    word_t stored_suffix = readBits(bit_pos, hash_len + real_suffix_len_);
+    if (kType == kReal) {
 	// if no suffix info for the stored key
 	if (stored_suffix == 0) 
 	    return true;
@@ -222,11 +713,61 @@ bool BitvectorSuffix::checkEquality(const position_t idx,
 	if (key.length() < level || ((key.length() - level) * 8) < real_suffix_len_) 
 	    return false;
     }
-    word_t querying_suffix 
-	= constructSuffix(type_, key, hash_suffix_len_, level, real_suffix_len_);
+    // as constructSuffix
+    word_t querying_suffix;
+    if (kType == kHash)
+	querying_suffix = constructQueryHashSuffix(prepared_key, hash_len);
+    else if (kType == kReal)
+	querying_suffix = constructRealSuffix(key, level, real_suffix_len_);
+    else
+	querying_suffix = ((constructQueryHashSuffix(prepared_key, hash_len) << real_suffix_len_)
+			   | constructRealSuffix(key, level, real_suffix_len_));
     return (stored_suffix == querying_suffix);
 }
 
+// The hash part rejects most false positives, so it is checked first
+template <SuffixType kType>
+bool BitvectorSuffix::checkEqualitySplit(const position_t idx,
+					 const PreparedKey& prepared_key, const level_t level) const {
+    const std::string& key = prepared_key.key();
+    if ((hash_suffix_len_ > 0)
+	&& (hash_suffixes_->read(idx) != constructQueryHashSuffix(prepared_key, hash_suffix_len_)))
+	return false;
+    if (real_suffix_len_ == 0)
+	return true;
+    word_t stored_suffix = real_suffixes_->read(idx);
+    if (kType == kReal) {
+	// if no suffix info for the stored key
+	if (stored_suffix == 0)
+	    return true;
+	// if the querying key is shorter than the stored key
+	if (key.length() < level || ((key.length() - level) * 8) < real_suffix_len_)
+	    return false;
+    }
+    return (stored_suffix == constructRealSuffix(key, level, real_suffix_len_));
+}
+
+// As constructHashSuffix, with the hash function of the suffixes
+word_t BitvectorSuffix::constructQueryHashSuffix(const PreparedKey& key, const level_t len) const {
+    if (len == 0)
+	return 0;
+    return extractHashBits(key.hash(getSuffixHash()), len);
+}
+
+double BitvectorSuffix::estimateFpProbability(const position_t idx) const {
+    if (type_ == kNone)
+	return (isExact() ? 0 : 1.0);
+    position_t bit_pos;
+    level_t hash_len = hash_suffix_len_;
+    if (hasSuffix(idx) && !isSplit())
+	locate(idx, bit_pos, hash_len);
+    int num_checked_bits = hash_len;
+    // a zero real suffix means no suffix info for the stored key
+    if ((real_suffix_len_ > 0) && (readReal(idx) != 0))
+	num_checked_bits += real_suffix_len_;
+    return ldexp(1.0, -num_checked_bits);
+}
+
 // If no real suffix is stored for the key, compare returns 0.
 // int BitvectorSuffix::compare(const position_t idx, 
 // 			     const std::string& key, const level_t level) const {
@@ -249,13 +790,21 @@ bool BitvectorSuffix::checkEquality(const position_t idx,
 
 int BitvectorSuffix::compare(const position_t idx, 
 			     const std::string& key, const level_t level) const {
-    if ((idx * getSuffixLen() >= num_bits_) || (type_ == kNone) || (type_ == kHash))
+    // the stored key is key.substr(0, level)
+    if (isExact())
+	return ((key.length() > level) ? -1 : kCouldBePositive);
+    if ((type_ == kNone) || (type_ == kHash) || !hasSuffix(idx))
 	return kCouldBePositive;
 
-    word_t stored_suffix = read(idx);
+    word_t stored_suffix;
+    if (isSplit()) {
+	stored_suffix = real_suffixes_->read(idx);
+    } else {
+	stored_suffix = read(idx);
+	if (type_ == kMixed)
+	    stored_suffix = extractRealSuffix(stored_suffix, real_suffix_len_);
+    }
     word_t querying_suffix = constructRealSuffix(key, level, real_suffix_len_);
-    if (type_ == kMixed)
-        stored_suffix = extractRealSuffix(stored_suffix, real_suffix_len_);
 
     if ((stored_suffix == 0) && (querying_suffix == 0))
 	return kCouldBePositive;
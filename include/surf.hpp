@@ -1,10 +1,14 @@
 #ifndef SURF_H_
 #define SURF_H_
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
+#include "blocked_bloom.hpp"
 #include "config.hpp"
+#include "key_encoder.hpp"
+#include "key_pattern.hpp"
 #include "louds_dense.hpp"
 #include "louds_sparse.hpp"
 #include "surf_builder.hpp"
@@ -15,11 +19,15 @@ class SuRF {
 public:
     class Iter {
     public:
-	Iter() {};
+	Iter() : filter_(nullptr), could_be_fp_(false), at_seek_(false),
+		 seek_inclusive_(false) {};
 	Iter(const SuRF* filter) {
+	    filter_ = filter;
 	    dense_iter_ = LoudsDense::Iter(filter->louds_dense_);
 	    sparse_iter_ = LoudsSparse::Iter(filter->louds_sparse_);
 	    could_be_fp_ = false;
+	    at_seek_ = false;
+	    seek_inclusive_ = false;
 	}
 
         inline void clear();
@@ -42,35 +50,96 @@ public:
      inline bool decrementSparseIter();
 
     private:
+	const SuRF* filter_;
 	// true implies that dense_iter_ is valid
 	LoudsDense::Iter dense_iter_;
 	LoudsSparse::Iter sparse_iter_;
 	bool could_be_fp_;
+	// set by lookupRange: the iterator has not moved since it was
+	// positioned at the first key greater than (or equal to, if
+	// seek_inclusive_) seek_key_, a trie key
+	bool at_seek_;
+	bool seek_inclusive_;
+	std::string seek_key_;
 
 	friend class SuRF;
     };
 
 public:
-    SuRF() : louds_dense_(nullptr), louds_sparse_(nullptr){};
+    SuRF() : louds_dense_(nullptr), louds_sparse_(nullptr), bloom_(nullptr),
+	     encoder_(nullptr), max_key_len_(kUnknownKeyLen) {};
     SuRF(const SuRF& other)
         : louds_dense_(new LoudsDense(*other.louds_dense_)),
-          louds_sparse_(new LoudsSparse(*other.louds_sparse_)) {}
+          louds_sparse_(new LoudsSparse(*other.louds_sparse_)),
+          bloom_(new BlockedBloom(*other.bloom_)),
+          encoder_(new KeyEncoder(*other.encoder_)),
+          max_key_len_(other.max_key_len_) {}
     //------------------------------------------------------------------
     // Input keys must be SORTED
     //------------------------------------------------------------------
     SuRF(const std::vector<std::string>& keys) {
-	create(keys, kIncludeDense, kSparseDenseRatio, kNone, 0, 0);
+	create(keys, kIncludeDense, kSparseDenseRatio, kNone, 0, 0, kBloomBitsPerKey, kEncodeKeys);
     }
 
     SuRF(const std::vector<std::string>& keys, const SuffixType suffix_type,
 	 const level_t hash_suffix_len, const level_t real_suffix_len) {
-	create(keys, kIncludeDense, kSparseDenseRatio, suffix_type, hash_suffix_len, real_suffix_len);
+	create(keys, kIncludeDense, kSparseDenseRatio, suffix_type, hash_suffix_len, real_suffix_len,
+	       kBloomBitsPerKey, kEncodeKeys);
     }
     
     SuRF(const std::vector<std::string>& keys,
 	 const bool include_dense, const uint32_t sparse_dense_ratio,
 	 const SuffixType suffix_type, const level_t hash_suffix_len, const level_t real_suffix_len) {
-	create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+	create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len,
+	       kBloomBitsPerKey, kEncodeKeys);
+    }
+
+    // bloom_bits_per_key > 0 adds a blocked Bloom filter over the full keys
+    // that lookupKey checks after the trie; range queries do not use it.
+    SuRF(const std::vector<std::string>& keys,
+	 const bool include_dense, const uint32_t sparse_dense_ratio,
+	 const SuffixType suffix_type, const level_t hash_suffix_len, const level_t real_suffix_len,
+	 const uint32_t bloom_bits_per_key) {
+	create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len,
+	       bloom_bits_per_key, kEncodeKeys);
+    }
+
+    // encode_keys builds the trie on order-preserving compressed keys
+    // (see KeyEncoder); queries encode their keys the same way. Iterator
+    // keys are then in the encoded space, longestPrefixMatch costs one
+    // lookupKey per candidate prefix, and the pattern queries cannot
+    // rule out any key (see enumeratePattern).
+    SuRF(const std::vector<std::string>& keys,
+	 const bool include_dense, const uint32_t sparse_dense_ratio,
+	 const SuffixType suffix_type, const level_t hash_suffix_len, const level_t real_suffix_len,
+	 const uint32_t bloom_bits_per_key, const bool encode_keys) {
+	create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len,
+	       bloom_bits_per_key, encode_keys);
+    }
+
+    // exact stores whole keys instead of their unique prefixes (no
+    // suffixes; suffix_type is ignored): lookupKey, lookupRange and the
+    // iterators are then exact, and iterator keys are the full keys.
+    SuRF(const std::vector<std::string>& keys,
+	 const bool include_dense, const uint32_t sparse_dense_ratio,
+	 const SuffixType suffix_type, const level_t hash_suffix_len, const level_t real_suffix_len,
+	 const uint32_t bloom_bits_per_key, const bool encode_keys, const bool exact) {
+	create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len,
+	       bloom_bits_per_key, encode_keys, exact);
+    }
+
+    // adaptive gives each level its own hash suffix length (kHash and
+    // kMixed), fitted to sample_queries (a sample of the expected
+    // queries) or, if it is empty, to the keys; see SuRFBuilder.
+    SuRF(const std::vector<std::string>& keys,
+	 const bool include_dense, const uint32_t sparse_dense_ratio,
+	 const SuffixType suffix_type, const level_t hash_suffix_len, const level_t real_suffix_len,
+	 const uint32_t bloom_bits_per_key, const bool encode_keys, const bool exact,
+	 const bool adaptive,
+	 const std::vector<std::string>& sample_queries = std::vector<std::string>()) {
+	create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len,
+	       bloom_bits_per_key, encode_keys, exact, kDenseRankBlockSize,
+	       kSparseSelectSampleInterval, kSuffixHash, adaptive, sample_queries);
     }
 
     ~SuRF() { destroy(); }
@@ -78,9 +147,55 @@ public:
     inline void create(const std::vector<std::string>& keys,
 		const bool include_dense, const uint32_t sparse_dense_ratio,
 		const SuffixType suffix_type,
-                const level_t hash_suffix_len, const level_t real_suffix_len);
-
-    inline bool lookupKey(const std::string& key) const;
+                const level_t hash_suffix_len, const level_t real_suffix_len,
+		const uint32_t bloom_bits_per_key, const bool encode_keys,
+		const bool exact = kExactKeys,
+		const position_t rank_block_size = kDenseRankBlockSize,
+		const position_t select_sample_interval = kSparseSelectSampleInterval,
+		const SuffixHash suffix_hash = kSuffixHash,
+		const bool adaptive = kAdaptiveHashSuffixes,
+		const std::vector<std::string>& sample_queries = std::vector<std::string>());
+
+    // Gives the LOUDS-Sparse nodes that sample_queries (a sample of the
+    // point query workload) visit most the LOUDS-Dense encoding, with
+    // at most 1/sparse_hot_ratio of the sparse memory; see
+    // LoudsSparse::promoteHotNodes. Only lookupKey uses them.
+    inline void promoteHotNodes(const std::vector<std::string>& sample_queries,
+				const uint32_t sparse_hot_ratio = kSparseDenseRatio);
+
+    // fp_probability (if not null) is set to an estimate of the probability
+    // that a positive answer is false, from how the answer was reached:
+    // 0 when the key ends at a stored prefix key, otherwise 2^-b for the b
+    // suffix bits that confirmed the truncated key (1 with none), scaled by
+    // the Bloom companion's rate. Useful for ordering I/O; not calibrated.
+    // It is 0 for negative answers.
+    // Lookup: see lookup_policy.hpp and SuRFSpecialized.
+    template <typename Lookup = DynamicLookup>
+    inline bool lookupKey(const std::string& key, double* fp_probability = nullptr) const;
+    // Returns the length of the longest prefix of key that lookupKey
+    // accepts, or 0 if there is none, in a single trie descent.
+    // Prefixes longer than the longest stored key are not candidates
+    // (unless the filter comes from a version 0 or 1 image), so that a
+    // long key costs at most that many suffix hashes per leaf.
+    // depth (if not null) is set to the number of key bytes matched
+    // before the query leaves the trie.
+    // With encoded keys, the encoded prefixes are not prefixes of the
+    // encoded key, so each prefix that the descent does not rule out is
+    // looked up, from the longest; depth counts the key bytes whose
+    // codes the trie matched.
+    inline level_t longestPrefixMatch(const std::string& key, level_t* depth = nullptr) const;
+    // Returns whether a stored key may fit pattern (see KeyPattern).
+    // Only the trie is consulted: a branch that terminates before the end
+    // of the pattern counts as a match. Always true with encoded keys,
+    // whose trie bytes are not key bytes.
+    inline bool lookupPattern(const KeyPattern& pattern) const;
+    // Appends, in sorted order, the stored prefixes that may fit pattern:
+    // the distinct key prefixes of pattern.size() bytes, or shorter
+    // truncated keys whose remaining bytes are unknown. Returns false,
+    // appending nothing, with encoded keys: their prefixes are not
+    // stored (see lookupPattern).
+    inline bool enumeratePattern(const KeyPattern& pattern,
+				 std::vector<std::string>& prefixes) const;
     // This function searches in a conservative way: if inclusive is true
     // and the stored key prefix matches key, iter stays at this key prefix.
     inline SuRF::Iter moveToKeyGreaterThan(const std::string& key, const bool inclusive) const;
@@ -89,6 +204,19 @@ public:
     inline SuRF::Iter moveToLast() const;
     inline bool lookupRange(const std::string& left_key, const bool left_inclusive,
 		     const std::string& right_key, const bool right_inclusive);
+    // Same as above, but also leaves iter at the first candidate key of the
+    // range: iter->getKeyWithSuffix() gives the stored prefix and
+    // iter->getFpFlag() whether the answer depends on missing suffix bits.
+    // An iter left by a previous call on this filter and not moved
+    // since is resumed without a new trie descent when left_key is not
+    // below that call's left key and iter already lies past left_key, so
+    // consecutive calls with ascending left keys can share one cursor.
+    // fp_probability: 0 when a stored key prefix lies strictly inside the
+    // range; otherwise the answer depends on a boundary prefix, which the
+    // real suffix bits (if any) confirmed, see lookupKey.
+    inline bool lookupRange(const std::string& left_key, const bool left_inclusive,
+			    const std::string& right_key, const bool right_inclusive,
+			    SuRF::Iter* iter, double* fp_probability = nullptr) const;
     // Accurate except at the boundaries --> undercount by at most 2
     inline uint64_t approxCount(const std::string& left_key, const std::string& right_key);
     inline uint64_t approxCount(const SuRF::Iter* iter, const SuRF::Iter* iter2);
@@ -97,38 +225,104 @@ public:
     inline uint64_t getMemoryUsage() const;
     inline level_t getHeight() const;
     inline level_t getSparseStartLevel() const;
+    bool isKeyEncoded() const { return encoder_->isEnabled(); };
+    bool isExact() const { return louds_sparse_->isExact(); };
+    SuffixType getSuffixType() const { return louds_sparse_->getSuffixType(); };
+    position_t getRankBlockSize() const { return louds_dense_->getRankBlockSize(); };
+    position_t getSelectSampleInterval() const {
+	return louds_sparse_->getSelectSampleInterval();
+    };
 
+    // The image starts with a header (see kSerializeMagic), so that
+    // filters written by other versions are recognized.
     char* serialize(char* buf) const {
 	uint64_t size = serializedSize();
 	//char* data = new char[size];
 	char* cur_data = buf;
+	writeUint32(cur_data, kSerializeMagic);
+	writeUint32(cur_data, kSerializeVersion);
+	writeUint32(cur_data, sizeof(position_t));
+	writeUint32(cur_data, max_key_len_);
 	louds_dense_->serialize(cur_data);
 	louds_sparse_->serialize(cur_data);
+	bloom_->serialize(cur_data);
+	encoder_->serialize(cur_data);
 	assert(cur_data - buf == (int64_t)size);
 	return cur_data;
     }
 
-    void deSerialize(const char*& src) {
+    // Reads an image of the current version, of version 1 (without the
+    // longest key length), or of version 0 (the unversioned layout with
+    // 32-bit positions, no layout flags, Bloom filter or key encoder).
+    // Returns false, leaving the filter empty, for a newer version or
+    // another position width.
+    bool deSerialize(const char*& src) {
+	destroy();
+	if (be32toh(*reinterpret_cast<const uint32_t*>(src)) != kSerializeMagic) {
+	    louds_dense_ = LoudsDense::deSerializeV0(src);
+	    louds_sparse_ = LoudsSparse::deSerializeV0(src);
+	    bloom_ = new BlockedBloom();
+	    encoder_ = new KeyEncoder();
+	    max_key_len_ = kUnknownKeyLen;
+	    return true;
+	}
+	const char* header = src + sizeof(uint32_t);
+	uint32_t version = readUint32(header);
+	uint32_t position_size = readUint32(header);
+	if ((version == 0) || (version > kSerializeVersion)
+	    || (position_size != sizeof(position_t)))
+	    return false;
+	max_key_len_ = (version > 1) ? readUint32(header) : kUnknownKeyLen;
+	src = header;
 	louds_dense_ = LoudsDense::deSerialize(src);
 	louds_sparse_ = LoudsSparse::deSerialize(src);
+	bloom_ = new BlockedBloom();
+	bloom_->deSerialize(src);
+	encoder_ = new KeyEncoder();
+	encoder_->deSerialize(src);
 	//surf->iter_ = SuRF::Iter(surf);
+	return true;
     }
 
-   private:
+    // Leaves the filter empty
     void destroy() {
         if(louds_dense_) {
             louds_dense_->destroy();
             delete louds_dense_;
+            louds_dense_ = nullptr;
         }
         if(louds_sparse_) {
             louds_sparse_->destroy();
             delete louds_sparse_;
+            louds_sparse_ = nullptr;
+        }
+        if(bloom_) {
+            bloom_->destroy();
+            delete bloom_;
+            bloom_ = nullptr;
+        }
+        if(encoder_) {
+            encoder_->destroy();
+            delete encoder_;
+            encoder_ = nullptr;
         }
     }
 
 private:
+    // magic, version, position width and longest key length
+    static const uint64_t kHeaderSize = 4 * sizeof(uint32_t);
+    static const level_t kUnknownKeyLen = UINT32_MAX;
+
+    inline bool matchPattern(const KeyPattern& pattern, std::vector<std::string>* prefixes) const;
+    // Returns key as stored in the trie: key itself, or its encoding in buf
+    inline const std::string& getTrieKey(const std::string& key, std::string& buf) const;
+
     LoudsDense* louds_dense_;
     LoudsSparse* louds_sparse_;
+    BlockedBloom* bloom_;
+    KeyEncoder* encoder_;
+    // of the input keys, before encoding
+    level_t max_key_len_;
     //SuRFBuilder* builder_;
     //SuRF::Iter iter_;
     //SuRF::Iter iter2_;
@@ -137,26 +331,170 @@ private:
 void SuRF::create(const std::vector<std::string>& keys, 
 		  const bool include_dense, const uint32_t sparse_dense_ratio,
 		  const SuffixType suffix_type,
-                  const level_t hash_suffix_len, const level_t real_suffix_len) {
+                  const level_t hash_suffix_len, const level_t real_suffix_len,
+		  const uint32_t bloom_bits_per_key, const bool encode_keys,
+		  const bool exact, const position_t rank_block_size,
+		  const position_t select_sample_interval, const SuffixHash suffix_hash,
+		  const bool adaptive, const std::vector<std::string>& sample_queries) {
     SuRFBuilder* builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio,
-                              suffix_type, hash_suffix_len, real_suffix_len);
-    builder_->build(keys);
-    louds_dense_ = new LoudsDense(builder_);
-    louds_sparse_ = new LoudsSparse(builder_);
+                              suffix_type, hash_suffix_len, real_suffix_len,
+					    adaptive, exact, suffix_hash);
+    max_key_len_ = 0;
+    for (position_t i = 0; i < keys.size(); i++)
+	max_key_len_ = std::max(max_key_len_, (level_t)keys[i].length());
+    if (encode_keys) {
+	encoder_ = new KeyEncoder(keys);
+	// encoding preserves the order, so the encoded keys stay sorted
+	std::vector<std::string> encoded_keys(keys.size());
+	for (position_t i = 0; i < keys.size(); i++)
+	    encoder_->encode(keys[i], encoded_keys[i]);
+	std::vector<std::string> encoded_queries(sample_queries.size());
+	for (position_t i = 0; i < sample_queries.size(); i++)
+	    encoder_->encode(sample_queries[i], encoded_queries[i]);
+	builder_->build(encoded_keys, encoded_queries);
+    } else {
+	encoder_ = new KeyEncoder();
+	builder_->build(keys, sample_queries);
+    }
+    louds_dense_ = new LoudsDense(builder_, kInterleaveDenseNodes, kDenseChildBases,
+				  kDenseRootStride, kSplitSuffixes, rank_block_size);
+    louds_sparse_ = new LoudsSparse(builder_, kInterleaveSparseNodes, kSparseChainMinLen,
+				    kSparseBitmapMinFanout, kSplitSuffixes, kSparseClusterBytes,
+				    select_sample_interval);
+    bloom_ = new BlockedBloom(keys, bloom_bits_per_key, suffix_hash);
     //iter_ = SuRF::Iter(this);
     delete builder_;
 }
 
-bool SuRF::lookupKey(const std::string& key) const {
+void SuRF::promoteHotNodes(const std::vector<std::string>& sample_queries,
+			   const uint32_t sparse_hot_ratio) {
+    std::vector<std::string> trie_keys;
+    std::vector<position_t> in_node_nums;
+    for (position_t i = 0; i < sample_queries.size(); i++) {
+	std::string buf;
+	const std::string& trie_key = getTrieKey(sample_queries[i], buf);
+	position_t connect_node_num = 0;
+	// only the queries that reach LOUDS-Sparse count
+	if (louds_dense_->lookupKey(trie_key, connect_node_num) && (connect_node_num != 0)) {
+	    trie_keys.push_back(trie_key);
+	    in_node_nums.push_back(connect_node_num);
+	}
+    }
+    louds_sparse_->promoteHotNodes(trie_keys, in_node_nums,
+				   louds_sparse_->getMemoryUsage() / sparse_hot_ratio);
+}
+
+const std::string& SuRF::getTrieKey(const std::string& key, std::string& buf) const {
+    if (!encoder_->isEnabled())
+	return key;
+    encoder_->encode(key, buf);
+    return buf;
+}
+
+template <typename Lookup>
+bool SuRF::lookupKey(const std::string& key, double* fp_probability) const {
+    position_t connect_node_num = 0;
+    if (fp_probability != nullptr)
+	*fp_probability = 1.0;
+    std::string buf;
+    const std::string& trie_key = getTrieKey(key, buf);
+    // the key is hashed at most once for the suffix check and the
+    // Bloom companion, unless it is encoded
+    PreparedKey prepared_trie_key(trie_key);
+    PreparedKey prepared_key(key);
+    const PreparedKey& bloom_key = (&trie_key == &key) ? prepared_trie_key : prepared_key;
+    // the Bloom companion is checked once the trie reached a leaf
+    if (!louds_dense_->lookupKey<Lookup>(prepared_trie_key, connect_node_num, fp_probability)
+	|| ((connect_node_num != 0)
+	    && !louds_sparse_->lookupKey<Lookup>(prepared_trie_key, connect_node_num,
+						 fp_probability))
+	|| !bloom_->lookupKey(bloom_key)) {
+	if (fp_probability != nullptr)
+	    *fp_probability = 0;
+	return false;
+    }
+    if (fp_probability != nullptr)
+	*fp_probability *= bloom_->fpRate();
+    return true;
+}
+
+level_t SuRF::longestPrefixMatch(const std::string& key, level_t* depth) const {
+    std::string buf;
+    const std::string& trie_key = getTrieKey(key, buf);
+    std::vector<PrefixRange> ranges;
+    level_t match_depth = 0;
     position_t connect_node_num = 0;
-    if (!louds_dense_->lookupKey(key, connect_node_num))
+    if (louds_dense_->longestPrefixMatch(trie_key, ranges, match_depth, connect_node_num)
+	&& (connect_node_num != 0))
+	louds_sparse_->longestPrefixMatch(trie_key, connect_node_num, ranges, match_depth);
+    if (encoder_->isEnabled()) {
+	if (depth != nullptr)
+	    *depth = encoder_->decodedLength(key, match_depth);
+	// an encoded prefix shares its whole bytes with trie_key, so it
+	// leaves the trie where trie_key does, unless it has fewer than
+	// match_depth + 1 of them or trie_key ended at a leaf (whose range
+	// runs to the end of trie_key)
+	level_t max_len = std::min((level_t)key.length(), max_key_len_);
+	if (ranges.empty() || (ranges.back().max_len < trie_key.length()))
+	    max_len = std::min(max_len, encoder_->decodedLength(key, match_depth + 1));
+	std::string prefix;
+	for (level_t len = max_len; len > 0; len--) {
+	    prefix.assign(key, 0, len);
+	    if (lookupKey(prefix))
+		return len;
+	}
+	return 0;
+    }
+    if (depth != nullptr)
+	*depth = match_depth;
+    // longest first: stop at the first prefix that passes both checks
+    std::string prefix;
+    for (int i = (int)ranges.size() - 1; i >= 0; i--) {
+	const PrefixRange& range = ranges[i];
+	// each candidate is hashed for the suffix and Bloom checks
+	level_t max_len = std::min(range.max_len, max_key_len_);
+	for (level_t len = max_len; len >= range.min_len; len--) {
+	    prefix.assign(key, 0, len);
+	    PreparedKey prepared_prefix(prefix);
+	    if (range.suffixes->checkEquality(range.idx, prepared_prefix, range.level)
+		&& (!bloom_->isEnabled() || bloom_->lookupKey(prepared_prefix)))
+		return len;
+	}
+    }
+    return 0;
+}
+
+bool SuRF::lookupPattern(const KeyPattern& pattern) const {
+    if (encoder_->isEnabled())
+	return true;
+    return matchPattern(pattern, nullptr);
+}
+
+bool SuRF::enumeratePattern(const KeyPattern& pattern,
+			    std::vector<std::string>& prefixes) const {
+    if (encoder_->isEnabled())
 	return false;
-    else if (connect_node_num != 0)
-	return louds_sparse_->lookupKey(key, connect_node_num);
+    position_t num_prefixes = prefixes.size();
+    matchPattern(pattern, &prefixes);
+    std::sort(prefixes.begin() + num_prefixes, prefixes.end());
     return true;
 }
 
-SuRF::Iter SuRF::moveToKeyGreaterThan(const std::string& key, const bool inclusive) const {
+bool SuRF::matchPattern(const KeyPattern& pattern, std::vector<std::string>* prefixes) const {
+    std::vector<position_t> node_nums;
+    std::vector<std::string> node_prefixes;
+    bool found = louds_dense_->matchPattern(pattern, prefixes, node_nums, node_prefixes);
+    for (position_t i = 0; i < node_nums.size(); i++) {
+	if (found && (prefixes == nullptr))
+	    return true;
+	found |= louds_sparse_->matchPattern(pattern, node_nums[i], node_prefixes[i], prefixes);
+    }
+    return found;
+}
+
+SuRF::Iter SuRF::moveToKeyGreaterThan(const std::string& in_key, const bool inclusive) const {
+    std::string buf;
+    const std::string& key = getTrieKey(in_key, buf);
     SuRF::Iter iter(this);
     iter.could_be_fp_ = louds_dense_->moveToKeyGreaterThan(key, inclusive, iter.dense_iter_);
 
@@ -181,17 +519,30 @@ SuRF::Iter SuRF::moveToKeyGreaterThan(const std::string& key, const bool inclusi
     return iter;
 }
 
-SuRF::Iter SuRF::moveToKeyLessThan(const std::string& key, const bool inclusive) const {
-    SuRF::Iter iter = moveToKeyGreaterThan(key, false);
-    if (!iter.isValid()) {
-	iter = moveToLast();
+SuRF::Iter SuRF::moveToKeyLessThan(const std::string& in_key, const bool inclusive) const {
+    std::string buf;
+    const std::string& key = getTrieKey(in_key, buf);
+    SuRF::Iter iter(this);
+    iter.could_be_fp_ = louds_dense_->moveToKeyLessThan(key, inclusive, iter.dense_iter_);
+
+    if (!iter.dense_iter_.isValid())
+	return iter;
+    if (iter.dense_iter_.isComplete())
+	return iter;
+
+    if (!iter.dense_iter_.isSearchComplete()) {
+	iter.passToSparse();
+	iter.could_be_fp_ = louds_sparse_->moveToKeyLessThan(key, inclusive, iter.sparse_iter_);
+	if (!iter.sparse_iter_.isValid() && (louds_dense_->getHeight() > 0))
+	    iter.decrementDenseIter();
+	return iter;
+    } else if (!iter.dense_iter_.isMoveRightComplete()) {
+	iter.passToSparse();
+	iter.sparse_iter_.moveToRightMostKey();
 	return iter;
     }
-    if (!iter.getFpFlag()) {
-	iter--;
-	if (lookupKey(key))
-	    iter--;
-    }
+
+    assert(false); // shouldn't reach here
     return iter;
 }
 
@@ -229,30 +580,57 @@ SuRF::Iter SuRF::moveToLast() const {
 
 bool SuRF::lookupRange(const std::string& left_key, const bool left_inclusive, 
 		       const std::string& right_key, const bool right_inclusive) {
-    //iter_.clear();
-    auto iter_ = SuRF::Iter(this);
-    louds_dense_->moveToKeyGreaterThan(left_key, left_inclusive, iter_.dense_iter_);
-    if (!iter_.dense_iter_.isValid()) return false;
-    if (!iter_.dense_iter_.isComplete()) {
-	if (!iter_.dense_iter_.isSearchComplete()) {
-	    iter_.passToSparse();
-	    louds_sparse_->moveToKeyGreaterThan(left_key, left_inclusive, iter_.sparse_iter_);
-	    if (!iter_.sparse_iter_.isValid()) {
-		iter_.incrementDenseIter();
-	    }
-	} else if (!iter_.dense_iter_.isMoveLeftComplete()) {
-	    iter_.passToSparse();
-	    iter_.sparse_iter_.moveToLeftMostKey();
-	}
+    SuRF::Iter iter;
+    return lookupRange(left_key, left_inclusive, right_key, right_inclusive, &iter);
+}
+
+bool SuRF::lookupRange(const std::string& left_key, const bool left_inclusive,
+		       const std::string& right_key, const bool right_inclusive,
+		       SuRF::Iter* iter, double* fp_probability) const {
+    int compare = kCouldBePositive;
+    if (fp_probability != nullptr)
+	*fp_probability = 0;
+    std::string left_buf, right_buf;
+    // the iterator compares against keys as stored in the trie
+    const std::string& left_trie_key = getTrieKey(left_key, left_buf);
+    const std::string& right_trie_key = getTrieKey(right_key, right_buf);
+    // iter is the first key past its seek key, so it is also the first
+    // key past any left key between the seek key and iter
+    bool resume = false;
+    if (iter->at_seek_ && (iter->filter_ == this) && iter->isValid()) {
+	int seek_compare = left_trie_key.compare(iter->seek_key_);
+	if ((seek_compare > 0)
+	    || ((seek_compare == 0) && (iter->seek_inclusive_ || !left_inclusive)))
+	    compare = iter->compare(left_trie_key);
+	resume = (compare != kCouldBePositive) && (compare > 0);
     }
-    if (!iter_.isValid()) return false;
-    int compare = iter_.compare(right_key);
+    if (resume) {
+	iter->could_be_fp_ = false; // iter is already past left_key
+    } else {
+	*iter = moveToKeyGreaterThan(left_key, left_inclusive);
+	iter->at_seek_ = true;
+	iter->seek_inclusive_ = left_inclusive;
+	iter->seek_key_ = left_trie_key;
+    }
+    if (!iter->isValid()) return false;
+    compare = iter->compare(right_trie_key);
+    bool key_exist;
     if (compare == kCouldBePositive)
-	return true;
-    if (right_inclusive)
-	return (compare <= 0);
+	key_exist = true;
+    else if (right_inclusive)
+	key_exist = (compare <= 0);
     else
-	return (compare < 0);
+	key_exist = (compare < 0);
+    // in exact mode, kCouldBePositive means the iter key equals right_key
+    if ((compare == kCouldBePositive) && isExact())
+	key_exist = right_inclusive;
+    if (key_exist && (fp_probability != nullptr) && !isExact()
+	&& (iter->getFpFlag() || (compare == kCouldBePositive))) {
+	word_t suffix = 0;
+	int num_checked_bits = iter->getSuffix(&suffix);
+	*fp_probability = (suffix == 0) ? 1.0 : ldexp(1.0, -num_checked_bits);
+    }
+    return key_exist;
 }
 
 uint64_t SuRF::approxCount(const SuRF::Iter* iter, const SuRF::Iter* iter2) {
@@ -283,13 +661,15 @@ uint64_t SuRF::approxCount(const std::string& left_key,
 }
 
 uint64_t SuRF::serializedSize() const {
-    if (louds_dense_ && louds_sparse_)
-        return (louds_dense_->serializedSize() + louds_sparse_->serializedSize());
+    if (louds_dense_ && louds_sparse_ && bloom_)
+        return (kHeaderSize + louds_dense_->serializedSize() + louds_sparse_->serializedSize()
+		+ bloom_->serializedSize() + encoder_->serializedSize());
     return 0;
 }
 
 uint64_t SuRF::getMemoryUsage() const {
-    return (sizeof(SuRF) + louds_dense_->getMemoryUsage() + louds_sparse_->getMemoryUsage());
+    return (sizeof(SuRF) + louds_dense_->getMemoryUsage() + louds_sparse_->getMemoryUsage()
+	    + bloom_->size() + encoder_->size());
 }
 
 level_t SuRF::getHeight() const {
@@ -303,6 +683,7 @@ level_t SuRF::getSparseStartLevel() const {
 //============================================================================
 
 void SuRF::Iter::clear() {
+    at_seek_ = false;
     dense_iter_.clear();
     sparse_iter_.clear();
 }
@@ -376,6 +757,7 @@ bool SuRF::Iter::incrementSparseIter() {
 }
 
 bool SuRF::Iter::operator ++(int) {
+    at_seek_ = false;
     if (!isValid()) 
 	return false;
     if (incrementSparseIter()) 
@@ -406,6 +788,7 @@ bool SuRF::Iter::decrementSparseIter() {
 }
 
 bool SuRF::Iter::operator --(int) {
+    at_seek_ = false;
     if (!isValid()) 
 	return false;
     if (decrementSparseIter()) 
@@ -2,8 +2,12 @@
 #define SURFBUILDER_H_
 
 #include <assert.h>
+#include <math.h>
 
+#include <algorithm>
+#include <queue>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "config.hpp"
@@ -14,12 +18,26 @@ namespace surf {
 
 class SuRFBuilder {
 public: 
-    SuRFBuilder() : sparse_start_level_(0), suffix_type_(kNone) {};
+    SuRFBuilder() : sparse_start_level_(0), suffix_type_(kNone), adaptive_hash_suffixes_(false),
+		    exact_(false), suffix_hash_(kSuffixHash) {};
+    // adaptive_hash_suffixes gives each level its own hash suffix length
+    // (kHash and kMixed only), within the bits that hash_suffix_len per
+    // key would take; see allocateHashSuffixLens.
+    // exact stores every key byte, so that each leaf ends its key and
+    // the trie is an exact set; suffixes are then useless and dropped.
+    // suffix_hash is the hash function of the hash suffixes.
     explicit SuRFBuilder(bool include_dense, uint32_t sparse_dense_ratio,
-			 SuffixType suffix_type, level_t hash_suffix_len, level_t real_suffix_len)
+			 SuffixType suffix_type, level_t hash_suffix_len, level_t real_suffix_len,
+			 bool adaptive_hash_suffixes = kAdaptiveHashSuffixes,
+			 bool exact = kExactKeys, SuffixHash suffix_hash = kSuffixHash)
 	: include_dense_(include_dense), sparse_dense_ratio_(sparse_dense_ratio),
-	  sparse_start_level_(0), suffix_type_(suffix_type),
-          hash_suffix_len_(hash_suffix_len), real_suffix_len_(real_suffix_len) {};
+	  sparse_start_level_(0), suffix_type_(exact ? kNone : suffix_type),
+          hash_suffix_len_(exact ? 0 : hash_suffix_len),
+	  real_suffix_len_(exact ? 0 : real_suffix_len),
+	  adaptive_hash_suffixes_(adaptive_hash_suffixes && !exact
+				  && ((suffix_type == kHash) || (suffix_type == kMixed))
+				  && (hash_suffix_len > 0)),
+	  exact_(exact), suffix_hash_(suffix_hash) {};
 
     ~SuRFBuilder() {};
 
@@ -28,6 +46,11 @@ public:
     // After build, the member vectors are used in SuRF constructor.
     // REQUIRED: provided key list must be sorted.
     inline void build(const std::vector<std::string>& keys);
+    // As above; with adaptive hash suffixes, the lengths are fitted to
+    // sample_queries (e.g., a sample of the negative queries expected)
+    // instead of to the keys themselves.
+    inline void build(const std::vector<std::string>& keys,
+		      const std::vector<std::string>& sample_queries);
 
     static bool readBit(const std::vector<word_t>& bits, const position_t pos) {
 	assert(pos < (bits.size() * kWordSize));
@@ -90,6 +113,25 @@ public:
     level_t getRealSuffixLen() const {
 	return real_suffix_len_;
     }
+    bool isExact() const {
+	return exact_;
+    }
+    SuffixHash getSuffixHash() const {
+	return suffix_hash_;
+    }
+    // Per-level hash suffix lengths, indexed like getSuffixCounts();
+    // empty unless the lengths are adaptive
+    const std::vector<level_t>& getHashSuffixLens() const {
+	return hash_suffix_lens_;
+    }
+    level_t getHashSuffixLen(const level_t level) const {
+	if (hash_suffix_lens_.empty())
+	    return hash_suffix_len_;
+	return hash_suffix_lens_[level];
+    }
+    level_t getSuffixLen(const level_t level) const {
+	return getHashSuffixLen(level) + real_suffix_len_;
+    }
 
 private:
     static bool isSameKey(const std::string& a, const std::string& b) {
@@ -98,7 +140,8 @@ private:
 
     // Fill in the LOUDS-Sparse vectors through a single scan
     // of the sorted key list.
-    inline void buildSparse(const std::vector<std::string>& keys);
+    inline void buildSparse(const std::vector<std::string>& keys,
+			    const std::vector<std::string>& sample_queries);
 
     // Walks down the current partially-filled trie by comparing key to
     // its previous key in the list until their prefixes do not match.
@@ -114,10 +157,29 @@ private:
     // This function is called after skipCommonPrefix. Therefore, it
     // guarantees that the stored prefix of key is unique in the trie.
     inline level_t insertKeyBytesToTrieUntilUnique(const std::string& key, const std::string& next_key, const level_t start_level);
+    // In exact mode, inserts the bytes of key after its unique prefix,
+    // one single-label node per byte; returns the new leaf level.
+    inline level_t insertRemainingKeyBytes(const std::string& key, const level_t start_level);
 
     // Fills in the suffix byte for key
     inline void insertSuffix(const std::string& key, const level_t level);
 
+    // Sets hash_suffix_lens_ from the leaf level (stored prefix length)
+    // of each distinct key.
+    // A query reaches a leaf, and needs its suffix to be rejected, if it
+    // shares the leaf's stored prefix. The number of sample queries that
+    // do so estimates the false positives at each level; without
+    // samples, the odd keys are run against a trie of the even ones and
+    // the per-leaf rates are scaled to the full trie.
+    // Bits then go, one at a time, to the level where they remove the
+    // most false positives per bit spent, until hash_suffix_len_ bits
+    // per key are used up.
+    inline void allocateHashSuffixLens(const std::vector<std::string>& keys,
+				       const std::vector<position_t>& leaf_key_ids,
+				       const std::vector<level_t>& leaf_levels,
+				       const std::vector<std::string>& sample_queries);
+    static inline level_t commonPrefixLen(const std::string& a, const std::string& b);
+
     inline bool isCharCommonPrefix(const label_t c, const level_t level) const;
     inline bool isLevelEmpty(const level_t level) const;
     inline void moveToNextItemSlot(const level_t level);
@@ -165,6 +227,10 @@ private:
     SuffixType suffix_type_;
     level_t hash_suffix_len_;
     level_t real_suffix_len_;
+    bool adaptive_hash_suffixes_;
+    bool exact_;
+    SuffixHash suffix_hash_;
+    std::vector<level_t> hash_suffix_lens_;
     std::vector<std::vector<word_t> > suffixes_;
     std::vector<position_t> suffix_counts_;
 
@@ -174,15 +240,25 @@ private:
 };
 
 void SuRFBuilder::build(const std::vector<std::string>& keys) {
+    build(keys, std::vector<std::string>());
+}
+
+void SuRFBuilder::build(const std::vector<std::string>& keys,
+			const std::vector<std::string>& sample_queries) {
     assert(keys.size() > 0);
-    buildSparse(keys);
+    buildSparse(keys, sample_queries);
     if (include_dense_) {
 	determineCutoffLevel();
 	buildDense();
     }
 }
 
-void SuRFBuilder::buildSparse(const std::vector<std::string>& keys) {
+void SuRFBuilder::buildSparse(const std::vector<std::string>& keys,
+			      const std::vector<std::string>& sample_queries) {
+    // with adaptive hash suffixes, the suffixes are stored once all the
+    // leaf levels are known
+    std::vector<position_t> leaf_key_ids;
+    std::vector<level_t> leaf_levels;
     for (position_t i = 0; i < keys.size(); i++) {
 	level_t level = skipCommonPrefix(keys[i]);	
 	position_t curpos = i;
@@ -192,10 +268,115 @@ void SuRFBuilder::buildSparse(const std::vector<std::string>& keys) {
 	    level = insertKeyBytesToTrieUntilUnique(keys[curpos], keys[i+1], level);
 	else // for last key, there is no successor key in the list
 	    level = insertKeyBytesToTrieUntilUnique(keys[curpos], std::string(), level);
-	insertSuffix(keys[curpos], level);
+	if (adaptive_hash_suffixes_) {
+	    if (level >= getTreeHeight())
+		addLevel();
+	    leaf_key_ids.push_back(curpos);
+	    leaf_levels.push_back(level);
+	} else {
+	    insertSuffix(keys[curpos], level);
+	}
+    }
+
+    if (adaptive_hash_suffixes_) {
+	allocateHashSuffixLens(keys, leaf_key_ids, leaf_levels, sample_queries);
+	for (position_t i = 0; i < leaf_key_ids.size(); i++)
+	    insertSuffix(keys[leaf_key_ids[i]], leaf_levels[i]);
     }
 }
 
+void SuRFBuilder::allocateHashSuffixLens(const std::vector<std::string>& keys,
+					 const std::vector<position_t>& leaf_key_ids,
+					 const std::vector<level_t>& leaf_levels,
+					 const std::vector<std::string>& sample_queries) {
+    position_t num_leaves = leaf_key_ids.size();
+    level_t height = getTreeHeight();
+    // lcps[i] = common prefix length of leaf keys i - 1 and i; 0 at the ends
+    std::vector<level_t> lcps(num_leaves + 1, 0);
+    for (position_t i = 1; i < num_leaves; i++)
+	lcps[i] = commonPrefixLen(keys[leaf_key_ids[i - 1]], keys[leaf_key_ids[i]]);
+
+    std::vector<uint64_t> leaf_counts(height, 0);
+    for (position_t i = 0; i < num_leaves; i++)
+	leaf_counts[leaf_levels[i] - 1]++;
+
+    // expected false positives at each level with no suffix bits
+    std::vector<double> fp_counts(height, 0);
+    if (!sample_queries.empty()) {
+	for (position_t i = 0; i < sample_queries.size(); i++) {
+	    const std::string& query = sample_queries[i];
+	    // first leaf key not less than query
+	    position_t lo = 0, hi = num_leaves;
+	    while (lo < hi) {
+		position_t mid = lo + (hi - lo) / 2;
+		if (keys[leaf_key_ids[mid]] < query)
+		    lo = mid + 1;
+		else
+		    hi = mid;
+	    }
+	    if ((lo < num_leaves) && isSameKey(keys[leaf_key_ids[lo]], query))
+		continue;
+	    if ((lo > 0) && (commonPrefixLen(keys[leaf_key_ids[lo - 1]], query) >= leaf_levels[lo - 1]))
+		fp_counts[leaf_levels[lo - 1] - 1]++;
+	    else if ((lo < num_leaves) && (commonPrefixLen(keys[leaf_key_ids[lo]], query) >= leaf_levels[lo]))
+		fp_counts[leaf_levels[lo] - 1]++;
+	}
+    } else {
+	// Leaf level of a key is 1 + its longest common prefix with a
+	// neighbor; in the even-key trie, the neighbors are 2 apart.
+	std::vector<level_t> even_levels(num_leaves, 0);
+	for (position_t i = 0; i < num_leaves; i += 2) {
+	    level_t lcp_prev = (i >= 2) ? std::min(lcps[i - 1], lcps[i]) : 0;
+	    level_t lcp_next = (i + 2 < num_leaves) ? std::min(lcps[i + 1], lcps[i + 2]) : 0;
+	    even_levels[i] = std::max(lcp_prev, lcp_next) + 1;
+	}
+	std::vector<double> even_leaf_counts(height, 0);
+	std::vector<double> even_fp_counts(height, 0);
+	for (position_t i = 0; i < num_leaves; i += 2)
+	    even_leaf_counts[even_levels[i] - 1]++;
+	for (position_t i = 1; i < num_leaves; i += 2) {
+	    if (lcps[i] >= even_levels[i - 1])
+		even_fp_counts[even_levels[i - 1] - 1]++;
+	    else if ((i + 1 < num_leaves) && (lcps[i + 1] >= even_levels[i + 1]))
+		even_fp_counts[even_levels[i + 1] - 1]++;
+	}
+	for (level_t level = 0; level < height; level++) {
+	    if (even_leaf_counts[level] > 0)
+		fp_counts[level] = leaf_counts[level] * even_fp_counts[level]
+		    / even_leaf_counts[level];
+	}
+    }
+
+    // Greedy by false positives removed per bit: a level whose leaves
+    // get b hash bits lets through (fp_count + 1) * 2^-b queries
+    level_t max_len = std::min((level_t)(kWordSize - kHashShift),
+			       (level_t)(kWordSize - real_suffix_len_));
+    hash_suffix_lens_.assign(height, 0);
+    uint64_t budget = (uint64_t)hash_suffix_len_ * num_leaves;
+    std::priority_queue<std::pair<double, level_t> > gains;
+    for (level_t level = 0; level < height; level++) {
+	if (leaf_counts[level] > 0)
+	    gains.push(std::make_pair((fp_counts[level] + 1) / 2 / leaf_counts[level], level));
+    }
+    while (!gains.empty()) {
+	level_t level = gains.top().second;
+	gains.pop();
+	if ((leaf_counts[level] > budget) || (hash_suffix_lens_[level] >= max_len))
+	    continue;
+	budget -= leaf_counts[level];
+	hash_suffix_lens_[level]++;
+	gains.push(std::make_pair(ldexp(fp_counts[level] + 1, -(hash_suffix_lens_[level] + 1))
+				  / leaf_counts[level], level));
+    }
+}
+
+level_t SuRFBuilder::commonPrefixLen(const std::string& a, const std::string& b) {
+    level_t len = 0;
+    while ((len < a.length()) && (len < b.length()) && (a[len] == b[len]))
+	len++;
+    return len;
+}
+
 level_t SuRFBuilder::skipCommonPrefix(const std::string& key) {
     level_t level = 0;
     while (level < key.length() && isCharCommonPrefix((label_t)key[level], level)) {
@@ -221,7 +402,7 @@ level_t SuRFBuilder::insertKeyBytesToTrieUntilUnique(const std::string& key, con
     level++;
     if (level > next_key.length()
 	|| !isSameKey(key.substr(0, level), next_key.substr(0, level)))
-	return level;
+	return (exact_ ? insertRemainingKeyBytes(key, level) : level);
 
     // All the following bytes inserted must be the start of a
     // new node.
@@ -240,6 +421,17 @@ level_t SuRFBuilder::insertKeyBytesToTrieUntilUnique(const std::string& key, con
     }
     level++;
 
+    return (exact_ ? insertRemainingKeyBytes(key, level) : level);
+}
+
+// A key that ends at a terminator is already complete: level is then
+// past its end.
+level_t SuRFBuilder::insertRemainingKeyBytes(const std::string& key, const level_t start_level) {
+    level_t level = start_level;
+    while (level < key.length()) {
+	insertKeyByte(key[level], level, true, false);
+	level++;
+    }
     return level;
 }
 
@@ -247,8 +439,9 @@ inline void SuRFBuilder::insertSuffix(const std::string& key, const level_t leve
     if (level >= getTreeHeight())
 	addLevel();
     assert(level - 1 < suffixes_.size());
-    word_t suffix_word = BitvectorSuffix::constructSuffix(suffix_type_, key, hash_suffix_len_,
-                                                          level, real_suffix_len_);
+    word_t suffix_word = BitvectorSuffix::constructSuffix(suffix_type_, key,
+							  getHashSuffixLen(level - 1),
+                                                          level, real_suffix_len_, suffix_hash_);
     storeSuffix(level, suffix_word);
 }
 
@@ -294,7 +487,11 @@ void SuRFBuilder::insertKeyByte(const char c, const level_t level, const bool is
 
 
 inline void SuRFBuilder::storeSuffix(const level_t level, const word_t suffix) {
-    level_t suffix_len = getSuffixLen();
+    level_t suffix_len = getSuffixLen(level - 1);
+    if (suffix_len == 0) {
+	suffix_counts_[level-1]++;
+	return;
+    }
     position_t pos = suffix_counts_[level-1] * suffix_len;
     assert(pos <= (suffixes_[level-1].size() * kWordSize));
     if (pos == (suffixes_[level-1].size() * kWordSize))
@@ -335,7 +532,7 @@ inline uint64_t SuRFBuilder::computeDenseMem(const level_t downto_level) const {
 	mem += (2 * kFanout * node_counts_[level]);
 	if (level > 0)
 	    mem += (node_counts_[level - 1] / 8 + 1);
-	mem += (suffix_counts_[level] * getSuffixLen() / 8);
+	mem += (suffix_counts_[level] * getSuffixLen(level) / 8);
     }
     return mem;
 }
@@ -345,7 +542,7 @@ inline uint64_t SuRFBuilder::computeSparseMem(const level_t start_level) const {
     for (level_t level = start_level; level < getTreeHeight(); level++) {
 	position_t num_items = labels_[level].size();
 	mem += (num_items + 2 * num_items / 8 + 1);
-	mem += (suffix_counts_[level] * getSuffixLen() / 8);
+	mem += (suffix_counts_[level] * getSuffixLen(level) / 8);
     }
     return mem;
 }
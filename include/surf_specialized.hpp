@@ -0,0 +1,117 @@
+#ifndef SURFSPECIALIZED_H_
+#define SURFSPECIALIZED_H_
+
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "lookup_policy.hpp"
+#include "surf.hpp"
+
+namespace surf {
+
+// A SuRF whose suffix type and directory parameters are template
+// arguments, so that lookupKey is compiled for this configuration only
+// (see StaticLookup). The other queries are those of SuRF.
+template <SuffixType kSuffixType,
+	  position_t kRankBlockSize = kDenseRankBlockSize,
+	  position_t kSelectSampleInterval = kSparseSelectSampleInterval>
+class SuRFSpecialized : public SuRF {
+public:
+    typedef StaticLookup<kSuffixType, kRankBlockSize, kSelectSampleInterval> Lookup;
+
+    SuRFSpecialized() : SuRF() {};
+    //------------------------------------------------------------------
+    // Input keys must be SORTED
+    //------------------------------------------------------------------
+    SuRFSpecialized(const std::vector<std::string>& keys,
+		    const level_t hash_suffix_len, const level_t real_suffix_len) {
+	// exact keys have no suffixes
+	create(keys, kIncludeDense, kSparseDenseRatio, kSuffixType,
+	       hash_suffix_len, real_suffix_len, kBloomBitsPerKey, kEncodeKeys,
+	       (kSuffixType == kNone) && kExactKeys, kRankBlockSize, kSelectSampleInterval);
+    }
+
+    // Whether surf has this configuration, e.g., before deSerialize
+    static bool matches(const SuRF& surf) {
+	return ((surf.getSuffixType() == kSuffixType)
+		&& ((surf.getRankBlockSize() == kRankBlockSize) || (surf.getRankBlockSize() == 0))
+		&& ((surf.getSelectSampleInterval() == kSelectSampleInterval)
+		    || (surf.getSelectSampleInterval() == 0)));
+    }
+
+    // Returns false, leaving the filter empty, also for an image of
+    // another configuration (see matches): the specialized lookupKey
+    // would misread its suffixes.
+    bool deSerialize(const char*& src) {
+	if (!SuRF::deSerialize(src))
+	    return false;
+	if (!matches(*this)) {
+	    destroy();
+	    return false;
+	}
+	return true;
+    }
+
+    bool lookupKey(const std::string& key, double* fp_probability = nullptr) const {
+	return SuRF::lookupKey<Lookup>(key, fp_probability);
+    }
+};
+
+// Type-erased point queries for callers that choose the configuration
+// at runtime: the specialized lookupKey matching surf (any suffix type,
+// default directory parameters) is picked once, and called through a
+// function pointer; other filters take the DynamicLookup path.
+// surf must outlive it.
+class SpecializedLookup {
+public:
+    explicit SpecializedLookup(const SuRF* surf) : surf_(surf) {
+	lookup_ = &lookupWith<DynamicLookup>;
+	is_specialized_ = true;
+	switch (surf->getSuffixType()) {
+	case kHash:
+	    pick<kHash>();
+	    break;
+	case kReal:
+	    pick<kReal>();
+	    break;
+	case kMixed:
+	    pick<kMixed>();
+	    break;
+	default:
+	    pick<kNone>();
+	}
+    }
+
+    bool lookupKey(const std::string& key, double* fp_probability = nullptr) const {
+	return lookup_(surf_, key, fp_probability);
+    }
+
+    bool isSpecialized() const {
+	return is_specialized_;
+    }
+
+private:
+    typedef bool (*LookupFunction)(const SuRF*, const std::string&, double*);
+
+    template <typename Lookup>
+    static bool lookupWith(const SuRF* surf, const std::string& key, double* fp_probability) {
+	return surf->lookupKey<Lookup>(key, fp_probability);
+    }
+
+    template <SuffixType kSuffixType>
+    void pick() {
+	if (SuRFSpecialized<kSuffixType>::matches(*surf_))
+	    lookup_ = &lookupWith<typename SuRFSpecialized<kSuffixType>::Lookup>;
+	else
+	    is_specialized_ = false;
+    }
+
+    const SuRF* surf_;
+    LookupFunction lookup_;
+    bool is_specialized_;
+};
+
+} // namespace surf
+
+#endif // SURFSPECIALIZED_H_
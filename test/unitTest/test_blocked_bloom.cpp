@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "blocked_bloom.hpp"
+#include "config.hpp"
+
+namespace surf {
+
+namespace blockedbloomtest {
+
+static const std::string kFilePath = "../../../test/words.txt";
+static const int kTestSize = 234369;
+static const uint64_t kIntTestBound = 1000001;
+static const uint64_t kIntTestSkip = 10;
+static const uint32_t kBitsPerKey = 10;
+static std::vector<std::string> words;
+
+class BlockedBloomUnitTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	data_ = nullptr;
+    }
+    virtual void TearDown () {
+	if (data_)
+	    delete[] data_;
+    }
+
+    void testSerialize();
+
+    BlockedBloom* bloom_;
+    char* data_;
+};
+
+void BlockedBloomUnitTest::testSerialize() {
+    uint64_t size = bloom_->serializedSize();
+    data_ = new char[size];
+    BlockedBloom* ori_bloom = bloom_;
+    char* data = data_;
+    ori_bloom->serialize(data);
+    ASSERT_EQ(size, (uint64_t)(data - data_));
+    const char* src = data_;
+    bloom_ = new BlockedBloom();
+    bloom_->deSerialize(src);
+
+    ASSERT_EQ(ori_bloom->numBlocks(), bloom_->numBlocks());
+    ASSERT_EQ(ori_bloom->numProbes(), bloom_->numProbes());
+
+    ori_bloom->destroy();
+    delete ori_bloom;
+}
+
+TEST_F (BlockedBloomUnitTest, disabledTest) {
+    bloom_ = new BlockedBloom(words, 0);
+    ASSERT_FALSE(bloom_->isEnabled());
+    ASSERT_TRUE(bloom_->lookupKey(std::string("not-a-word")));
+    bloom_->destroy();
+    delete bloom_;
+}
+
+TEST_F (BlockedBloomUnitTest, lookupWordTest) {
+    bloom_ = new BlockedBloom(words, kBitsPerKey);
+    for (unsigned i = 0; i < words.size(); i++)
+	ASSERT_TRUE(bloom_->lookupKey(words[i]));
+    bloom_->destroy();
+    delete bloom_;
+}
+
+TEST_F (BlockedBloomUnitTest, falsePositiveRateIntTest) {
+    std::vector<std::string> ints;
+    for (uint64_t i = 0; i < kIntTestBound; i += kIntTestSkip)
+	ints.push_back(uint64ToString(i));
+    bloom_ = new BlockedBloom(ints, kBitsPerKey);
+
+    uint64_t num_fp = 0;
+    uint64_t num_queries = 0;
+    for (uint64_t i = 0; i < kIntTestBound; i++) {
+	bool key_exist = bloom_->lookupKey(uint64ToString(i));
+	if (i % kIntTestSkip == 0) {
+	    ASSERT_TRUE(key_exist);
+	} else {
+	    num_queries++;
+	    if (key_exist)
+		num_fp++;
+	}
+    }
+    // a standard Bloom filter with 10 bits per key is just under 1%
+    ASSERT_LT((double)num_fp / num_queries, 0.02);
+    bloom_->destroy();
+    delete bloom_;
+}
+
+TEST_F (BlockedBloomUnitTest, serializeTest) {
+    bloom_ = new BlockedBloom(words, kBitsPerKey);
+    testSerialize();
+    for (unsigned i = 0; i < words.size(); i++)
+	ASSERT_TRUE(bloom_->lookupKey(words[i]));
+    bloom_->destroy();
+    delete bloom_;
+}
+
+void loadWordList() {
+    std::ifstream infile(kFilePath);
+    std::string key;
+    int count = 0;
+    while (infile.good() && count < kTestSize) {
+	infile >> key;
+	words.push_back(key);
+	count++;
+    }
+}
+
+} // namespace blockedbloomtest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    surf::blockedbloomtest::loadWordList();
+    return RUN_ALL_TESTS();
+}
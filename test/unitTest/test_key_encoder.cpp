@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "key_encoder.hpp"
+
+namespace surf {
+
+namespace keyencodertest {
+
+static const std::string kFilePath = "../../../test/words.txt";
+static const int kTestSize = 234369;
+static const uint64_t kIntTestBound = 1000001;
+static const uint64_t kIntTestSkip = 10;
+static std::vector<std::string> words;
+
+class KeyEncoderUnitTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	data_ = nullptr;
+    }
+    virtual void TearDown () {
+	if (data_)
+	    delete[] data_;
+    }
+
+    void testSerialize();
+
+    KeyEncoder* encoder_;
+    char* data_;
+};
+
+void KeyEncoderUnitTest::testSerialize() {
+    uint64_t size = encoder_->serializedSize();
+    data_ = new char[size];
+    KeyEncoder* ori_encoder = encoder_;
+    char* data = data_;
+    ori_encoder->serialize(data);
+    ASSERT_EQ(size, (uint64_t)(data - data_));
+    const char* src = data_;
+    encoder_ = new KeyEncoder();
+    encoder_->deSerialize(src);
+
+    ASSERT_EQ(ori_encoder->isEnabled(), encoder_->isEnabled());
+    for (unsigned i = 0; i < words.size(); i++)
+	ASSERT_EQ(ori_encoder->encode(words[i]), encoder_->encode(words[i]));
+
+    ori_encoder->destroy();
+    delete ori_encoder;
+}
+
+TEST_F (KeyEncoderUnitTest, disabledTest) {
+    encoder_ = new KeyEncoder();
+    ASSERT_FALSE(encoder_->isEnabled());
+    testSerialize();
+    ASSERT_FALSE(encoder_->isEnabled());
+    encoder_->destroy();
+    delete encoder_;
+}
+
+TEST_F (KeyEncoderUnitTest, orderWordTest) {
+    encoder_ = new KeyEncoder(words);
+    ASSERT_TRUE(encoder_->isEnabled());
+    uint64_t raw_len = 0, encoded_len = 0;
+    std::string prev_encoded = encoder_->encode(words[0]);
+    for (unsigned i = 1; i < words.size(); i++) {
+	std::string encoded = encoder_->encode(words[i]);
+	ASSERT_LT(prev_encoded, encoded);
+	// a key and its extensions
+	std::string extended = encoder_->encode(words[i] + (char)0);
+	ASSERT_LT(encoded, extended);
+	raw_len += words[i].length();
+	encoded_len += encoded.length();
+	prev_encoded = encoded;
+    }
+    // English words have far less than 8 bits of entropy per byte
+    ASSERT_LT(encoded_len, raw_len * 3 / 4);
+    encoder_->destroy();
+    delete encoder_;
+}
+
+TEST_F (KeyEncoderUnitTest, orderIntTest) {
+    std::vector<std::string> ints;
+    for (uint64_t i = 0; i < kIntTestBound; i += kIntTestSkip)
+	ints.push_back(uint64ToString(i));
+    encoder_ = new KeyEncoder(ints);
+    std::string prev_encoded = encoder_->encode(uint64ToString(0));
+    for (uint64_t i = 1; i < kIntTestBound; i++) {
+	std::string encoded = encoder_->encode(uint64ToString(i));
+	ASSERT_LT(prev_encoded, encoded);
+	prev_encoded = encoded;
+    }
+    // every byte value, seen in training or not, gets a code
+    for (unsigned c = 0; c < 256; c++)
+	ASSERT_GT(encoder_->codeLen((label_t)c), 0);
+    encoder_->destroy();
+    delete encoder_;
+}
+
+TEST_F (KeyEncoderUnitTest, serializeTest) {
+    encoder_ = new KeyEncoder(words);
+    testSerialize();
+    ASSERT_TRUE(encoder_->isEnabled());
+    encoder_->destroy();
+    delete encoder_;
+}
+
+void loadWordList() {
+    std::ifstream infile(kFilePath);
+    std::string key;
+    int count = 0;
+    while (infile.good() && count < kTestSize) {
+	infile >> key;
+	words.push_back(key);
+	count++;
+    }
+}
+
+} // namespace keyencodertest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    surf::keyencodertest::loadWordList();
+    return RUN_ALL_TESTS();
+}
@@ -187,6 +187,51 @@ TEST_F (LabelVectorUnitTest, searchAlgTest) {
     delete labels_;
 }
 
+TEST_F (LabelVectorUnitTest, searchOrderedAlgTest) {
+    setupWordsTest();
+    position_t start_pos = 0;
+    position_t search_len = 0;
+    for (level_t level = 0; level < builder_->getTreeHeight(); level++) {
+	for (position_t pos = 0; pos < builder_->getLabels()[level].size(); pos++) {
+	    bool louds_bit = SuRFBuilder::readBit(builder_->getLoudsBits()[level], pos);
+	    if (louds_bit && (search_len > 0)) {
+		for (unsigned target = 0; target < kFanout; target++) {
+		    // simd searches must agree with linear searches
+		    position_t simd_search_pos = start_pos;
+		    position_t linear_search_pos = start_pos;
+		    bool simd_search_success = labels_->simdSearchGreaterThan((label_t)target, simd_search_pos, search_len);
+		    bool linear_search_success = labels_->linearSearchGreaterThan((label_t)target, linear_search_pos, search_len);
+		    ASSERT_EQ(linear_search_success, simd_search_success);
+		    if (linear_search_success) {
+			ASSERT_EQ(linear_search_pos, simd_search_pos);
+		    }
+
+		    simd_search_pos = start_pos;
+		    linear_search_pos = start_pos;
+		    simd_search_success = labels_->simdSearchLessThan((label_t)target, simd_search_pos, search_len);
+		    linear_search_success = labels_->linearSearchLessThan((label_t)target, linear_search_pos, search_len);
+		    ASSERT_EQ(linear_search_success, simd_search_success);
+		    if (linear_search_success) {
+			ASSERT_EQ(linear_search_pos, simd_search_pos);
+		    }
+		}
+	    }
+	    if (louds_bit) {
+		start_pos += search_len;
+		search_len = 0;
+	    }
+
+	    if (builder_->getLabels()[level][pos] == kTerminator
+		&& !SuRFBuilder::readBit(builder_->getChildIndicatorBits()[level], pos))
+		start_pos++;
+	    else
+		search_len++;
+	}
+    }
+    labels_->destroy();
+    delete labels_;
+}
+
 TEST_F (LabelVectorUnitTest, searchTest) {
     setupWordsTest();
     testSearch();
@@ -248,6 +293,54 @@ TEST_F (LabelVectorUnitTest, searchGreaterThanTest) {
     }
 }
 
+TEST_F (LabelVectorUnitTest, searchLessThanTest) {
+    setupWordsTest();
+    position_t start_pos = 0;
+    position_t search_len = 0;
+    for (level_t level = 0; level < builder_->getTreeHeight(); level++) {
+	for (position_t pos = 0; pos < builder_->getLabels()[level].size(); pos++) {
+	    bool louds_bit = SuRFBuilder::readBit(builder_->getLoudsBits()[level], pos);
+	    if (louds_bit) {
+		position_t search_pos;
+		position_t terminator_offset = 0;
+		bool search_success;
+		for (position_t i = start_pos; i < start_pos + search_len; i++) {
+		    label_t cur_label = labels_->read(i);
+		    if (i == start_pos && cur_label == kTerminator && search_len > 1) {
+			terminator_offset = 1;
+			continue;
+		    }
+
+		    if (i > start_pos + terminator_offset) {
+			label_t prev_label = labels_->read(i-1);
+			// search existing label
+			search_pos = start_pos;
+			search_success = labels_->searchLessThan(cur_label, search_pos, search_len);
+			ASSERT_TRUE(search_success);
+			ASSERT_EQ(i-1, search_pos);
+
+			// search midpoint (could be non-existing label)
+			label_t test_label = cur_label - ((cur_label - prev_label) / 2);
+			search_pos = start_pos;
+			search_success = labels_->searchLessThan(test_label, search_pos, search_len);
+			ASSERT_TRUE(search_success);
+			ASSERT_EQ(i-1, search_pos);
+		    } else {
+			// search out-of-bound label
+			search_pos = start_pos;
+			search_success = labels_->searchLessThan(cur_label, search_pos, search_len);
+			ASSERT_FALSE(search_success);
+			ASSERT_EQ(start_pos + terminator_offset, search_pos);
+		    }
+		}
+		start_pos += search_len;
+		search_len = 0;
+	    }
+	    search_len++;
+	}
+    }
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
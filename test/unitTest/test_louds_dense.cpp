@@ -429,6 +429,173 @@ TEST_F (DenseUnitTest, approxCountIntTest) {
     delete louds_dense_;
 }
 
+TEST_F (DenseUnitTest, interleavedNodesWordTest) {
+    // larger levels take the split layout
+    ASSERT_TRUE(DenseNodeBlocks::fits(UINT32_MAX));
+    if (sizeof(position_t) > sizeof(uint32_t)) {
+	ASSERT_FALSE(DenseNodeBlocks::fits((position_t)UINT32_MAX + 1));
+    }
+    for (int t = 0; t < kNumSuffixType; t++) {
+	for (int k = 0; k < kNumSuffixLen; k++) {
+	    newBuilder(kSuffixTypeList[t], kSuffixLenList[k]);
+	    builder_->build(words);
+	    LoudsDense* louds_dense_split = new LoudsDense(builder_, false);
+	    louds_dense_ = new LoudsDense(builder_, true);
+	    ASSERT_TRUE(louds_dense_->isNodeInterleaved());
+	    testSerialize();
+	    ASSERT_TRUE(louds_dense_->isNodeInterleaved());
+	    testLookupWord();
+
+	    for (unsigned i = 0; i < words.size(); i += 7) {
+		std::string key = words[i];
+		key[key.length() - 1]++;
+		for (int inclusive = 0; inclusive < 2; inclusive++) {
+		    LoudsDense::Iter iter(louds_dense_);
+		    LoudsDense::Iter iter_split(louds_dense_split);
+		    bool could_be_fp = louds_dense_->moveToKeyGreaterThan(key, inclusive, iter);
+		    bool could_be_fp_split = louds_dense_split->moveToKeyGreaterThan(key, inclusive, iter_split);
+		    ASSERT_EQ(could_be_fp_split, could_be_fp);
+		    ASSERT_EQ(iter_split.isValid(), iter.isValid());
+		    ASSERT_EQ(iter_split.getKey(), iter.getKey());
+
+		    iter.clear();
+		    iter_split.clear();
+		    could_be_fp = louds_dense_->moveToKeyLessThan(key, inclusive, iter);
+		    could_be_fp_split = louds_dense_split->moveToKeyLessThan(key, inclusive, iter_split);
+		    ASSERT_EQ(could_be_fp_split, could_be_fp);
+		    ASSERT_EQ(iter_split.isValid(), iter.isValid());
+		    ASSERT_EQ(iter_split.getKey(), iter.getKey());
+		}
+	    }
+
+	    delete builder_;
+	    louds_dense_split->destroy();
+	    delete louds_dense_split;
+	    louds_dense_->destroy();
+	    delete louds_dense_;
+	}
+    }
+}
+
+TEST_F (DenseUnitTest, interleavedNodesIntTest) {
+    newBuilder(kReal, 8);
+    builder_->build(ints_);
+    LoudsDense* louds_dense_split = new LoudsDense(builder_, false);
+    louds_dense_ = new LoudsDense(builder_, true);
+    for (uint64_t i = 0; i < kIntTestBound; i++) {
+	position_t out_node_num = 0, out_node_num_split = 0;
+	ASSERT_EQ(louds_dense_split->lookupKey(uint64ToString(i), out_node_num_split),
+		  louds_dense_->lookupKey(uint64ToString(i), out_node_num));
+	ASSERT_EQ(out_node_num_split, out_node_num);
+    }
+
+    LoudsDense::Iter iter(louds_dense_);
+    LoudsDense::Iter iter_split(louds_dense_split);
+    louds_dense_->moveToKeyGreaterThan(uint64ToString(0), true, iter);
+    louds_dense_split->moveToKeyGreaterThan(uint64ToString(0), true, iter_split);
+    while (iter_split.isValid()) {
+	ASSERT_TRUE(iter.isValid());
+	ASSERT_EQ(iter_split.getKey(), iter.getKey());
+	iter++;
+	iter_split++;
+    }
+    ASSERT_FALSE(iter.isValid());
+
+    for (int j = 0; j < kIntTestBound; j += kIntTestBound / 16) {
+	LoudsDense::Iter iter_left(louds_dense_);
+	LoudsDense::Iter iter_right(louds_dense_);
+	louds_dense_->moveToKeyGreaterThan(uint64ToString(j / 2), true, iter_left);
+	louds_dense_->moveToKeyGreaterThan(uint64ToString(j), true, iter_right);
+	LoudsDense::Iter iter_left_split(louds_dense_split);
+	LoudsDense::Iter iter_right_split(louds_dense_split);
+	louds_dense_split->moveToKeyGreaterThan(uint64ToString(j / 2), true, iter_left_split);
+	louds_dense_split->moveToKeyGreaterThan(uint64ToString(j), true, iter_right_split);
+	position_t out_node_num_left = 0, out_node_num_right = 0;
+	position_t out_node_num_left_split = 0, out_node_num_right_split = 0;
+	ASSERT_EQ(louds_dense_split->approxCount(&iter_left_split, &iter_right_split,
+						 out_node_num_left_split, out_node_num_right_split),
+		  louds_dense_->approxCount(&iter_left, &iter_right,
+					    out_node_num_left, out_node_num_right));
+	ASSERT_EQ(out_node_num_left_split, out_node_num_left);
+	ASSERT_EQ(out_node_num_right_split, out_node_num_right);
+    }
+
+    delete builder_;
+    louds_dense_split->destroy();
+    delete louds_dense_split;
+    louds_dense_->destroy();
+    delete louds_dense_;
+}
+
+TEST_F (DenseUnitTest, childBasesIntTest) {
+    newBuilder(kReal, 8);
+    builder_->build(ints_);
+    LoudsDense* louds_dense_default = new LoudsDense(builder_, false, false);
+    louds_dense_ = new LoudsDense(builder_, false, true);
+    ASSERT_TRUE(louds_dense_->hasChildBases());
+    testSerialize();
+    ASSERT_TRUE(louds_dense_->hasChildBases());
+    for (uint64_t i = 0; i < kIntTestBound; i++) {
+	position_t out_node_num = 0, out_node_num_default = 0;
+	ASSERT_EQ(louds_dense_default->lookupKey(uint64ToString(i), out_node_num_default),
+		  louds_dense_->lookupKey(uint64ToString(i), out_node_num));
+	ASSERT_EQ(out_node_num_default, out_node_num);
+    }
+
+    LoudsDense::Iter iter(louds_dense_);
+    LoudsDense::Iter iter_default(louds_dense_default);
+    louds_dense_->moveToKeyGreaterThan(uint64ToString(0), true, iter);
+    louds_dense_default->moveToKeyGreaterThan(uint64ToString(0), true, iter_default);
+    while (iter_default.isValid()) {
+	ASSERT_TRUE(iter.isValid());
+	ASSERT_EQ(iter_default.getKey(), iter.getKey());
+	iter++;
+	iter_default++;
+    }
+    ASSERT_FALSE(iter.isValid());
+
+    delete builder_;
+    louds_dense_default->destroy();
+    delete louds_dense_default;
+    louds_dense_->destroy();
+    delete louds_dense_;
+}
+
+TEST_F (DenseUnitTest, rootStrideTest) {
+    newBuilder(kReal, 8);
+    builder_->build(words);
+    LoudsDense* louds_dense_default = new LoudsDense(builder_, false, false, false);
+    louds_dense_ = new LoudsDense(builder_, false, false, true);
+    ASSERT_TRUE(louds_dense_->hasRootStride());
+    testSerialize();
+    ASSERT_TRUE(louds_dense_->hasRootStride());
+    for (unsigned i = 0; i < words.size(); i++) {
+	// also the keys that end or diverge at levels 0 to 2
+	for (unsigned j = 1; j <= 3 && j <= words[i].length(); j++) {
+	    std::string key = words[i].substr(0, j);
+	    position_t out_node_num = 0, out_node_num_default = 0;
+	    ASSERT_EQ(louds_dense_default->lookupKey(key, out_node_num_default),
+		      louds_dense_->lookupKey(key, out_node_num));
+	    ASSERT_EQ(out_node_num_default, out_node_num);
+	    key[j - 1] = (char)(key[j - 1] + 1);
+	    out_node_num = out_node_num_default = 0;
+	    ASSERT_EQ(louds_dense_default->lookupKey(key, out_node_num_default),
+		      louds_dense_->lookupKey(key, out_node_num));
+	    ASSERT_EQ(out_node_num_default, out_node_num);
+	}
+	position_t out_node_num = 0, out_node_num_default = 0;
+	ASSERT_EQ(louds_dense_default->lookupKey(words[i], out_node_num_default),
+		  louds_dense_->lookupKey(words[i], out_node_num));
+	ASSERT_EQ(out_node_num_default, out_node_num);
+    }
+
+    delete builder_;
+    louds_dense_default->destroy();
+    delete louds_dense_default;
+    louds_dense_->destroy();
+    delete louds_dense_;
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
@@ -2,6 +2,7 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -44,6 +45,8 @@ public:
     void fillinInts();
     void testSerialize();
     void testLookupWord();
+    void testLayoutVariant(const std::vector<std::string>& keys,
+			   const std::vector<std::string>& queries, const unsigned step);
 
     SuRFBuilder* builder_;
     LoudsSparse* louds_sparse_;
@@ -123,6 +126,45 @@ void SparseUnitTest::testSerialize() {
     delete ori_louds_sparse;
 }
 
+// louds_sparse_, built from builder_ with some layout options, must
+// answer as the plain layout on every step-th query: on its prefixes,
+// an extension, and each of these with its last byte changed. It is
+// then replaced by its serialized copy, which must find the keys.
+void SparseUnitTest::testLayoutVariant(const std::vector<std::string>& keys,
+				       const std::vector<std::string>& queries,
+				       const unsigned step) {
+    LoudsSparse* louds_sparse_plain = new LoudsSparse(builder_, false, 0, 0, false, 0);
+    position_t in_node_num = 0;
+    for (unsigned i = 0; i < queries.size(); i += step) {
+	for (unsigned j = 1; j <= queries[i].length() + 1; j++) {
+	    std::string key = queries[i].substr(0, j);
+	    if (j > queries[i].length())
+		key.push_back('s');
+	    double fp_probability = 1.0, fp_probability_plain = 1.0;
+	    ASSERT_EQ(louds_sparse_plain->lookupKey(key, in_node_num, &fp_probability_plain),
+		      louds_sparse_->lookupKey(key, in_node_num, &fp_probability));
+	    ASSERT_EQ(fp_probability_plain, fp_probability);
+	    key[j - 1] = (char)(key[j - 1] + 1);
+	    ASSERT_EQ(louds_sparse_plain->lookupKey(key, in_node_num),
+		      louds_sparse_->lookupKey(key, in_node_num));
+	}
+    }
+    louds_sparse_plain->destroy();
+    delete louds_sparse_plain;
+
+    uint64_t size = louds_sparse_->serializedSize();
+    data_ = new char[size];
+    char* dst = data_;
+    louds_sparse_->serialize(dst);
+    ASSERT_EQ(size, (uint64_t)(dst - data_));
+    const char* src = data_;
+    louds_sparse_->destroy();
+    delete louds_sparse_;
+    louds_sparse_ = LoudsSparse::deSerialize(src);
+    for (unsigned i = 0; i < keys.size(); i++)
+	ASSERT_TRUE(louds_sparse_->lookupKey(keys[i], in_node_num));
+}
+
 void SparseUnitTest::testLookupWord() {
     position_t in_node_num = 0;
     for (unsigned i = 0; i < words.size(); i++) {
@@ -278,6 +320,52 @@ TEST_F (SparseUnitTest, moveToKeyGreaterThanIntTest) {
     delete louds_sparse_;
 }
 
+TEST_F (SparseUnitTest, moveToKeyLessThanWordTest) {
+    for (int t = 0; t < kNumSuffixType; t++) {
+	for (int k = 0; k < kNumSuffixLen; k++) {
+	    newBuilder(kSuffixTypeList[t], kSuffixLenList[k]);
+	    builder_->build(words);
+	    louds_sparse_ = new LoudsSparse(builder_);
+
+	    bool inclusive = true;
+	    for (int i = 0; i < 2; i++) {
+		if (i == 1)
+		    inclusive = false;
+		for (unsigned j = 1; j < words.size(); j++) {
+		    LoudsSparse::Iter iter(louds_sparse_);
+		    bool could_be_fp = louds_sparse_->moveToKeyLessThan(words[j], inclusive, iter);
+
+		    ASSERT_TRUE(iter.isValid());
+		    std::string iter_key = iter.getKey();
+		    std::string word_prefix_fp = words[j].substr(0, iter_key.length());
+		    std::string word_prefix_true = words[j-1].substr(0, iter_key.length());
+		    bool is_prefix = false;
+		    if (could_be_fp)
+			is_prefix = (word_prefix_fp.compare(iter_key) == 0);
+		    else
+			is_prefix = (word_prefix_true.compare(iter_key) == 0);
+		    ASSERT_TRUE(is_prefix);
+		}
+
+		LoudsSparse::Iter iter(louds_sparse_);
+		bool could_be_fp = louds_sparse_->moveToKeyLessThan(words[0], inclusive, iter);
+		if (could_be_fp) {
+		    std::string iter_key = iter.getKey();
+		    std::string word_prefix_fp = words[0].substr(0, iter_key.length());
+		    bool is_prefix = (word_prefix_fp.compare(iter_key) == 0);
+		    ASSERT_TRUE(is_prefix);
+		} else {
+		    ASSERT_FALSE(iter.isValid());
+		}
+	    }
+
+	    delete builder_;
+	    louds_sparse_->destroy();
+	    delete louds_sparse_;
+	}
+    }
+}
+
 TEST_F (SparseUnitTest, IteratorIncrementWordTest) {
     newBuilder(kReal, 8);
     builder_->build(words);
@@ -444,6 +532,270 @@ TEST_F (SparseUnitTest, approxCountIntTest) {
     delete louds_sparse_;
 }
 
+TEST_F (SparseUnitTest, interleavedNodesWordTest) {
+    // larger levels take the split layout
+    ASSERT_TRUE(SparseNodeBlocks::fits(UINT32_MAX));
+    if (sizeof(position_t) > sizeof(uint32_t)) {
+	ASSERT_FALSE(SparseNodeBlocks::fits((position_t)UINT32_MAX + 1));
+    }
+    for (int t = 0; t < kNumSuffixType; t++) {
+	for (int k = 0; k < kNumSuffixLen; k++) {
+	    newBuilder(kSuffixTypeList[t], kSuffixLenList[k]);
+	    builder_->build(words);
+	    LoudsSparse* louds_sparse_split = new LoudsSparse(builder_, false);
+	    louds_sparse_ = new LoudsSparse(builder_, true);
+	    ASSERT_TRUE(louds_sparse_->isNodeInterleaved());
+	    testSerialize();
+	    ASSERT_TRUE(louds_sparse_->isNodeInterleaved());
+	    testLookupWord();
+
+	    for (unsigned i = 0; i < words.size(); i += 7) {
+		std::string key = words[i];
+		key[key.length() - 1]++;
+		for (int inclusive = 0; inclusive < 2; inclusive++) {
+		    LoudsSparse::Iter iter(louds_sparse_);
+		    LoudsSparse::Iter iter_split(louds_sparse_split);
+		    bool could_be_fp = louds_sparse_->moveToKeyGreaterThan(key, inclusive, iter);
+		    bool could_be_fp_split = louds_sparse_split->moveToKeyGreaterThan(key, inclusive, iter_split);
+		    ASSERT_EQ(could_be_fp_split, could_be_fp);
+		    ASSERT_EQ(iter_split.isValid(), iter.isValid());
+		    ASSERT_EQ(iter_split.getKey(), iter.getKey());
+
+		    iter.clear();
+		    iter_split.clear();
+		    could_be_fp = louds_sparse_->moveToKeyLessThan(key, inclusive, iter);
+		    could_be_fp_split = louds_sparse_split->moveToKeyLessThan(key, inclusive, iter_split);
+		    ASSERT_EQ(could_be_fp_split, could_be_fp);
+		    ASSERT_EQ(iter_split.isValid(), iter.isValid());
+		    ASSERT_EQ(iter_split.getKey(), iter.getKey());
+		}
+	    }
+
+	    delete builder_;
+	    louds_sparse_split->destroy();
+	    delete louds_sparse_split;
+	    louds_sparse_->destroy();
+	    delete louds_sparse_;
+	}
+    }
+}
+
+TEST_F (SparseUnitTest, interleavedNodesIntTest) {
+    // sparse-only, so that node 0 is the root
+    builder_ = new SuRFBuilder(false, kSparseDenseRatio, kReal, 0, 8);
+    builder_->build(ints_);
+    LoudsSparse* louds_sparse_split = new LoudsSparse(builder_, false);
+    louds_sparse_ = new LoudsSparse(builder_, true);
+    position_t in_node_num = 0;
+    for (uint64_t i = 0; i < kIntTestBound; i++) {
+	ASSERT_EQ(louds_sparse_split->lookupKey(uint64ToString(i), in_node_num),
+		  louds_sparse_->lookupKey(uint64ToString(i), in_node_num));
+    }
+
+    LoudsSparse::Iter iter(louds_sparse_);
+    LoudsSparse::Iter iter_split(louds_sparse_split);
+    louds_sparse_->moveToKeyGreaterThan(uint64ToString(0), true, iter);
+    louds_sparse_split->moveToKeyGreaterThan(uint64ToString(0), true, iter_split);
+    while (iter_split.isValid()) {
+	ASSERT_TRUE(iter.isValid());
+	ASSERT_EQ(iter_split.getKey(), iter.getKey());
+	iter++;
+	iter_split++;
+    }
+    ASSERT_FALSE(iter.isValid());
+
+    LoudsSparse::Iter iter_left(louds_sparse_);
+    LoudsSparse::Iter iter_right(louds_sparse_);
+    louds_sparse_->moveToKeyGreaterThan(uint64ToString(kIntTestBound / 4), true, iter_left);
+    louds_sparse_->moveToKeyGreaterThan(uint64ToString(3 * kIntTestBound / 4), true, iter_right);
+    LoudsSparse::Iter iter_left_split(louds_sparse_split);
+    LoudsSparse::Iter iter_right_split(louds_sparse_split);
+    louds_sparse_split->moveToKeyGreaterThan(uint64ToString(kIntTestBound / 4), true, iter_left_split);
+    louds_sparse_split->moveToKeyGreaterThan(uint64ToString(3 * kIntTestBound / 4), true, iter_right_split);
+    ASSERT_EQ(louds_sparse_split->approxCount(&iter_left_split, &iter_right_split, 0, 0),
+	      louds_sparse_->approxCount(&iter_left, &iter_right, 0, 0));
+
+    delete builder_;
+    louds_sparse_split->destroy();
+    delete louds_sparse_split;
+    louds_sparse_->destroy();
+    delete louds_sparse_;
+}
+
+TEST_F (SparseUnitTest, singleChildChainsTest) {
+    // long shared prefixes produce chains of single-child nodes
+    std::vector<std::string> keys, queries;
+    for (unsigned i = 0; i < words.size(); i++) {
+	queries.push_back("com.gmail@" + words[i]);
+	if (i % 7 == 0)
+	    keys.push_back(queries.back());
+    }
+    builder_ = new SuRFBuilder(false, kSparseDenseRatio, kReal, 0, 8);
+    builder_->build(keys);
+    louds_sparse_ = new LoudsSparse(builder_, false, 2);
+    position_t num_chains = louds_sparse_->numChains();
+    ASSERT_TRUE(num_chains > 0);
+
+    // including keys that end or diverge inside a chain
+    testLayoutVariant(keys, queries, 3);
+    ASSERT_EQ(num_chains, louds_sparse_->numChains());
+
+    delete builder_;
+    louds_sparse_->destroy();
+    delete louds_sparse_;
+}
+
+TEST_F (SparseUnitTest, nodeBitmapsTest) {
+    builder_ = new SuRFBuilder(false, kSparseDenseRatio, kReal, 0, 8);
+    builder_->build(words);
+    LoudsSparse* louds_sparse_plain = new LoudsSparse(builder_, false, 0, 0);
+    louds_sparse_ = new LoudsSparse(builder_, false, 0, 4);
+    ASSERT_EQ(0, louds_sparse_plain->numBitmapNodes());
+    ASSERT_TRUE(louds_sparse_->numBitmapNodes() > 0);
+
+    position_t in_node_num = 0;
+    for (unsigned i = 0; i < words.size(); i += 5) {
+	for (unsigned j = 1; j <= words[i].length(); j++) {
+	    std::string key = words[i].substr(0, j);
+	    ASSERT_EQ(louds_sparse_plain->lookupKey(key, in_node_num),
+		      louds_sparse_->lookupKey(key, in_node_num));
+	    key[j - 1] = (char)(key[j - 1] + 1);
+	    ASSERT_EQ(louds_sparse_plain->lookupKey(key, in_node_num),
+		      louds_sparse_->lookupKey(key, in_node_num));
+
+	    for (int k = 0; k < 2; k++) {
+		bool inclusive = (k == 0);
+		LoudsSparse::Iter iter(louds_sparse_);
+		LoudsSparse::Iter iter_plain(louds_sparse_plain);
+		louds_sparse_->moveToKeyGreaterThan(key, inclusive, iter);
+		louds_sparse_plain->moveToKeyGreaterThan(key, inclusive, iter_plain);
+		ASSERT_EQ(iter_plain.isValid(), iter.isValid());
+		if (iter.isValid()) {
+		    ASSERT_EQ(iter_plain.getKey(), iter.getKey());
+		}
+
+		LoudsSparse::Iter iter_less(louds_sparse_);
+		LoudsSparse::Iter iter_less_plain(louds_sparse_plain);
+		louds_sparse_->moveToKeyLessThan(key, inclusive, iter_less);
+		louds_sparse_plain->moveToKeyLessThan(key, inclusive, iter_less_plain);
+		ASSERT_EQ(iter_less_plain.isValid(), iter_less.isValid());
+		if (iter_less.isValid()) {
+		    ASSERT_EQ(iter_less_plain.getKey(), iter_less.getKey());
+		}
+	    }
+	}
+    }
+
+    delete builder_;
+    louds_sparse_plain->destroy();
+    delete louds_sparse_plain;
+    louds_sparse_->destroy();
+    delete louds_sparse_;
+}
+
+TEST_F (SparseUnitTest, subtreeClustersTest) {
+    builder_ = new SuRFBuilder(false, kSparseDenseRatio, kMixed, 4, 4);
+    builder_->build(words);
+    louds_sparse_ = new LoudsSparse(builder_, false, 0, 0, false, 256);
+    ASSERT_TRUE(louds_sparse_->hasClusters());
+
+    testLayoutVariant(words, words, 3);
+    ASSERT_TRUE(louds_sparse_->hasClusters());
+
+    delete builder_;
+    louds_sparse_->destroy();
+    delete louds_sparse_;
+}
+
+TEST_F (SparseUnitTest, hotNodesTest) {
+    builder_ = new SuRFBuilder(false, kSparseDenseRatio, kMixed, 4, 4);
+    builder_->build(words);
+    louds_sparse_ = new LoudsSparse(builder_, false, 0, 0, false, 0);
+    uint64_t plain_memory = louds_sparse_->getMemoryUsage();
+    std::vector<std::string> sample_queries;
+    for (unsigned i = 0; i < words.size(); i += 5)
+	sample_queries.push_back(words[i]);
+    std::vector<position_t> in_node_nums(sample_queries.size(), 0);
+
+    // the budget bounds the number of hot nodes
+    louds_sparse_->promoteHotNodes(sample_queries, in_node_nums, 100000);
+    position_t num_hot_nodes = louds_sparse_->numHotNodes();
+    ASSERT_GT(num_hot_nodes, 0u);
+    ASSERT_LE(louds_sparse_->getMemoryUsage(), plain_memory + 100000);
+    louds_sparse_->promoteHotNodes(sample_queries, in_node_nums, 1 << 30);
+    ASSERT_GT(louds_sparse_->numHotNodes(), num_hot_nodes);
+    num_hot_nodes = louds_sparse_->numHotNodes();
+
+    testLayoutVariant(words, words, 1);
+    ASSERT_EQ(num_hot_nodes, louds_sparse_->numHotNodes());
+
+    delete builder_;
+    louds_sparse_->destroy();
+    delete louds_sparse_;
+}
+
+TEST_F (SparseUnitTest, adaptiveHashSuffixesTest) {
+    std::vector<std::string> keys;
+    std::vector<std::string> probes;
+    for (unsigned i = 0; i < words.size(); i += 2)
+	keys.push_back(words[i]);
+    // short probes end at shallow leaves, unlike the keys
+    for (unsigned i = 1; i < words.size(); i += 2) {
+	std::string probe = words[i].substr(0, 4);
+	if (!std::binary_search(keys.begin(), keys.end(), probe))
+	    probes.push_back(probe);
+    }
+    std::vector<std::string> sample_probes;
+    std::vector<std::string> test_probes;
+    for (unsigned i = 0; i < probes.size(); i++) {
+	if (i % 2 == 0)
+	    sample_probes.push_back(probes[i]);
+	else
+	    test_probes.push_back(probes[i]);
+    }
+
+    const level_t hash_suffix_len = 2;
+    builder_ = new SuRFBuilder(false, kSparseDenseRatio, kHash, hash_suffix_len, 0, false);
+    builder_->build(keys);
+    ASSERT_TRUE(builder_->getHashSuffixLens().empty());
+    LoudsSparse* louds_sparse_uniform = new LoudsSparse(builder_);
+    delete builder_;
+    builder_ = new SuRFBuilder(false, kSparseDenseRatio, kHash, hash_suffix_len, 0, true);
+    builder_->build(keys, sample_probes);
+    ASSERT_FALSE(builder_->getHashSuffixLens().empty());
+    louds_sparse_ = new LoudsSparse(builder_);
+
+    // within the suffix bits of the uniform lengths
+    uint64_t num_suffix_bits = 0;
+    uint64_t num_suffixes = 0;
+    for (level_t level = 0; level < builder_->getTreeHeight(); level++) {
+	num_suffix_bits += builder_->getSuffixCounts()[level] * builder_->getHashSuffixLen(level);
+	num_suffixes += builder_->getSuffixCounts()[level];
+    }
+    ASSERT_TRUE(num_suffix_bits <= num_suffixes * hash_suffix_len);
+
+    testSerialize();
+    position_t in_node_num = 0;
+    for (unsigned i = 0; i < keys.size(); i++)
+	ASSERT_TRUE(louds_sparse_->lookupKey(keys[i], in_node_num));
+
+    uint64_t num_fp_uniform = 0;
+    uint64_t num_fp = 0;
+    for (unsigned i = 0; i < test_probes.size(); i++) {
+	if (louds_sparse_uniform->lookupKey(test_probes[i], in_node_num))
+	    num_fp_uniform++;
+	if (louds_sparse_->lookupKey(test_probes[i], in_node_num))
+	    num_fp++;
+    }
+    ASSERT_TRUE(num_fp < num_fp_uniform);
+
+    delete builder_;
+    louds_sparse_uniform->destroy();
+    delete louds_sparse_uniform;
+    louds_sparse_->destroy();
+    delete louds_sparse_;
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
@@ -144,6 +144,25 @@ TEST_F (RankUnitTest, serializeTest) {
     testRank();
 }
 
+TEST_F (RankUnitTest, popcountLinearKernelsTest) {
+    static const int kNumWords = 20;
+    uint64_t bits[kNumWords];
+    uint64_t word = 0x0123456789ABCDEFULL;
+    for (int i = 0; i < kNumWords; i++) {
+	word = word * 6364136223846793005ULL + 1442695040888963407ULL;
+	bits[i] = word;
+    }
+    for (uint64_t x = 0; x < 4; x++) {
+	for (uint64_t nbits = 0; nbits <= (kNumWords - x) * 64; nbits++) {
+	    uint64_t expected = popcountLinear_scalar(bits, x, nbits);
+	    ASSERT_EQ(expected, popcountLinear(bits, x, nbits));
+	    if (cpuFeatures().has_avx512_popcount) {
+		ASSERT_EQ(expected, popcountLinear_avx512(bits, x, nbits));
+	    }
+	}
+    }
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
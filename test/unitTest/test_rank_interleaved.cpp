@@ -0,0 +1,141 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "rank.hpp"
+#include "rank_interleaved.hpp"
+#include "surf_builder.hpp"
+
+namespace surf {
+
+namespace rankinterleavedtest {
+
+static const std::string kFilePath = "../../../test/words.txt";
+static const int kTestSize = 234369;
+static std::vector<std::string> words;
+
+class RankInterleavedUnitTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	bool include_dense = false;
+	uint32_t sparse_dense_ratio = 0;
+	level_t suffix_len = 8;
+	builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, kReal, 0, suffix_len);
+	data_ = nullptr;
+	num_items_ = 0;
+    }
+    virtual void TearDown () {
+	delete builder_;
+	if (data_)
+	    delete[] data_;
+    }
+
+    void setupWordsTest();
+    void testSerialize();
+    void testRank();
+
+    static const position_t kRankBasicBlockSize = 512;
+
+    SuRFBuilder* builder_;
+    BitvectorRankInterleaved* bv_;
+    BitvectorRank* expected_bv_;
+    std::vector<position_t> num_items_per_level_;
+    position_t num_items_;
+    char* data_;
+};
+
+void RankInterleavedUnitTest::setupWordsTest() {
+    builder_->build(words);
+    for (level_t level = 0; level < builder_->getTreeHeight(); level++)
+	num_items_per_level_.push_back(builder_->getLabels()[level].size());
+    for (level_t level = 0; level < num_items_per_level_.size(); level++)
+	num_items_ += num_items_per_level_[level];
+    bv_ = new BitvectorRankInterleaved(builder_->getChildIndicatorBits(), num_items_per_level_);
+    expected_bv_ = new BitvectorRank(kRankBasicBlockSize, builder_->getChildIndicatorBits(),
+				     num_items_per_level_);
+}
+
+void RankInterleavedUnitTest::testSerialize() {
+    uint64_t size = bv_->serializedSize();
+    data_ = new char[size];
+    BitvectorRankInterleaved* ori_bv = bv_;
+    char* data = data_;
+    ori_bv->serialize(data);
+    ASSERT_EQ(size, (uint64_t)(data - data_));
+    const char* src = data_;
+    bv_ = new BitvectorRankInterleaved();
+    bv_->deSerialize(src);
+
+    ASSERT_EQ(ori_bv->numBits(), bv_->numBits());
+    ASSERT_EQ(ori_bv->blocksSize(), bv_->blocksSize());
+
+    ori_bv->destroy();
+    delete ori_bv;
+}
+
+void RankInterleavedUnitTest::testRank() {
+    ASSERT_EQ(num_items_, bv_->numBits());
+    for (position_t pos = 0; pos < num_items_; pos++)
+	ASSERT_EQ(expected_bv_->rank(pos), bv_->rank(pos));
+}
+
+TEST_F (RankInterleavedUnitTest, readBitTest) {
+    setupWordsTest();
+    position_t bv_pos = 0;
+    for (level_t level = 0; level < builder_->getTreeHeight(); level++) {
+	for (position_t pos = 0; pos < num_items_per_level_[level]; pos++) {
+	    bool expected_bit = SuRFBuilder::readBit(builder_->getChildIndicatorBits()[level], pos);
+	    ASSERT_EQ(expected_bit, bv_->readBit(bv_pos));
+	    bv_pos++;
+	}
+    }
+    bv_->destroy();
+    delete bv_;
+    expected_bv_->destroy();
+    delete expected_bv_;
+}
+
+TEST_F (RankInterleavedUnitTest, rankTest) {
+    setupWordsTest();
+    testRank();
+    bv_->destroy();
+    delete bv_;
+    expected_bv_->destroy();
+    delete expected_bv_;
+}
+
+TEST_F (RankInterleavedUnitTest, serializeTest) {
+    setupWordsTest();
+    testSerialize();
+    testRank();
+    bv_->destroy();
+    delete bv_;
+    expected_bv_->destroy();
+    delete expected_bv_;
+}
+
+void loadWordList() {
+    std::ifstream infile(kFilePath);
+    std::string key;
+    int count = 0;
+    while (infile.good() && count < kTestSize) {
+	infile >> key;
+	words.push_back(key);
+	count++;
+    }
+}
+
+} // namespace rankinterleavedtest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    surf::rankinterleavedtest::loadWordList();
+    return RUN_ALL_TESTS();
+}
@@ -104,6 +104,48 @@ TEST_F (SelectUnitTest, selectTest) {
     testSelect();
 }
 
+TEST_F (SelectUnitTest, selectRankLutTest) {
+    // long runs of 0's between dense clusters of 1's
+    static const position_t kNumBits = 200000;
+    std::vector<std::vector<word_t> > bits_per_level(1);
+    std::vector<position_t> num_bits_per_level(1, kNumBits);
+    bits_per_level[0].resize(kNumBits / kWordSize + 1, 0);
+    for (position_t pos = 0; pos < kNumBits; pos++) {
+	if ((pos % 3000 < 100 && pos % 3 == 0) || (pos % 777 == 0))
+	    bits_per_level[0][pos / kWordSize] |= (kMsbMask >> (pos % kWordSize));
+    }
+    for (position_t sample_interval = 1; sample_interval <= 128; sample_interval *= 4) {
+	bv_ = new BitvectorSelect(sample_interval, bits_per_level, num_bits_per_level, 0, 0, true);
+	num_items_ = kNumBits;
+	testSelect();
+	bv_->destroy();
+	delete bv_;
+    }
+}
+
+TEST_F (SelectUnitTest, select64Test) {
+    word_t words[4] = {0x8000000000000001ULL, 0xFFFFFFFFFFFFFFFFULL,
+		       0x0123456789ABCDEFULL, 0x5555555555555555ULL};
+    for (int i = 0; i < 4; i++) {
+	for (int k = 1; k <= popcount(words[i]); k++)
+	    ASSERT_EQ(select64_naive(words[i], k), select64(words[i], k));
+    }
+}
+
+TEST_F (SelectUnitTest, select64KernelsTest) {
+    uint64_t word = 0x0123456789ABCDEFULL;
+    for (int i = 0; i < 1000; i++) {
+	word = word * 6364136223846793005ULL + 1442695040888963407ULL;
+	for (int k = 1; k <= popcount(word); k++) {
+	    int expected = select64_naive(word, k);
+	    ASSERT_EQ(expected, select64_popcount_search(word, k));
+	    if (cpuFeatures().has_bmi2) {
+		ASSERT_EQ(expected, select64_pdep(word, k));
+	    }
+	}
+    }
+}
+
 TEST_F (SelectUnitTest, serializeTest) {
     setupWordsTest();
     testSerialize();
@@ -178,13 +178,17 @@ TEST_F (SuffixUnitTest, checkEqualityTest) {
 	    SuffixType suffix_type = suffix_type_array[i];
 	    level_t suffix_len = suffix_len_array[j];
 
+	    // fixed suffix lengths and the hash function of the
+	    // BitvectorSuffix below
             if (i == 0)
-                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, suffix_len, 0);
+                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, suffix_len, 0,
+                                           false, false, kLevelDbHash);
             else if (i == 1)
-                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, 0, suffix_len);
+                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, 0, suffix_len,
+                                           false, false, kLevelDbHash);
             else
-                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio,
-                                           suffix_type, suffix_len, suffix_len);
+                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type,
+                                           suffix_len, suffix_len, false, false, kLevelDbHash);
 	    builder_->build(words);
 
 	    level_t height = builder_->getLabels().size();
@@ -222,12 +226,14 @@ TEST_F (SuffixUnitTest, serializeTest) {
 	    SuffixType suffix_type = suffix_type_array[i];
 	    level_t suffix_len = suffix_len_array[j];
             if (i == 0)
-                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, suffix_len, 0);
+                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, suffix_len, 0,
+                                           false, false, kLevelDbHash);
             else if (i == 1)
-                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, 0, suffix_len);
+                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, 0, suffix_len,
+                                           false, false, kLevelDbHash);
             else
-                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio,
-                                           suffix_type, suffix_len, suffix_len);
+                builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type,
+                                           suffix_len, suffix_len, false, false, kLevelDbHash);
 	    builder_->build(words);
 
 	    level_t height = builder_->getLabels().size();
@@ -253,6 +259,127 @@ TEST_F (SuffixUnitTest, serializeTest) {
     }
 }
 
+TEST_F (SuffixUnitTest, splitLayoutTest) {
+    bool include_dense = false;
+    uint32_t sparse_dense_ratio = 0;
+    SuffixType suffix_type_array[3] = {kHash, kReal, kMixed};
+    level_t suffix_len_array[4] = {3, 8, 13, 16};
+    for (int i = 0; i < 3; i++) {
+	for (int j = 0; j < 4; j++) {
+	    SuffixType suffix_type = suffix_type_array[i];
+	    level_t hash_suffix_len = (suffix_type == kReal) ? 0 : suffix_len_array[j];
+	    level_t real_suffix_len = (suffix_type == kHash) ? 0 : suffix_len_array[j];
+	    builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type,
+				       hash_suffix_len, real_suffix_len, false);
+	    builder_->build(words);
+
+	    level_t height = builder_->getLabels().size();
+	    std::vector<position_t> num_suffix_bits_per_level;
+	    for (level_t level = 0; level < height; level++)
+		num_suffix_bits_per_level.push_back(builder_->getSuffixCounts()[level]
+						    * (hash_suffix_len + real_suffix_len));
+	    BitvectorSuffix* packed = new BitvectorSuffix(suffix_type, hash_suffix_len, real_suffix_len,
+							  builder_->getSuffixes(),
+							  num_suffix_bits_per_level, 0, height);
+	    BitvectorSuffix* split = new BitvectorSuffix(suffix_type, hash_suffix_len, real_suffix_len,
+							 builder_->getSuffixes(),
+							 num_suffix_bits_per_level, 0, height, true);
+	    ASSERT_FALSE(packed->isSplit());
+	    ASSERT_TRUE(split->isSplit());
+
+	    uint64_t size = split->serializedSize();
+	    data_ = new char[size];
+	    char* dst = data_;
+	    split->serialize(dst);
+	    ASSERT_EQ(size, (uint64_t)(dst - data_));
+	    const char* src = data_;
+	    BitvectorSuffix* split_copy = new BitvectorSuffix();
+	    split_copy->deSerialize(src);
+	    ASSERT_TRUE(split_copy->isSplit());
+
+	    position_t suffix_idx = 0;
+	    for (level_t level = 0; level < words_by_suffix_start_level_.size(); level++) {
+		for (unsigned k = 0; k < words_by_suffix_start_level_[level].size(); k++) {
+		    const std::string& word = words_by_suffix_start_level_[level][k];
+		    ASSERT_EQ(packed->read(suffix_idx), split->read(suffix_idx));
+		    ASSERT_EQ(packed->readReal(suffix_idx), split->readReal(suffix_idx));
+		    ASSERT_EQ(packed->checkEquality(suffix_idx, word, level + 1),
+			      split->checkEquality(suffix_idx, word, level + 1));
+		    ASSERT_EQ(packed->compare(suffix_idx, word, level + 1),
+			      split->compare(suffix_idx, word, level + 1));
+		    ASSERT_EQ(split->read(suffix_idx), split_copy->read(suffix_idx));
+		    suffix_idx++;
+		}
+	    }
+
+	    delete builder_;
+	    packed->destroy();
+	    delete packed;
+	    split->destroy();
+	    delete split;
+	    split_copy->destroy();
+	    delete split_copy;
+	    delete[] data_;
+	    data_ = nullptr;
+	}
+    }
+}
+
+TEST_F (SuffixUnitTest, wyHashTest) {
+    // a prepared key hashes once per hash function
+    std::string key = "somebody@example.com/some/long/path";
+    PreparedKey prepared_key(key);
+    ASSERT_EQ(WyHash(key.data(), key.size(), 0xbc9f1d34), prepared_key.hash(kWyHash));
+    ASSERT_EQ((uint64_t)suffixHash(key), prepared_key.hash(kLevelDbHash));
+    ASSERT_EQ(BitvectorSuffix::constructHashSuffix(key, 13, kWyHash),
+	      BitvectorSuffix::extractHashBits(prepared_key.hash(kWyHash), 13));
+
+    bool include_dense = false;
+    uint32_t sparse_dense_ratio = 0;
+    level_t suffix_len = 13;
+    SuffixType suffix_type_array[2] = {kHash, kMixed};
+    for (int i = 0; i < 2; i++) {
+	SuffixType suffix_type = suffix_type_array[i];
+	level_t real_suffix_len = (suffix_type == kMixed) ? suffix_len : 0;
+	builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type,
+				   suffix_len, real_suffix_len, false, false, kWyHash);
+	builder_->build(words);
+	ASSERT_EQ(kWyHash, builder_->getSuffixHash());
+
+	level_t height = builder_->getLabels().size();
+	std::vector<position_t> num_suffix_bits_per_level;
+	for (level_t level = 0; level < height; level++)
+	    num_suffix_bits_per_level.push_back(builder_->getSuffixCounts()[level]
+						* (suffix_len + real_suffix_len));
+	suffixes_ = new BitvectorSuffix(suffix_type, suffix_len, real_suffix_len,
+					builder_->getSuffixes(),
+					num_suffix_bits_per_level, 0, height);
+	suffixes_->setSuffixHash(kWyHash);
+	testSerialize();
+	ASSERT_EQ(kWyHash, suffixes_->getSuffixHash());
+
+	// all stored keys match, and about 1 in 2^13 other keys
+	position_t suffix_idx = 0;
+	position_t num_fp = 0;
+	for (level_t level = 0; level < words_by_suffix_start_level_.size(); level++) {
+	    for (unsigned k = 0; k < words_by_suffix_start_level_[level].size(); k++) {
+		const std::string& word = words_by_suffix_start_level_[level][k];
+		ASSERT_TRUE(suffixes_->checkEquality(suffix_idx, word, level + 1));
+		if (suffixes_->checkEquality(suffix_idx, word + "!", level + 1))
+		    num_fp++;
+		suffix_idx++;
+	    }
+	}
+	ASSERT_LT(num_fp * 100, suffix_idx);
+
+	delete builder_;
+	suffixes_->destroy();
+	delete suffixes_;
+	delete[] data_;
+	data_ = nullptr;
+    }
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
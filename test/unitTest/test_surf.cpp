@@ -2,18 +2,23 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 #include <string>
 #include <vector>
 
 #include "config.hpp"
 #include "surf.hpp"
+#include "surf_specialized.hpp"
 
 namespace surf {
 
 namespace surftest {
 
 static const std::string kFilePath = "../../../test/words.txt";
+// SuRF(every 200th word, true, 16, kMixed, 4, 4) serialized by version 0
+static const std::string kV0FilePath = "../../../test/surf_v0_words.bin";
 static const int kWordTestSize = 234369;
 static const uint64_t kIntTestStart = 10;
 static const int kIntTestBound = 1000001;
@@ -62,6 +67,13 @@ static int getMax(int a, int b) {
     return a;
 }
 
+static size_t getMaxLen(const std::vector<std::string>& keys) {
+    size_t max_len = 0;
+    for (unsigned i = 0; i < keys.size(); i++)
+	max_len = std::max(max_len, keys[i].length());
+    return max_len;
+}
+
 static bool isEqual(const std::string& a, const std::string& b, const unsigned bitlen) {
     if (bitlen == 0) {
 	return (a.compare(b) == 0);
@@ -199,6 +211,201 @@ TEST_F (SuRFUnitTest, lookupIntTest) {
     }
 }
 
+TEST_F (SuRFUnitTest, lookupWordBloomTest) {
+    uint64_t num_fp_trie = 0;
+    uint64_t num_fp_bloom = 0;
+    SuRF* surf_trie = new SuRF(words, kIncludeDense, kSparseDenseRatio, kNone, 0, 0);
+    surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, kNone, 0, 0, 10);
+    for (unsigned i = 0; i < words.size(); i++) {
+	ASSERT_TRUE(surf_->lookupKey(words[i]));
+	// not in the word list; the trie alone accepts it whenever
+	// words[i] is stored as a truncated prefix
+	std::string key = words[i] + (char)'\1';
+	if (surf_->lookupKey(key))
+	    num_fp_bloom++;
+	if (surf_trie->lookupKey(key))
+	    num_fp_trie++;
+    }
+    ASSERT_LT(num_fp_bloom * 10, num_fp_trie);
+
+    // range queries do not consult the Bloom filter
+    for (unsigned i = 0; i < words.size() - 1; i++) {
+	ASSERT_EQ(surf_trie->lookupRange(words[i], false, words[i+1], false),
+		  surf_->lookupRange(words[i], false, words[i+1], false));
+    }
+    delete surf_trie;
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, lookupWordFpProbabilityTest) {
+    for (int t = 0; t < kNumSuffixType; t++) {
+	SuffixType suffix_type = kSuffixTypeList[t];
+	level_t hash_suffix_len = ((suffix_type == kHash) || (suffix_type == kMixed)) ? 8 : 0;
+	level_t real_suffix_len = ((suffix_type == kReal) || (suffix_type == kMixed)) ? 8 : 0;
+	// fixed suffix lengths: adaptive ones bound the probability per level
+	surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, suffix_type,
+			 hash_suffix_len, real_suffix_len, kBloomBitsPerKey, kEncodeKeys,
+			 kExactKeys, false);
+	// a zero real suffix carries no information
+	double max_fp_probability = ((kSuffixTypeList[t] == kHash) || (kSuffixTypeList[t] == kMixed))
+	    ? (1.0 / 256) : 1.0;
+	for (unsigned i = 0; i < words.size(); i++) {
+	    double fp_probability = -1;
+	    ASSERT_TRUE(surf_->lookupKey(words[i], &fp_probability));
+	    ASSERT_GE(fp_probability, 0);
+	    ASSERT_LE(fp_probability, max_fp_probability);
+	    // stored as a prefix key: the match is exact
+	    if ((i < words.size() - 1) && (words[i + 1].compare(0, words[i].length(), words[i]) == 0)) {
+		ASSERT_EQ(0, fp_probability);
+	    }
+
+	    std::string key = words[i] + (char)'\1';
+	    if (!surf_->lookupKey(key, &fp_probability)) {
+		ASSERT_EQ(0, fp_probability);
+	    }
+	}
+	surf_->destroy();
+	delete surf_;
+    }
+
+    surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, kNone, 0, 0, 10);
+    for (unsigned i = 0; i < words.size(); i++) {
+	double fp_probability = -1;
+	ASSERT_TRUE(surf_->lookupKey(words[i], &fp_probability));
+	ASSERT_LT(fp_probability, 0.05);
+    }
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, lookupRangeFpProbabilityIntTest) {
+    newSuRFInts(kNone, 0);
+    SuRF::Iter iter;
+    for (uint64_t i = kIntTestSkip; i < kIntTestBound - kIntTestSkip; i += kIntTestSkip) {
+	double fp_probability = -1;
+	// the stored key i lies strictly inside the range
+	ASSERT_TRUE(surf_->lookupRange(uint64ToString(i - 1), true, uint64ToString(i + 1), true,
+				       &iter, &fp_probability));
+	ASSERT_EQ(0, fp_probability);
+	ASSERT_FALSE(surf_->lookupRange(uint64ToString(i + 1), true, uint64ToString(i + 2), true,
+					&iter, &fp_probability));
+	ASSERT_EQ(0, fp_probability);
+    }
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, longestPrefixMatchWordTest) {
+    // longer prefixes are not candidates
+    size_t max_len = getMaxLen(words);
+    for (int t = 0; t < kNumSuffixType; t++) {
+	for (int k = 0; k < kNumSuffixLen; k++) {
+	    newSuRFWords(kSuffixTypeList[t], kSuffixLenList[k]);
+	    for (unsigned i = 0; i < words.size(); i += 7) {
+		std::string query = words[i] + std::string("/path");
+		level_t depth = 0;
+		level_t match_len = surf_->longestPrefixMatch(query, &depth);
+		ASSERT_GE(match_len, (level_t)words[i].length());
+		ASSERT_LE(depth, (level_t)query.length());
+
+		level_t expected_len = 0;
+		for (level_t len = std::min(query.length(), max_len); len > 0; len--) {
+		    if (surf_->lookupKey(query.substr(0, len))) {
+			expected_len = len;
+			break;
+		    }
+		}
+		ASSERT_EQ(expected_len, match_len);
+	    }
+	    surf_->destroy();
+	    delete surf_;
+	}
+    }
+}
+
+TEST_F (SuRFUnitTest, longestPrefixMatchBloomTest) {
+    size_t max_len = getMaxLen(words);
+    surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8, 10);
+    for (unsigned i = 0; i < words.size(); i += 7) {
+	std::string query = words[i] + std::string("/path");
+	level_t match_len = surf_->longestPrefixMatch(query);
+	ASSERT_GE(match_len, (level_t)words[i].length());
+	level_t expected_len = 0;
+	for (level_t len = std::min(query.length(), max_len); len > 0; len--) {
+	    if (surf_->lookupKey(query.substr(0, len))) {
+		expected_len = len;
+		break;
+	    }
+	}
+	ASSERT_EQ(expected_len, match_len);
+    }
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, longestPrefixMatchLongKeyTest) {
+    // the stored keys end in leaves after their first byte
+    std::vector<std::string> keys = {"apple", "mango", "zebra"};
+    surf_ = new SuRF(keys, kIncludeDense, kSparseDenseRatio, kHash, 8, 0, 10);
+    std::string query = std::string("mango") + std::string(1 << 20, 'x');
+    ASSERT_EQ((level_t)5, surf_->longestPrefixMatch(query));
+    query = std::string("m") + std::string(1 << 20, 'x');
+    level_t match_len = surf_->longestPrefixMatch(query);
+    ASSERT_LE(match_len, (level_t)5);
+    for (level_t len = 5; len > match_len; len--)
+	ASSERT_FALSE(surf_->lookupKey(query.substr(0, len)));
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, lookupPatternWordTest) {
+    static const int kNumPatterns = 6;
+    KeyPattern patterns[kNumPatterns] = {KeyPattern("a?e"), KeyPattern("??x?"),
+					 KeyPattern("t?o?g*", '*'), KeyPattern("?????????q"),
+					 KeyPattern(""), KeyPattern()};
+    patterns[kNumPatterns - 1].addRange('m', 'o');
+    patterns[kNumPatterns - 1].addWildcard();
+    patterns[kNumPatterns - 1].addRange('a', 'e');
+
+    newSuRFWords(kReal, 8);
+    for (int p = 0; p < kNumPatterns; p++) {
+	std::vector<std::string> prefixes;
+	ASSERT_TRUE(surf_->enumeratePattern(patterns[p], prefixes));
+	for (unsigned i = 0; i < prefixes.size(); i++) {
+	    ASSERT_LE(prefixes[i].length(), patterns[p].size());
+	    ASSERT_TRUE(patterns[p].matchPrefix(prefixes[i]));
+	    if (i > 0) {
+		ASSERT_TRUE(prefixes[i - 1] < prefixes[i]);
+	    }
+	}
+
+	bool any_match = false;
+	for (unsigned i = 0; i < words.size(); i++) {
+	    if ((words[i].length() < patterns[p].size()) || !patterns[p].matchPrefix(words[i]))
+		continue;
+	    any_match = true;
+	    std::string prefix = words[i].substr(0, patterns[p].size());
+	    std::vector<std::string>::iterator it
+		= std::upper_bound(prefixes.begin(), prefixes.end(), prefix);
+	    ASSERT_TRUE(it != prefixes.begin());
+	    it--;
+	    ASSERT_EQ(0, prefix.compare(0, it->length(), *it));
+	}
+	ASSERT_EQ(!prefixes.empty(), surf_->lookupPattern(patterns[p]));
+	if (any_match) {
+	    ASSERT_TRUE(surf_->lookupPattern(patterns[p]));
+	}
+    }
+
+    KeyPattern absent_pattern;
+    absent_pattern.addByte(1);
+    absent_pattern.addWildcard();
+    ASSERT_FALSE(surf_->lookupPattern(absent_pattern));
+    surf_->destroy();
+    delete surf_;
+}
+
 TEST_F (SuRFUnitTest, moveToKeyGreaterThanWordTest) {
     for (int t = 2; t < kNumSuffixType; t++) {
 	for (int k = 0; k < kNumSuffixLen; k++) {
@@ -569,6 +776,397 @@ TEST_F (SuRFUnitTest, lookupRangeIntTest) {
     }
 }
 
+TEST_F (SuRFUnitTest, lookupRangeIterIntTest) {
+    for (int t = 0; t < kNumSuffixType; t++) {
+	newSuRFInts(kSuffixTypeList[t], 8);
+	SuRF::Iter iter;
+	for (uint64_t i = 0; i < kIntTestBound; i += 3) {
+	    std::string left_key = uint64ToString(i);
+	    std::string right_key = uint64ToString(i + 5);
+	    bool exist = surf_->lookupRange(left_key, false, right_key, true, &iter);
+	    ASSERT_EQ(surf_->lookupRange(left_key, false, right_key, true), exist);
+
+	    SuRF::Iter fresh_iter = surf_->moveToKeyGreaterThan(left_key, false);
+	    ASSERT_EQ(fresh_iter.isValid(), iter.isValid());
+	    if (!iter.isValid())
+		continue;
+	    unsigned bitlen, fresh_bitlen;
+	    std::string key = iter.getKeyWithSuffix(&bitlen);
+	    std::string fresh_key = fresh_iter.getKeyWithSuffix(&fresh_bitlen);
+	    ASSERT_EQ(fresh_key, key);
+	    ASSERT_EQ(fresh_bitlen, bitlen);
+	    if (!iter.getFpFlag()) {
+		uint64_t next_key = ((i / kIntTestSkip) + 1) * kIntTestSkip;
+		ASSERT_EQ(0, uint64ToString(next_key).compare(0, key.length(), key));
+	    }
+	}
+
+	// a cursor moved since its last call is not resumed
+	SuRF::Iter moved_iter;
+	ASSERT_TRUE(surf_->lookupRange(uint64ToString(5), true, uint64ToString(12), true,
+				       &moved_iter));
+	moved_iter++;
+	ASSERT_TRUE(surf_->lookupRange(uint64ToString(8), true, uint64ToString(15), true,
+				       &moved_iter));
+	// nor is one positioned for a larger left key
+	SuRF::Iter desc_iter;
+	ASSERT_TRUE(surf_->lookupRange(uint64ToString(25), true, uint64ToString(40), true,
+				       &desc_iter));
+	ASSERT_TRUE(surf_->lookupRange(uint64ToString(15), true, uint64ToString(22), true,
+				       &desc_iter));
+	surf_->destroy();
+	delete surf_;
+    }
+
+    // nor is one left by another filter
+    std::vector<std::string> keys = {"apple", "mango"};
+    std::vector<std::string> other_keys = {"apple", "date5"};
+    surf_ = new SuRF(keys);
+    SuRF* surf_other = new SuRF(other_keys);
+    SuRF::Iter shared_iter;
+    ASSERT_FALSE(surf_->lookupRange("c", true, "d", false, &shared_iter));
+    ASSERT_TRUE(surf_other->lookupRange("d", true, "e", false, &shared_iter));
+    ASSERT_EQ(std::string("d"), shared_iter.getKey());
+    delete surf_other;
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, encodedKeysWordTest) {
+    SuRF* surf_plain = new SuRF(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8);
+    surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8,
+		     kBloomBitsPerKey, true);
+    ASSERT_TRUE(surf_->isKeyEncoded());
+    ASSERT_FALSE(surf_plain->isKeyEncoded());
+    ASSERT_LT(surf_->serializedSize(), surf_plain->serializedSize());
+    for (unsigned i = 0; i < words.size(); i++)
+	ASSERT_TRUE(surf_->lookupKey(words[i]));
+    for (unsigned i = 0; i < words.size() - 1; i++) {
+	ASSERT_TRUE(surf_->lookupRange(words[i], true, words[i+1], false));
+	ASSERT_TRUE(surf_->lookupRange(words[i], false, words[i+1], true));
+    }
+
+    // no false negatives, and about as many false positives
+    std::vector<std::string> queries;
+    for (unsigned i = 0; i < words.size(); i += 3)
+	queries.push_back(words[i] + "ly");
+    uint64_t num_fp = 0, num_fp_plain = 0;
+    for (unsigned i = 0; i < queries.size(); i++) {
+	if (surf_->lookupKey(queries[i])) num_fp++;
+	if (surf_plain->lookupKey(queries[i])) num_fp_plain++;
+    }
+    ASSERT_LT(num_fp, num_fp_plain * 2 + 100);
+
+    // the byte-prefix queries never miss a stored key
+    size_t max_len = getMaxLen(words);
+    for (unsigned i = 0; i < words.size(); i += 97) {
+	std::string query = words[i] + std::string("/path");
+	level_t depth = 0;
+	level_t match_len = surf_->longestPrefixMatch(query, &depth);
+	ASSERT_GE(match_len, (level_t)words[i].length());
+	ASSERT_LE(depth, (level_t)query.length());
+	ASSERT_TRUE(surf_->lookupKey(query.substr(0, match_len)));
+	for (level_t len = match_len + 1; len <= std::min(query.length(), max_len); len++)
+	    ASSERT_FALSE(surf_->lookupKey(query.substr(0, len)));
+    }
+    // nor do the queries that leave the trie early
+    for (unsigned i = 0; i < words.size(); i += 89) {
+	std::string query = words[i].substr(0, words[i].length() / 2) + std::string("\1~/path");
+	level_t match_len = surf_->longestPrefixMatch(query);
+	for (level_t len = std::min(query.length(), max_len); len > match_len; len--)
+	    ASSERT_FALSE(surf_->lookupKey(query.substr(0, len)));
+	if (match_len > 0) {
+	    ASSERT_TRUE(surf_->lookupKey(query.substr(0, match_len)));
+	}
+    }
+    // the pattern queries cannot look at the encoded prefixes
+    ASSERT_TRUE(surf_->lookupPattern(KeyPattern("a?e")));
+    std::vector<std::string> prefixes;
+    ASSERT_FALSE(surf_->enumeratePattern(KeyPattern("a?e"), prefixes));
+    ASSERT_TRUE(prefixes.empty());
+
+    uint64_t size = surf_->serializedSize();
+    data_ = new char[size];
+    char* end = surf_->serialize(data_);
+    ASSERT_EQ(size, (uint64_t)(end - data_));
+    const char* src = data_;
+    SuRF* surf_ser = new SuRF();
+    surf_ser->deSerialize(src);
+    ASSERT_TRUE(surf_ser->isKeyEncoded());
+    for (unsigned i = 0; i < words.size(); i++)
+	ASSERT_TRUE(surf_ser->lookupKey(words[i]));
+
+    delete surf_ser;
+    delete surf_plain;
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, exactKeysWordTest) {
+    surf_ = new SuRF(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8,
+		     kBloomBitsPerKey, kEncodeKeys, true);
+    ASSERT_TRUE(surf_->isExact());
+    for (unsigned i = 0; i < words.size(); i++) {
+	double fp_probability = 1.0;
+	ASSERT_TRUE(surf_->lookupKey(words[i], &fp_probability));
+	ASSERT_EQ(0, fp_probability);
+    }
+
+    // no false positives, on extensions or on truncations
+    for (unsigned i = 0; i < words.size(); i++) {
+	std::string extended = words[i] + "ly";
+	std::string truncated = words[i].substr(0, words[i].length() - 1);
+	ASSERT_EQ(std::binary_search(words.begin(), words.end(), extended),
+		  surf_->lookupKey(extended));
+	ASSERT_EQ(std::binary_search(words.begin(), words.end(), truncated),
+		  surf_->lookupKey(truncated));
+    }
+
+    // the iterators see the full keys
+    SuRF::Iter iter = surf_->moveToFirst();
+    for (unsigned i = 0; i < words.size(); i++) {
+	ASSERT_TRUE(iter.isValid());
+	ASSERT_EQ(words[i], iter.getKey());
+	iter++;
+    }
+    ASSERT_FALSE(iter.isValid());
+    for (unsigned i = 1; i < words.size() - 1; i++) {
+	ASSERT_EQ(words[i], surf_->moveToKeyGreaterThan(words[i], true).getKey());
+	ASSERT_EQ(words[i+1], surf_->moveToKeyGreaterThan(words[i], false).getKey());
+	ASSERT_EQ(words[i], surf_->moveToKeyLessThan(words[i], true).getKey());
+	ASSERT_EQ(words[i-1], surf_->moveToKeyLessThan(words[i], false).getKey());
+	ASSERT_TRUE(surf_->lookupRange(words[i], true, words[i+1], false));
+	ASSERT_TRUE(surf_->lookupRange(words[i], false, words[i+1], true));
+	ASSERT_FALSE(surf_->lookupRange(words[i], false, words[i+1], false));
+    }
+
+    uint64_t size = surf_->serializedSize();
+    data_ = new char[size];
+    char* end = surf_->serialize(data_);
+    ASSERT_EQ(size, (uint64_t)(end - data_));
+    const char* src = data_;
+    SuRF* surf_ser = new SuRF();
+    surf_ser->deSerialize(src);
+    ASSERT_TRUE(surf_ser->isExact());
+    for (unsigned i = 0; i < words.size(); i++) {
+	ASSERT_TRUE(surf_ser->lookupKey(words[i]));
+	ASSERT_FALSE(surf_ser->lookupKey(words[i] + (char)kTerminator));
+    }
+
+    delete surf_ser;
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, promoteHotNodesWordTest) {
+    surf_ = new SuRF(words, kMixed, 4, 4);
+    SuRF* surf_plain = new SuRF(words, kMixed, 4, 4);
+    // a skewed sample: the queries for words starting with 's'
+    std::vector<std::string> sample_queries;
+    for (unsigned i = 0; i < words.size(); i++) {
+	if (words[i][0] == 's')
+	    sample_queries.push_back(words[i]);
+    }
+    uint64_t mem = surf_->getMemoryUsage();
+    surf_->promoteHotNodes(sample_queries);
+    ASSERT_GT(surf_->getMemoryUsage(), mem);
+    ASSERT_LE(surf_->getMemoryUsage(), mem + mem / kSparseDenseRatio);
+
+    for (unsigned i = 0; i < words.size(); i++) {
+	double fp_probability = 1.0, fp_probability_plain = 1.0;
+	ASSERT_TRUE(surf_->lookupKey(words[i], &fp_probability));
+	ASSERT_TRUE(surf_plain->lookupKey(words[i], &fp_probability_plain));
+	ASSERT_EQ(fp_probability_plain, fp_probability);
+	std::string extended = words[i] + "ly";
+	std::string truncated = words[i].substr(0, words[i].length() - 1);
+	ASSERT_EQ(surf_plain->lookupKey(extended), surf_->lookupKey(extended));
+	ASSERT_EQ(surf_plain->lookupKey(truncated), surf_->lookupKey(truncated));
+    }
+
+    uint64_t size = surf_->serializedSize();
+    data_ = new char[size];
+    char* end = surf_->serialize(data_);
+    ASSERT_EQ(size, (uint64_t)(end - data_));
+    const char* src = data_;
+    SuRF* surf_ser = new SuRF();
+    surf_ser->deSerialize(src);
+    ASSERT_EQ(surf_->getMemoryUsage(), surf_ser->getMemoryUsage());
+    for (unsigned i = 0; i < words.size(); i++)
+	ASSERT_TRUE(surf_ser->lookupKey(words[i]));
+
+    delete surf_ser;
+    delete surf_plain;
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, adaptiveSuffixesWordTest) {
+    // 4-byte prefixes of the odd words probe a filter of the even words
+    std::vector<std::string> keys, queries, sample_queries;
+    for (unsigned i = 0; i < words.size(); i++) {
+	if (i % 2 == 0)
+	    keys.push_back(words[i]);
+	else if (words[i].length() > 4)
+	    queries.push_back(words[i].substr(0, 4));
+    }
+    for (unsigned i = 0; i < queries.size(); i += 4)
+	sample_queries.push_back(queries[i]);
+
+    SuRF* surf_uniform = new SuRF(keys, kIncludeDense, kSparseDenseRatio, kHash, 2, 0,
+				  kBloomBitsPerKey, kEncodeKeys, kExactKeys, false);
+    surf_ = new SuRF(keys, kIncludeDense, kSparseDenseRatio, kHash, 2, 0,
+		     kBloomBitsPerKey, kEncodeKeys, kExactKeys, true, sample_queries);
+    for (unsigned i = 0; i < keys.size(); i++)
+	ASSERT_TRUE(surf_->lookupKey(keys[i]));
+    uint64_t num_fp = 0, num_fp_uniform = 0;
+    for (unsigned i = 0; i < queries.size(); i++) {
+	if (std::binary_search(keys.begin(), keys.end(), queries[i]))
+	    continue;
+	if (surf_->lookupKey(queries[i])) num_fp++;
+	if (surf_uniform->lookupKey(queries[i])) num_fp_uniform++;
+    }
+    ASSERT_LT(num_fp, num_fp_uniform);
+
+    delete surf_uniform;
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, specializedLookupWordTest) {
+    surf_ = new SuRF(words, kMixed, 4, 4);
+    SuRFSpecialized<kMixed>* surf_mixed = new SuRFSpecialized<kMixed>(words, 4, 4);
+    SuRFSpecialized<kReal, 256, 64>* surf_real = new SuRFSpecialized<kReal, 256, 64>(words, 0, 8);
+    SuRF* surf_real_plain = new SuRF();
+    surf_real_plain->create(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8,
+			    kBloomBitsPerKey, kEncodeKeys, kExactKeys, 256, 64);
+    ASSERT_TRUE(SuRFSpecialized<kMixed>::matches(*surf_));
+    ASSERT_FALSE((SuRFSpecialized<kReal>::matches(*surf_real_plain)));
+    ASSERT_TRUE((SuRFSpecialized<kReal, 256, 64>::matches(*surf_real_plain)));
+
+    // the type-erased lookup specializes for the default directories only
+    SpecializedLookup lookup(surf_);
+    SpecializedLookup lookup_real(surf_real_plain);
+    ASSERT_TRUE(lookup.isSpecialized());
+    ASSERT_FALSE(lookup_real.isSpecialized());
+
+    for (unsigned i = 0; i < words.size(); i++) {
+	std::string extended = words[i] + "ly";
+	std::string truncated = words[i].substr(0, words[i].length() - 1);
+	std::vector<std::string> keys = {words[i], extended, truncated};
+	for (unsigned j = 0; j < keys.size(); j++) {
+	    double fp_probability = 1.0, fp_probability_specialized = 1.0;
+	    bool found = surf_->lookupKey(keys[j], &fp_probability);
+	    ASSERT_EQ(found, surf_mixed->lookupKey(keys[j], &fp_probability_specialized));
+	    ASSERT_EQ(fp_probability, fp_probability_specialized);
+	    ASSERT_EQ(found, lookup.lookupKey(keys[j]));
+	    found = surf_real_plain->lookupKey(keys[j]);
+	    ASSERT_EQ(found, surf_real->lookupKey(keys[j]));
+	    ASSERT_EQ(found, lookup_real.lookupKey(keys[j]));
+	}
+    }
+
+    delete surf_real_plain;
+    delete surf_real;
+    delete surf_mixed;
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, specializedDeSerializeWordTest) {
+    surf_ = new SuRF(words, kHash, 8, 0);
+    uint64_t size = surf_->serializedSize();
+    data_ = new char[size];
+    surf_->serialize(data_);
+
+    const char* src = data_;
+    SuRFSpecialized<kHash>* surf_hash = new SuRFSpecialized<kHash>();
+    ASSERT_TRUE(surf_hash->deSerialize(src));
+    ASSERT_EQ(size, (uint64_t)(src - data_));
+    for (unsigned i = 0; i < words.size(); i++)
+	ASSERT_TRUE(surf_hash->lookupKey(words[i]));
+
+    // an image of another suffix type is refused
+    src = data_;
+    SuRFSpecialized<kReal>* surf_real = new SuRFSpecialized<kReal>();
+    ASSERT_FALSE(surf_real->deSerialize(src));
+    src = data_;
+    SuRFSpecialized<kHash, 256>* surf_block = new SuRFSpecialized<kHash, 256>();
+    ASSERT_FALSE(surf_block->deSerialize(src));
+
+    delete surf_block;
+    delete surf_real;
+    delete surf_hash;
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, wyHashWordTest) {
+    surf_ = new SuRF();
+    surf_->create(words, kIncludeDense, kSparseDenseRatio, kHash, 8, 0, 10, kEncodeKeys,
+		  kExactKeys, kDenseRankBlockSize, kSparseSelectSampleInterval, kWyHash);
+    SuRF* surf_leveldb = new SuRF(words, kIncludeDense, kSparseDenseRatio, kHash, 8, 0, 10);
+    uint64_t num_fp = 0;
+    uint64_t num_fp_leveldb = 0;
+    for (unsigned i = 0; i < words.size(); i++) {
+	ASSERT_TRUE(surf_->lookupKey(words[i]));
+	std::string key = words[i] + (char)'\1';
+	if (surf_->lookupKey(key))
+	    num_fp++;
+	if (surf_leveldb->lookupKey(key))
+	    num_fp_leveldb++;
+    }
+    // both hashes are good enough for the suffixes and the Bloom filter
+    ASSERT_LT(num_fp, 2 * num_fp_leveldb + 100);
+
+    // the hash function is serialized with the filter
+    testSerialize();
+    for (unsigned i = 0; i < words.size(); i++)
+	ASSERT_TRUE(surf_->lookupKey(words[i]));
+
+    delete surf_leveldb;
+    surf_->destroy();
+    delete surf_;
+}
+
+TEST_F (SuRFUnitTest, deSerializeVersion0Test) {
+    std::ifstream infile(kV0FilePath, std::ios::binary);
+    std::string image((std::istreambuf_iterator<char>(infile)),
+		      std::istreambuf_iterator<char>());
+    ASSERT_FALSE(image.empty());
+    std::vector<std::string> keys;
+    for (unsigned i = 0; i < words.size(); i += 200)
+	keys.push_back(words[i]);
+
+    const char* src = image.data();
+    surf_ = new SuRF();
+    ASSERT_TRUE(surf_->deSerialize(src));
+    ASSERT_EQ(image.size(), (size_t)(src - image.data()));
+    // the same filter, built and serialized by this version
+    // (version 0 hash suffixes use the LevelDB hash)
+    SuRF* surf_new = new SuRF();
+    surf_new->create(keys, true, 16, kMixed, 4, 4, 0, false, false, kDenseRankBlockSize,
+		     kSparseSelectSampleInterval, kLevelDbHash, false);
+    uint64_t size = surf_new->serializedSize();
+    data_ = new char[size];
+    surf_new->serialize(data_);
+    src = data_;
+    SuRF* surf_ser = new SuRF();
+    ASSERT_TRUE(surf_ser->deSerialize(src));
+    ASSERT_EQ(size, (uint64_t)(src - data_));
+    for (unsigned i = 0; i < keys.size(); i++)
+	ASSERT_TRUE(surf_->lookupKey(keys[i]));
+    for (unsigned i = 0; i < words.size() - 1; i++) {
+	ASSERT_EQ(surf_new->lookupKey(words[i]), surf_->lookupKey(words[i]));
+	ASSERT_EQ(surf_new->lookupKey(words[i]), surf_ser->lookupKey(words[i]));
+	ASSERT_EQ(surf_new->lookupRange(words[i], true, words[i + 1], false),
+		  surf_->lookupRange(words[i], true, words[i + 1], false));
+    }
+
+    // newer versions are refused
+    data_[7]++;
+    src = data_;
+    SuRF* surf_newer = new SuRF();
+    ASSERT_FALSE(surf_newer->deSerialize(src));
+
+    delete surf_newer;
+    delete surf_ser;
+    delete surf_new;
+    delete surf_;
+}
+
 TEST_F (SuRFUnitTest, approxCountWordTest) {
     newSuRFWords(kReal, 8);
     const int num_start_indexes = 5;